@@ -0,0 +1,196 @@
+/*
+ * Generic FIQ service for AVIC interrupt sources
+ *
+ * The ARM core has a single FIQ vector, so all sources switched to FIQ
+ * share one entry which dispatches to the handler registered for each
+ * pending source. Handlers pass their data to a bottom half running as
+ * a normal interrupt, which is raised by forcing an otherwise unused
+ * AVIC source.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/interrupt.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <asm/fiq.h>
+#include <mach/irqs.h>
+#include <mach/avic-fiq.h>
+
+#include "irq-common.h"
+
+#define AVIC_FIQ_STACK_SIZE	1024
+
+extern unsigned char avic_fiq_entry_start, avic_fiq_entry_end;
+
+static struct mxc_fiq *avic_fiqs[AVIC_NUM_IRQS];
+static unsigned long avic_fiq_stack[AVIC_FIQ_STACK_SIZE / sizeof(long)] __aligned(8);
+static unsigned int avic_fiq_users;
+static DEFINE_MUTEX(avic_fiq_lock);
+
+static struct fiq_handler avic_fh = {
+	.name	= "avic-fiq",
+};
+
+/* called in FIQ mode from avic_fiq_entry_start */
+static asmlinkage void notrace avic_fiq_dispatch(void)
+{
+	struct mxc_fiq *fiq;
+	int irq;
+
+	while ((irq = avic_fiq_pending()) >= 0) {
+		fiq = avic_fiqs[irq];
+		if (unlikely(!fiq)) {
+			/* would stay pending and never let us leave FIQ mode */
+			avic_fiq_reject(irq);
+			continue;
+		}
+		fiq->count++;
+		fiq->handler(fiq);
+	}
+}
+
+/* may be called in FIQ mode */
+void mxc_fiq_kick(struct mxc_fiq *fiq)
+{
+	avic_force_irq(fiq->kick_irq, 1);
+}
+
+static irqreturn_t avic_fiq_kick_irq(int irq, void *dev_id)
+{
+	struct mxc_fiq *fiq = dev_id;
+
+	/*
+	 * Clear the force bit before draining the ring, so a kick for data
+	 * put after this raises the interrupt again. The force register is
+	 * shared with the kicks of other sources, keep the FIQ handlers
+	 * from modifying it in between.
+	 */
+	local_fiq_disable();
+	avic_force_irq(irq, 0);
+	local_fiq_enable();
+
+	fiq->bottom_half(fiq);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Switches fiq->irq to FIQ and allocates a ring of ring_size words,
+ * which may be zero if the handler needs no ring. The caller has to
+ * enable the interrupt in the peripheral afterwards.
+ */
+int mxc_fiq_register(struct mxc_fiq *fiq, unsigned int ring_size)
+{
+	struct pt_regs regs;
+	int ret;
+
+	if (fiq->irq >= AVIC_NUM_IRQS || !fiq->handler)
+		return -EINVAL;
+
+	if (fiq->bottom_half && fiq->kick_irq >= AVIC_NUM_IRQS)
+		return -EINVAL;
+
+	if (ring_size && !is_power_of_2(ring_size))
+		return -EINVAL;
+
+	if (is_module_address((unsigned long)fiq) ||
+	    is_module_address((unsigned long)fiq->handler)) {
+		pr_err("%s: FIQ handlers can not live in modules\n", fiq->name);
+		return -EINVAL;
+	}
+
+	fiq->ring.buf = NULL;
+	if (ring_size) {
+		fiq->ring.buf = kcalloc(ring_size, sizeof(u32), GFP_KERNEL);
+		if (!fiq->ring.buf)
+			return -ENOMEM;
+	}
+	fiq->ring.size = ring_size;
+	fiq->ring.head = 0;
+	fiq->ring.tail = 0;
+	fiq->ring.overruns = 0;
+	fiq->count = 0;
+
+	mutex_lock(&avic_fiq_lock);
+
+	if (avic_fiqs[fiq->irq]) {
+		ret = -EBUSY;
+		goto err_unlock;
+	}
+
+	if (!avic_fiq_users) {
+		ret = claim_fiq(&avic_fh);
+		if (ret) {
+			pr_err("%s: FIQ is in use\n", fiq->name);
+			goto err_unlock;
+		}
+
+		set_fiq_handler(&avic_fiq_entry_start,
+				&avic_fiq_entry_end - &avic_fiq_entry_start);
+
+		memset(&regs, 0, sizeof(regs));
+		regs.ARM_r9 = (long)avic_fiq_dispatch;
+		regs.ARM_sp = (long)(avic_fiq_stack + ARRAY_SIZE(avic_fiq_stack));
+		set_fiq_regs(&regs);
+	}
+
+	if (fiq->bottom_half) {
+		ret = request_irq(fiq->kick_irq, avic_fiq_kick_irq, 0,
+				  fiq->name, fiq);
+		if (ret)
+			goto err_release;
+	}
+
+	avic_fiqs[fiq->irq] = fiq;
+	mxc_set_irq_fiq(fiq->irq, 1);
+	enable_fiq(fiq->irq);
+	avic_fiq_users++;
+
+	mutex_unlock(&avic_fiq_lock);
+
+	return 0;
+
+err_release:
+	if (!avic_fiq_users)
+		release_fiq(&avic_fh);
+err_unlock:
+	mutex_unlock(&avic_fiq_lock);
+	kfree(fiq->ring.buf);
+	fiq->ring.buf = NULL;
+
+	return ret;
+}
+
+/*
+ * The caller has to disable the interrupt in the peripheral first. The
+ * bottom half has finished when this returns.
+ */
+void mxc_fiq_unregister(struct mxc_fiq *fiq)
+{
+	mutex_lock(&avic_fiq_lock);
+
+	disable_fiq(fiq->irq);
+	mxc_set_irq_fiq(fiq->irq, 0);
+	avic_fiqs[fiq->irq] = NULL;
+
+	if (fiq->bottom_half) {
+		free_irq(fiq->kick_irq, fiq);
+		local_fiq_disable();
+		avic_force_irq(fiq->kick_irq, 0);
+		local_fiq_enable();
+	}
+
+	if (!--avic_fiq_users)
+		release_fiq(&avic_fh);
+
+	mutex_unlock(&avic_fiq_lock);
+
+	kfree(fiq->ring.buf);
+	fiq->ring.buf = NULL;
+}
@@ -47,8 +47,6 @@
 #define AVIC_FIPNDH		0x60	/* fast int pending high */
 #define AVIC_FIPNDL		0x64	/* fast int pending low */
 
-#define AVIC_NUM_IRQS 64
-
 void __iomem *avic_base;
 
 static u32 avic_saved_mask_reg[2];
@@ -93,6 +91,50 @@ static int avic_set_irq_fiq(unsigned int irq, unsigned int type)
 }
 #endif /* CONFIG_FIQ */
 
+#ifdef CONFIG_MXC_AVIC_FIQ
+/*
+ * The two helpers below are used by avic-fiq.c and may be called in FIQ
+ * mode, so they must not take any locks.
+ */
+
+/* returns the lowest pending fast interrupt source or -1 if there is none */
+int avic_fiq_pending(void)
+{
+	u32 pnd;
+
+	pnd = __raw_readl(avic_base + AVIC_FIPNDL);
+	if (pnd)
+		return __ffs(pnd);
+
+	pnd = __raw_readl(avic_base + AVIC_FIPNDH);
+	if (pnd)
+		return __ffs(pnd) + AVIC_NUM_IRQS / 2;
+
+	return -1;
+}
+
+/* raise or clear an interrupt source by software */
+void avic_force_irq(unsigned int irq, int force)
+{
+	void __iomem *reg = avic_base + AVIC_INTFRCL;
+	u32 frc;
+
+	if (irq >= AVIC_NUM_IRQS / 2) {
+		reg = avic_base + AVIC_INTFRCH;
+		irq -= AVIC_NUM_IRQS / 2;
+	}
+
+	frc = __raw_readl(reg) & ~(1 << irq);
+	__raw_writel(frc | (!!force << irq), reg);
+}
+
+/* mask a fast interrupt nobody handles and turn it back into a normal one */
+void avic_fiq_reject(unsigned int irq)
+{
+	__raw_writel(irq, avic_base + AVIC_INTDISNUM);
+	avic_set_irq_fiq(irq, 0);
+}
+#endif /* CONFIG_MXC_AVIC_FIQ */
 
 static struct mxc_extra_irq avic_extra_irq = {
 #ifdef CONFIG_MXC_IRQ_PRIOR
@@ -27,6 +27,16 @@
 		.irq = soc ## _INT_UART ## _hwid,			\
 	}
 
+#define imx_imx_uart_1irq_dma_data_entry(soc, _id, _hwid, _size)	\
+	[_id] = {							\
+		.id = _id,						\
+		.iobase = soc ## _UART ## _hwid ## _BASE_ADDR,		\
+		.iosize = _size,					\
+		.irq = soc ## _INT_UART ## _hwid,			\
+		.dmarx = soc ## _DMA_REQ_UART ## _hwid ## _RX,		\
+		.dmatx = soc ## _DMA_REQ_UART ## _hwid ## _TX,		\
+	}
+
 #ifdef CONFIG_SOC_IMX1
 const struct imx_imx_uart_3irq_data imx1_imx_uart_data[] __initconst = {
 #define imx1_imx_uart_data_entry(_id, _hwid)				\
@@ -50,7 +60,7 @@ const struct imx_imx_uart_1irq_data imx21_imx_uart_data[] __initconst = {
 #ifdef CONFIG_SOC_IMX25
 const struct imx_imx_uart_1irq_data imx25_imx_uart_data[] __initconst = {
 #define imx25_imx_uart_data_entry(_id, _hwid)				\
-	imx_imx_uart_1irq_data_entry(MX25, _id, _hwid, SZ_16K)
+	imx_imx_uart_1irq_dma_data_entry(MX25, _id, _hwid, SZ_16K)
 	imx25_imx_uart_data_entry(0, 1),
 	imx25_imx_uart_data_entry(1, 2),
 	imx25_imx_uart_data_entry(2, 3),
@@ -169,10 +179,25 @@ struct platform_device *__init imx_add_imx_uart_1irq(
 			.start = data->irq,
 			.end = data->irq,
 			.flags = IORESOURCE_IRQ,
+		}, {
+			.name = "rx",
+			.start = data->dmarx,
+			.end = data->dmarx,
+			.flags = IORESOURCE_DMA,
+		}, {
+			.name = "tx",
+			.start = data->dmatx,
+			.end = data->dmatx,
+			.flags = IORESOURCE_DMA,
 		},
 	};
+	unsigned int nres = ARRAY_SIZE(res);
+
+	/* only pass the DMA resources if the SoC data provides them */
+	if (!data->dmarx || !data->dmatx)
+		nres -= 2;
 
 	/* i.mx21 type uart runs on all i.mx except i.mx1 */
 	return imx_add_platform_device("imx21-uart", data->id,
-			res, ARRAY_SIZE(res), pdata, sizeof(*pdata));
+			res, nres, pdata, sizeof(*pdata));
 }
@@ -0,0 +1,59 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+#include <mach/hardware.h>
+#include <mach/devices-common.h>
+
+struct imx_sahara_data {
+	resource_size_t iobase;
+	resource_size_t irq;
+};
+
+#define imx_sahara_data_entry_single(soc)				\
+	{								\
+		.iobase = soc ## _SAHARA_BASE_ADDR,			\
+		.irq = soc ## _INT_SAHARA,				\
+	}
+
+#ifdef CONFIG_SOC_IMX27
+static const struct imx_sahara_data imx27_sahara_data __initconst =
+	imx_sahara_data_entry_single(MX27);
+#endif /* ifdef CONFIG_SOC_IMX27 */
+
+static struct platform_device *__init imx_add_sahara(
+		const struct imx_sahara_data *data)
+{
+	struct resource res[] = {
+		{
+			.start = data->iobase,
+			.end = data->iobase + SZ_4K - 1,
+			.flags = IORESOURCE_MEM,
+		}, {
+			.start = data->irq,
+			.end = data->irq,
+			.flags = IORESOURCE_IRQ,
+		},
+	};
+	return imx_add_platform_device("sahara", -1,
+			res, ARRAY_SIZE(res), NULL, 0);
+}
+
+static int __init imxXX_add_sahara(void)
+{
+	struct platform_device *ret;
+
+#if defined(CONFIG_SOC_IMX27)
+	if (cpu_is_mx27())
+		ret = imx_add_sahara(&imx27_sahara_data);
+	else
+#endif /* if defined(CONFIG_SOC_IMX27) */
+		ret = ERR_PTR(-ENODEV);
+
+	if (IS_ERR(ret))
+		return PTR_ERR(ret);
+
+	return 0;
+}
+arch_initcall(imxXX_add_sahara);
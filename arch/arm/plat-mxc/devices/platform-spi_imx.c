@@ -21,6 +21,17 @@
 #define imx_spi_imx_data_entry(soc, type, devid, id, hwid, size)	\
 	[id] = imx_spi_imx_data_entry_single(soc, type, devid, id, hwid, size)
 
+#define imx_spi_imx_data_entry_dma(soc, type, _devid, _id, hwid, _size)	\
+	[_id] = {							\
+		.devid = _devid,					\
+		.id = _id,						\
+		.iobase = soc ## _ ## type ## hwid ## _BASE_ADDR,	\
+		.iosize = _size,					\
+		.irq = soc ## _INT_ ## type ## hwid,			\
+		.dmarx = soc ## _DMA_REQ_ ## type ## hwid ## _RX,	\
+		.dmatx = soc ## _DMA_REQ_ ## type ## hwid ## _TX,	\
+	}
+
 #ifdef CONFIG_SOC_IMX1
 const struct imx_spi_imx_data imx1_cspi_data[] __initconst = {
 #define imx1_cspi_data_entry(_id, _hwid) \
@@ -43,7 +54,7 @@ const struct imx_spi_imx_data imx21_cspi_data[] __initconst = {
 /* i.mx25 has the i.mx35 type cspi */
 const struct imx_spi_imx_data imx25_cspi_data[] __initconst = {
 #define imx25_cspi_data_entry(_id, _hwid)				\
-	imx_spi_imx_data_entry(MX25, CSPI, "imx35-cspi", _id, _hwid, SZ_16K)
+	imx_spi_imx_data_entry_dma(MX25, CSPI, "imx35-cspi", _id, _hwid, SZ_16K)
 	imx25_cspi_data_entry(1, 1),
 	imx25_cspi_data_entry(0, 2),
 	imx25_cspi_data_entry(2, 3),
@@ -119,9 +130,24 @@ struct platform_device *__init imx_add_spi_imx(
 			.start = data->irq,
 			.end = data->irq,
 			.flags = IORESOURCE_IRQ,
+		}, {
+			.name = "rx",
+			.start = data->dmarx,
+			.end = data->dmarx,
+			.flags = IORESOURCE_DMA,
+		}, {
+			.name = "tx",
+			.start = data->dmatx,
+			.end = data->dmatx,
+			.flags = IORESOURCE_DMA,
 		},
 	};
+	unsigned int nres = ARRAY_SIZE(res);
+
+	/* only pass the DMA resources if the SoC data provides them */
+	if (!data->dmarx || !data->dmatx)
+		nres -= 2;
 
 	return imx_add_platform_device(data->devid, data->id,
-			res, ARRAY_SIZE(res), pdata, sizeof(*pdata));
+			res, nres, pdata, sizeof(*pdata));
 }
@@ -0,0 +1,89 @@
+/*
+ * Generic FIQ service for AVIC interrupt sources
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __MACH_AVIC_FIQ_H
+#define __MACH_AVIC_FIQ_H
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <asm/system.h>
+
+/*
+ * Single producer, single consumer ring of words. The FIQ handler is the
+ * producer and the bottom half the consumer, so neither side needs a
+ * lock. head and tail run freely, size is a power of two.
+ */
+struct mxc_fiq_ring {
+	u32		*buf;
+	unsigned int	size;
+	unsigned int	head;		/* written by the producer only */
+	unsigned int	tail;		/* written by the consumer only */
+	unsigned int	overruns;	/* words dropped because of a full ring */
+};
+
+static inline int mxc_fiq_ring_put(struct mxc_fiq_ring *ring, u32 val)
+{
+	unsigned int head = ring->head;
+
+	if (head - ACCESS_ONCE(ring->tail) >= ring->size) {
+		ring->overruns++;
+		return -ENOSPC;
+	}
+
+	ring->buf[head & (ring->size - 1)] = val;
+	smp_wmb();
+	ring->head = head + 1;
+
+	return 0;
+}
+
+static inline int mxc_fiq_ring_get(struct mxc_fiq_ring *ring, u32 *val)
+{
+	unsigned int tail = ring->tail;
+
+	if (tail == ACCESS_ONCE(ring->head))
+		return -EAGAIN;
+
+	smp_rmb();
+	*val = ring->buf[tail & (ring->size - 1)];
+	smp_mb();
+	ring->tail = tail + 1;
+
+	return 0;
+}
+
+/*
+ * @handler is called in FIQ mode whenever @irq is pending and has to
+ * clear the interrupt in the peripheral. It runs on a small private
+ * stack with all interrupts masked and must not take locks, sleep,
+ * printk or use anything that relies on the current task. It can only
+ * reach code and data that are mapped in every page table: the kernel
+ * image, kmalloc memory and the static io mappings, but not modules,
+ * vmalloc or ioremap space outside of the static mappings.
+ *
+ * @bottom_half, if set, runs as the normal interrupt handler of
+ * @kick_irq, an AVIC source without a peripheral behind it on the SoC,
+ * and is scheduled from the FIQ handler by mxc_fiq_kick().
+ */
+struct mxc_fiq {
+	const char		*name;
+	unsigned int		irq;
+	unsigned int		kick_irq;
+	void			(*handler)(struct mxc_fiq *fiq);
+	void			(*bottom_half)(struct mxc_fiq *fiq);
+	struct mxc_fiq_ring	ring;
+	unsigned long		count;	/* FIQs serviced */
+	void			*priv;
+};
+
+int mxc_fiq_register(struct mxc_fiq *fiq, unsigned int ring_size);
+void mxc_fiq_unregister(struct mxc_fiq *fiq);
+void mxc_fiq_kick(struct mxc_fiq *fiq);
+
+#endif /* __MACH_AVIC_FIQ_H */
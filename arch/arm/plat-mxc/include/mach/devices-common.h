@@ -162,6 +162,9 @@ struct imx_imx_uart_1irq_data {
 	resource_size_t iobase;
 	resource_size_t iosize;
 	resource_size_t irq;
+	/* SDMA event numbers, 0 if the port is used without DMA */
+	resource_size_t dmarx;
+	resource_size_t dmatx;
 };
 struct platform_device *__init imx_add_imx_uart_1irq(
 		const struct imx_imx_uart_1irq_data *data,
@@ -313,6 +316,9 @@ struct imx_spi_imx_data {
 	resource_size_t iobase;
 	resource_size_t iosize;
 	int irq;
+	/* SDMA event numbers, 0 if the controller is used without DMA */
+	int dmarx;
+	int dmatx;
 };
 struct platform_device *__init imx_add_spi_imx(
 		const struct imx_spi_imx_data *data,
@@ -51,6 +51,21 @@
 #define DMACR_HM(x)	(((x) & 0xf) << 16)
 #define DMACR_TM(x)	((x) & 0xf)
 
+/*
+ * Damage updates: with a back buffer, the area of the frame buffer mmap
+ * starting at PAGE_ALIGN(smem_len) is a cached copy of one frame. After
+ * drawing into it, IMXFB_IOCTL_DAMAGE copies a rectangle to the frame
+ * being scanned out.
+ */
+struct imxfb_rect {
+	__u32 x;
+	__u32 y;
+	__u32 width;
+	__u32 height;
+};
+
+#define IMXFB_IOCTL_DAMAGE	_IOW('F', 0x40, struct imxfb_rect)
+
 struct imx_fb_videomode {
 	struct fb_videomode mode;
 	u32 pcr;
@@ -73,6 +88,11 @@ struct imx_fb_platform_data {
 	u_char * fixed_screen_cpu;
 	dma_addr_t fixed_screen_dma;
 
+	/* frames in video RAM for page flipping, 0 means 1 */
+	u_int		num_buffers;
+	/* cached back buffer for IMXFB_IOCTL_DAMAGE */
+	u_int		damage_buffer:1;
+
 	int (*init)(struct platform_device *);
 	void (*exit)(struct platform_device *);
 
@@ -98,6 +98,18 @@
 #define MX25_INT_GPIO1		52
 #define MX25_INT_FEC		57
 
+#define MX25_DMA_REQ_CSPI2_RX	6
+#define MX25_DMA_REQ_CSPI2_TX	7
+#define MX25_DMA_REQ_CSPI1_RX	8
+#define MX25_DMA_REQ_CSPI1_TX	9
+#define MX25_DMA_REQ_UART3_RX	10
+#define MX25_DMA_REQ_UART3_TX	11
+#define MX25_DMA_REQ_UART4_RX	12
+#define MX25_DMA_REQ_UART4_TX	13
+#define MX25_DMA_REQ_UART2_RX	16
+#define MX25_DMA_REQ_UART2_TX	17
+#define MX25_DMA_REQ_UART1_RX	18
+#define MX25_DMA_REQ_UART1_TX	19
 #define MX25_DMA_REQ_SSI2_RX1	22
 #define MX25_DMA_REQ_SSI2_TX1	23
 #define MX25_DMA_REQ_SSI2_RX0	24
@@ -106,6 +118,10 @@
 #define MX25_DMA_REQ_SSI1_TX1	27
 #define MX25_DMA_REQ_SSI1_RX0	28
 #define MX25_DMA_REQ_SSI1_TX0	29
+#define MX25_DMA_REQ_CSPI3_RX	34
+#define MX25_DMA_REQ_CSPI3_TX	35
+#define MX25_DMA_REQ_UART5_RX	46
+#define MX25_DMA_REQ_UART5_TX	47
 
 #ifndef __ASSEMBLY__
 extern int mx25_revision(void);
@@ -26,6 +26,7 @@ struct mxc_nand_platform_data {
 	unsigned int width;	/* data bus width in bytes */
 	unsigned int hw_ecc:1;	/* 0 if suppress hardware ECC */
 	unsigned int flash_bbt:1; /* set to 1 to use a flash based bbt */
+	unsigned int cache_read:1; /* set to 1 if the chip has read cache (31h/3Fh) */
 	struct mtd_partition *parts;	/* partition table */
 	int nr_parts;			/* size of parts */
 };
@@ -19,10 +19,16 @@
 #ifndef __PLAT_MXC_IRQ_COMMON_H__
 #define __PLAT_MXC_IRQ_COMMON_H__
 
+#define AVIC_NUM_IRQS 64
+
 struct mxc_extra_irq
 {
 	int (*set_priority)(unsigned char irq, unsigned char prio);
 	int (*set_irq_fiq)(unsigned int irq, unsigned int type);
 };
 
+int avic_fiq_pending(void);
+void avic_force_irq(unsigned int irq, int force);
+void avic_fiq_reject(unsigned int irq);
+
 #endif
@@ -25,6 +25,8 @@
 #include <linux/irq.h>
 #include <linux/clockchips.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <mach/hardware.h>
 #include <asm/sched_clock.h>
@@ -57,6 +59,7 @@
 /* MX31, MX35, MX25, MX5 */
 #define V2_TCTL_WAITEN		(1 << 3) /* Wait enable mode */
 #define V2_TCTL_CLK_IPG		(1 << 6)
+#define V2_TCTL_CLK_32K		(4 << 6)
 #define V2_TCTL_FRR		(1 << 9)
 #define V2_IR			0x0c
 #define V2_TSTAT		0x08
@@ -67,10 +70,169 @@
 #define timer_is_v1()	(cpu_is_mx1() || cpu_is_mx21() || cpu_is_mx27())
 #define timer_is_v2()	(!timer_is_v1())
 
+/*
+ * Shortest event we program: long enough to cover the register write
+ * and the interrupt entry on the fast IPG clock, and at least a few
+ * ticks for the compare to synchronise when running from 32 kHz.
+ */
+#define MXC_TIMER_MIN_DELTA_NS	4000
+#define MXC_TIMER_MIN_TICKS	3
+
 static struct clock_event_device clockevent_mxc;
 static enum clock_event_mode clockevent_mode = CLOCK_EVT_MODE_UNUSED;
 
 static void __iomem *timer_base;
+static unsigned long timer_rate;
+
+/*
+ * "mxc_gpt=32k" runs the v2 timer from the always-on 32 kHz clock
+ * instead of IPG, trading resolution for a timer that doesn't depend
+ * on the IPG clock.
+ */
+static int timer_use_32k;
+
+static int __init mxc_gpt_setup(char *str)
+{
+	if (!strcmp(str, "32k"))
+		timer_use_32k = 1;
+	else if (!strcmp(str, "ipg"))
+		timer_use_32k = 0;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("mxc_gpt", mxc_gpt_setup);
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Expiry latency of the clock event device, i.e. counter value at
+ * interrupt entry minus the programmed compare value. Bucket n holds
+ * latencies of [2^(n-1), 2^n) ticks, bucket 0 the exact hits.
+ */
+#define MXC_TIMER_LAT_BUCKETS	33
+
+static struct {
+	u32		expected;
+	bool		armed;
+	unsigned long	programmed;
+	unsigned long	etime;
+	unsigned long	expired;
+	unsigned long	spurious;
+	u32		max;
+	unsigned long	lat[MXC_TIMER_LAT_BUCKETS];
+} timer_stats;
+
+static inline void mxc_timer_stat_program(u32 tcmp, int ret)
+{
+	timer_stats.programmed++;
+	if (ret) {
+		timer_stats.etime++;
+		return;
+	}
+	timer_stats.expected = tcmp;
+	timer_stats.armed = true;
+}
+
+static inline void mxc_timer_stat_expire(u32 tcn)
+{
+	u32 lat;
+
+	if (!timer_stats.armed) {
+		timer_stats.spurious++;
+		return;
+	}
+	timer_stats.armed = false;
+
+	lat = tcn - timer_stats.expected;
+	timer_stats.expired++;
+	timer_stats.lat[fls(lat)]++;
+	if (lat > timer_stats.max)
+		timer_stats.max = lat;
+}
+
+static unsigned long long mxc_timer_ticks2ns(u64 ticks)
+{
+	return div_u64(ticks * NSEC_PER_SEC, timer_rate);
+}
+
+static int mxc_timer_stats_show(struct seq_file *s, void *unused)
+{
+	unsigned long flags;
+	typeof(timer_stats) stats;
+	int i;
+
+	local_irq_save(flags);
+	stats = timer_stats;
+	local_irq_restore(flags);
+
+	seq_printf(s, "clock:      %lu Hz, min delta %llu ns\n", timer_rate,
+			clockevent_mxc.min_delta_ns);
+	seq_printf(s, "programmed: %lu\n", stats.programmed);
+	seq_printf(s, "too late:   %lu\n", stats.etime);
+	seq_printf(s, "expired:    %lu\n", stats.expired);
+	seq_printf(s, "spurious:   %lu\n", stats.spurious);
+	seq_printf(s, "max:        %llu ns\n", mxc_timer_ticks2ns(stats.max));
+	seq_printf(s, "latency (ns)\n");
+
+	for (i = 0; i < MXC_TIMER_LAT_BUCKETS; i++) {
+		if (!stats.lat[i])
+			continue;
+		seq_printf(s, "%10llu - %10llu: %lu\n",
+			   i ? mxc_timer_ticks2ns(1ULL << (i - 1)) : 0,
+			   mxc_timer_ticks2ns(i ? 1ULL << i : 1),
+			   stats.lat[i]);
+	}
+
+	return 0;
+}
+
+static int mxc_timer_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mxc_timer_stats_show, NULL);
+}
+
+/* any write clears the counters */
+static ssize_t mxc_timer_stats_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	memset(&timer_stats, 0, sizeof(timer_stats));
+	local_irq_restore(flags);
+
+	return count;
+}
+
+static const struct file_operations mxc_timer_stats_fops = {
+	.open = mxc_timer_stats_open,
+	.read = seq_read,
+	.write = mxc_timer_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init mxc_timer_debugfs_init(void)
+{
+	if (!timer_base)
+		return 0;
+
+	if (!debugfs_create_file("mxc_timer", 0644, NULL, NULL,
+				 &mxc_timer_stats_fops))
+		pr_warning("Failed to create mxc_timer debugfs file\n");
+
+	return 0;
+}
+late_initcall(mxc_timer_debugfs_init);
+#else
+static inline void mxc_timer_stat_program(u32 tcmp, int ret)
+{
+}
+
+static inline void mxc_timer_stat_expire(u32 tcn)
+{
+}
+#endif
 
 static inline void gpt_irq_disable(void)
 {
@@ -122,9 +284,9 @@ static void notrace mxc_update_sched_clock(void)
 	update_sched_clock(&cd, cyc, (u32)~0);
 }
 
-static int __init mxc_clocksource_init(struct clk *timer_clk)
+static int __init mxc_clocksource_init(void)
 {
-	unsigned int c = clk_get_rate(timer_clk);
+	unsigned int c = timer_rate;
 	void __iomem *reg = timer_base + (timer_is_v2() ? V2_TCN : MX1_2_TCN);
 
 	sched_clock_reg = reg;
@@ -136,30 +298,48 @@ static int __init mxc_clocksource_init(struct clk *timer_clk)
 
 /* clock event */
 
+/*
+ * The compare only matches when the counter steps onto it, so an event
+ * the counter has already reached is reported as -ETIME and the core
+ * retries with a larger delta. Deltas of 2^31 ticks and more look like
+ * the past in this check and are always accepted.
+ */
 static int mx1_2_set_next_event(unsigned long evt,
 			      struct clock_event_device *unused)
 {
 	unsigned long tcmp;
+	int ret;
 
 	tcmp = __raw_readl(timer_base + MX1_2_TCN) + evt;
 
 	__raw_writel(tcmp, timer_base + MX1_2_TCMP);
 
-	return (int)(tcmp - __raw_readl(timer_base + MX1_2_TCN)) < 0 ?
+	ret = evt < 0x7fffffff &&
+		(int)(tcmp - __raw_readl(timer_base + MX1_2_TCN)) <= 0 ?
 				-ETIME : 0;
+
+	mxc_timer_stat_program(tcmp, ret);
+
+	return ret;
 }
 
 static int v2_set_next_event(unsigned long evt,
 			      struct clock_event_device *unused)
 {
 	unsigned long tcmp;
+	int ret;
 
 	tcmp = __raw_readl(timer_base + V2_TCN) + evt;
 
 	__raw_writel(tcmp, timer_base + V2_TCMP);
 
-	return (int)(tcmp - __raw_readl(timer_base + V2_TCN)) < 0 ?
+	ret = evt < 0x7fffffff &&
+		(int)(tcmp - __raw_readl(timer_base + V2_TCN)) <= 0 ?
 				-ETIME : 0;
+
+	mxc_timer_stat_program(tcmp, ret);
+
+	return ret;
 }
 
 #ifdef DEBUG
@@ -239,12 +419,19 @@ static irqreturn_t mxc_timer_interrupt(int irq, void *dev_id)
 {
 	struct clock_event_device *evt = &clockevent_mxc;
 	uint32_t tstat;
+	uint32_t tcn = __raw_readl(sched_clock_reg);
 
 	if (timer_is_v2())
 		tstat = __raw_readl(timer_base + V2_TSTAT);
 	else
 		tstat = __raw_readl(timer_base + MX1_2_TSTAT);
 
+	/* nothing matched, don't wake up the timer core for nothing */
+	if (timer_is_v2() && !(tstat & V2_TSTAT_OF1))
+		return IRQ_NONE;
+
+	mxc_timer_stat_expire(tcn);
+
 	gpt_irq_acknowledge();
 
 	evt->event_handler(evt);
@@ -267,9 +454,10 @@ static struct clock_event_device clockevent_mxc = {
 	.rating		= 200,
 };
 
-static int __init mxc_clockevent_init(struct clk *timer_clk)
+static int __init mxc_clockevent_init(void)
 {
-	unsigned int c = clk_get_rate(timer_clk);
+	unsigned int c = timer_rate;
+	unsigned long min_ticks;
 
 	if (timer_is_v2())
 		clockevent_mxc.set_next_event = v2_set_next_event;
@@ -278,8 +466,10 @@ static int __init mxc_clockevent_init(struct clk *timer_clk)
 					clockevent_mxc.shift);
 	clockevent_mxc.max_delta_ns =
 			clockevent_delta2ns(0xfffffffe, &clockevent_mxc);
+	min_ticks = max_t(unsigned long, MXC_TIMER_MIN_TICKS,
+			DIV_ROUND_UP(c, NSEC_PER_SEC / MXC_TIMER_MIN_DELTA_NS));
 	clockevent_mxc.min_delta_ns =
-			clockevent_delta2ns(0xff, &clockevent_mxc);
+			clockevent_delta2ns(min_ticks, &clockevent_mxc);
 
 	clockevent_mxc.cpumask = cpumask_of(0);
 
@@ -303,7 +493,17 @@ void __init mxc_timer_init(struct clk *timer_clk, void __iomem *base, int irq)
 	__raw_writel(0, timer_base + MXC_TCTL);
 	__raw_writel(0, timer_base + MXC_TPRER); /* see datasheet note */
 
-	if (timer_is_v2())
+	timer_rate = clk_get_rate(timer_clk);
+
+	if (timer_use_32k && !timer_is_v2()) {
+		pr_warning("mxc_gpt=32k is only supported by the v2 timer\n");
+		timer_use_32k = 0;
+	}
+
+	if (timer_use_32k) {
+		tctl_val = V2_TCTL_CLK_32K | V2_TCTL_FRR | V2_TCTL_WAITEN | MXC_TCTL_TEN;
+		timer_rate = 32768;
+	} else if (timer_is_v2())
 		tctl_val = V2_TCTL_CLK_IPG | V2_TCTL_FRR | V2_TCTL_WAITEN | MXC_TCTL_TEN;
 	else
 		tctl_val = MX1_2_TCTL_FRR | MX1_2_TCTL_CLK_PCLK1 | MXC_TCTL_TEN;
@@ -311,8 +511,8 @@ void __init mxc_timer_init(struct clk *timer_clk, void __iomem *base, int irq)
 	__raw_writel(tctl_val, timer_base + MXC_TCTL);
 
 	/* init and register the timer to the framework */
-	mxc_clocksource_init(timer_clk);
-	mxc_clockevent_init(timer_clk);
+	mxc_clocksource_init();
+	mxc_clockevent_init();
 
 	/* Make irqs happen */
 	setup_irq(irq, &mxc_timer_irq);
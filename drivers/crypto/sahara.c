@@ -0,0 +1,1301 @@
+/*
+ * Cryptographic API.
+ *
+ * Support for the SAHARA2 cryptographic accelerator found on the i.MX27.
+ *
+ * The engine runs chains of descriptors from memory. Each descriptor
+ * loads key, IV or hash context into one of the accelerators (SKHA for
+ * AES, MDHA for SHA) or pushes data through it, with the data described
+ * by lists of links. Only one chain runs at a time, so requests are
+ * queued and handed to the engine one after the other by a kernel
+ * thread.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/internal/hash.h>
+#include <crypto/scatterwalk.h>
+#include <crypto/sha.h>
+
+#include <linux/clk.h>
+#include <linux/crypto.h>
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#define SAHARA_NAME		"sahara"
+#define SAHARA_VERSION_3	3
+#define SAHARA_VERSION_4	4
+#define SAHARA_TIMEOUT_MS	1000
+#define SAHARA_MAX_HW_DESC	2
+#define SAHARA_MAX_HW_LINK	20
+#define SAHARA_QUEUE_LENGTH	50
+#define SAHARA_PRIORITY		300
+
+/* CTR keystream is generated in chunks of this many bytes */
+#define SAHARA_CTR_CHUNK	PAGE_SIZE
+/* restoring the context, the remainder and saving the context take one */
+#define SAHARA_SHA_MAX_LINKS	(SAHARA_MAX_HW_LINK - 3)
+
+#define FLAGS_MODE_MASK		0x000f
+#define FLAGS_ENCRYPT		(1 << 0)
+#define FLAGS_CBC		(1 << 1)
+#define FLAGS_CTR		(1 << 2)
+
+/* descriptor headers, the parity bit makes the number of set bits odd */
+#define SAHARA_HDR_BASE			0x00800000
+#define SAHARA_HDR_SKHA_ALG_AES		0
+#define SAHARA_HDR_SKHA_OP_ENC		(1 << 2)
+#define SAHARA_HDR_SKHA_MODE_ECB	(0 << 3)
+#define SAHARA_HDR_SKHA_MODE_CBC	(1 << 3)
+#define SAHARA_HDR_FORM_DATA		(5 << 16)
+#define SAHARA_HDR_FORM_KEY		(8 << 16)
+#define SAHARA_HDR_LLO			(1 << 24)
+#define SAHARA_HDR_CHA_SKHA		(1 << 28)
+#define SAHARA_HDR_CHA_MDHA		(2 << 28)
+#define SAHARA_HDR_PARITY_BIT		(1 << 31)
+
+#define SAHARA_HDR_MDHA_SET_MODE_MD_KEY	0x20880000
+#define SAHARA_HDR_MDHA_SET_MODE_HASH	0x208D0000
+#define SAHARA_HDR_MDHA_HASH		0xA0850000
+#define SAHARA_HDR_MDHA_STORE_DIGEST	0x20820000
+#define SAHARA_HDR_MDHA_ALG_SHA1	0
+#define SAHARA_HDR_MDHA_ALG_MD5		1
+#define SAHARA_HDR_MDHA_ALG_SHA256	2
+#define SAHARA_HDR_MDHA_ALG_SHA224	3
+#define SAHARA_HDR_MDHA_PDATA		(1 << 2)
+#define SAHARA_HDR_MDHA_HMAC		(1 << 3)
+#define SAHARA_HDR_MDHA_INIT		(1 << 5)
+#define SAHARA_HDR_MDHA_IPAD		(1 << 6)
+#define SAHARA_HDR_MDHA_OPAD		(1 << 7)
+#define SAHARA_HDR_MDHA_SWAP		(1 << 8)
+#define SAHARA_HDR_MDHA_MAC_FULL	(1 << 9)
+#define SAHARA_HDR_MDHA_SSL		(1 << 10)
+
+/* registers */
+#define SAHARA_REG_VERSION	0x00
+#define SAHARA_REG_DAR		0x04
+#define SAHARA_REG_CONTROL	0x08
+#define		SAHARA_CONTROL_SET_THROTTLE(x)	(((x) & 0xff) << 24)
+#define		SAHARA_CONTROL_SET_MAXBURST(x)	(((x) & 0xff) << 16)
+#define		SAHARA_CONTROL_RNG_AUTORSD	(1 << 7)
+#define		SAHARA_CONTROL_ENABLE_INT	(1 << 4)
+#define SAHARA_REG_CMD		0x0C
+#define		SAHARA_CMD_RESET		(1 << 0)
+#define		SAHARA_CMD_CLEAR_INT		(1 << 8)
+#define		SAHARA_CMD_CLEAR_ERR		(1 << 9)
+#define		SAHARA_CMD_SINGLE_STEP		(1 << 10)
+#define		SAHARA_CMD_MODE_BATCH		(1 << 16)
+#define		SAHARA_CMD_MODE_DEBUG		(1 << 18)
+#define SAHARA_REG_STATUS	0x10
+#define		SAHARA_STATUS_GET_STATE(x)	((x) & 0x7)
+#define			SAHARA_STATE_IDLE	0
+#define			SAHARA_STATE_BUSY	1
+#define			SAHARA_STATE_ERR	2
+#define			SAHARA_STATE_FAULT	3
+#define			SAHARA_STATE_COMPLETE	4
+#define			SAHARA_STATE_COMP_FLAG	(1 << 2)
+#define		SAHARA_STATUS_DAR_FULL		(1 << 3)
+#define		SAHARA_STATUS_ERROR		(1 << 4)
+#define		SAHARA_STATUS_SECURE		(1 << 5)
+#define		SAHARA_STATUS_FAIL		(1 << 6)
+#define		SAHARA_STATUS_INIT		(1 << 7)
+#define		SAHARA_STATUS_RNG_RESEED	(1 << 8)
+#define		SAHARA_STATUS_ACTIVE_RNG	(1 << 9)
+#define		SAHARA_STATUS_ACTIVE_MDHA	(1 << 10)
+#define		SAHARA_STATUS_ACTIVE_SKHA	(1 << 11)
+#define		SAHARA_STATUS_MODE_BATCH	(1 << 16)
+#define		SAHARA_STATUS_MODE_DEDICATED	(1 << 17)
+#define		SAHARA_STATUS_MODE_DEBUG	(1 << 18)
+#define		SAHARA_STATUS_GET_ISTATE(x)	(((x) >> 24) & 0xff)
+#define SAHARA_REG_ERRSTATUS	0x14
+#define		SAHARA_ERRSTATUS_GET_SOURCE(x)	((x) & 0xf)
+#define			SAHARA_ERRSOURCE_CHA	14
+#define			SAHARA_ERRSOURCE_DMA	15
+#define		SAHARA_ERRSTATUS_DMA_DIR	(1 << 8)
+#define		SAHARA_ERRSTATUS_GET_DMASZ(x)	(((x) >> 9) & 0x3)
+#define		SAHARA_ERRSTATUS_GET_DMASRC(x)	(((x) >> 13) & 0x7)
+#define		SAHARA_ERRSTATUS_GET_CHASRC(x)	(((x) >> 16) & 0xfff)
+#define		SAHARA_ERRSTATUS_GET_CHAERR(x)	(((x) >> 28) & 0x3)
+#define SAHARA_REG_FADDR	0x18
+#define SAHARA_REG_CDAR		0x1C
+#define SAHARA_REG_IDAR		0x20
+
+struct sahara_hw_desc {
+	u32	hdr;
+	u32	len1;
+	u32	p1;
+	u32	len2;
+	u32	p2;
+	u32	next;
+};
+
+struct sahara_hw_link {
+	u32	len;
+	u32	p;
+	u32	next;
+};
+
+/*
+ * Everything the engine reads or writes besides the request data, in
+ * one coherent allocation.
+ */
+struct sahara_hw {
+	struct sahara_hw_desc	desc[SAHARA_MAX_HW_DESC];
+	struct sahara_hw_link	link[SAHARA_MAX_HW_LINK];
+	u8			key[AES_KEYSIZE_128];
+	u8			iv[AES_BLOCK_SIZE];
+	u8			context[SHA256_DIGEST_SIZE + 4];
+	u8			rembuf[SHA256_BLOCK_SIZE];
+};
+
+struct sahara_ctx {
+	int			keylen;
+	u8			key[AES_KEYSIZE_128];
+	struct crypto_ablkcipher *fallback;
+};
+
+struct sahara_aes_reqctx {
+	unsigned long		mode;
+};
+
+/*
+ * Hash state between update calls. Data is only handed to the engine
+ * in whole blocks, except for the last call, where the engine pads.
+ * The rest waits in buf. Between calls the engine's context (digest
+ * and message length) lives in context.
+ */
+struct sahara_sha_reqctx {
+	u8			buf[SHA256_BLOCK_SIZE];
+	u8			context[SHA256_DIGEST_SIZE + 4];
+	unsigned int		mode;
+	unsigned int		digest_size;
+	unsigned int		context_size;
+	unsigned int		buf_cnt;
+	unsigned int		last;
+	unsigned int		first;
+	unsigned int		active;
+};
+
+struct sahara_dev {
+	struct device		*device;
+	unsigned int		version;
+	void __iomem		*regs_base;
+	struct clk		*clk;
+	int			irq;
+
+	spinlock_t		queue_lock;
+	struct crypto_queue	queue;
+	struct task_struct	*kthread;
+	struct completion	dma_completion;
+
+	struct sahara_hw	*hw;
+	dma_addr_t		hw_phys;
+
+	/* CTR counter blocks, encrypted in place into keystream */
+	u8			*ctr_buf;
+	/* CTR data, XORed with the keystream */
+	u8			*ctr_data;
+
+	int			error;
+};
+
+static struct sahara_dev *dev_ptr;
+
+#define sahara_phys(dev, ptr) \
+	((dev)->hw_phys + ((u8 *)(ptr) - (u8 *)(dev)->hw))
+
+static inline void sahara_write(struct sahara_dev *dev, u32 data, u32 reg)
+{
+	writel(data, dev->regs_base + reg);
+}
+
+static inline unsigned int sahara_read(struct sahara_dev *dev, u32 reg)
+{
+	return readl(dev->regs_base + reg);
+}
+
+static u32 sahara_hdr_parity(u32 hdr)
+{
+	if (!(hweight32(hdr) & 1))
+		hdr |= SAHARA_HDR_PARITY_BIT;
+	return hdr;
+}
+
+static char *sahara_err_src[16] = {
+	"No error",
+	"Header error",
+	"Descriptor length error",
+	"Descriptor length or pointer error",
+	"Link length error",
+	"Link pointer error",
+	"Input buffer error",
+	"Output buffer error",
+	"Output buffer starvation",
+	"Internal state fault",
+	"General descriptor problem",
+	"Reserved",
+	"Descriptor address error",
+	"Link address error",
+	"CHA error",
+	"DMA error"
+};
+
+static void sahara_decode_error(struct sahara_dev *dev, unsigned int error)
+{
+	u8 source = SAHARA_ERRSTATUS_GET_SOURCE(error);
+
+	dev_err(dev->device, "%s: error 0x%08x: %s (CHA source 0x%03x)\n",
+		__func__, error, sahara_err_src[source],
+		SAHARA_ERRSTATUS_GET_CHASRC(error));
+}
+
+static irqreturn_t sahara_irq_handler(int irq, void *data)
+{
+	struct sahara_dev *dev = data;
+	unsigned int stat = sahara_read(dev, SAHARA_REG_STATUS);
+	unsigned int err = sahara_read(dev, SAHARA_REG_ERRSTATUS);
+
+	sahara_write(dev, SAHARA_CMD_CLEAR_INT | SAHARA_CMD_CLEAR_ERR,
+		     SAHARA_REG_CMD);
+
+	if (SAHARA_STATUS_GET_STATE(stat) == SAHARA_STATE_BUSY)
+		return IRQ_NONE;
+
+	if (SAHARA_STATUS_GET_STATE(stat) == SAHARA_STATE_COMPLETE) {
+		dev->error = 0;
+	} else {
+		sahara_decode_error(dev, err);
+		dev->error = -EINVAL;
+	}
+
+	complete(&dev->dma_completion);
+
+	return IRQ_HANDLED;
+}
+
+static void sahara_reset_hw(struct sahara_dev *dev)
+{
+	sahara_write(dev, SAHARA_CMD_RESET | SAHARA_CMD_MODE_BATCH,
+		     SAHARA_REG_CMD);
+	sahara_write(dev, SAHARA_CONTROL_SET_THROTTLE(0) |
+			SAHARA_CONTROL_SET_MAXBURST(8) |
+			SAHARA_CONTROL_RNG_AUTORSD |
+			SAHARA_CONTROL_ENABLE_INT,
+			SAHARA_REG_CONTROL);
+}
+
+/* Start the descriptor chain and sleep until the engine is done. */
+static int sahara_run(struct sahara_dev *dev)
+{
+	unsigned long timeout;
+
+	INIT_COMPLETION(dev->dma_completion);
+
+	wmb();
+	sahara_write(dev, sahara_phys(dev, &dev->hw->desc[0]), SAHARA_REG_DAR);
+
+	timeout = wait_for_completion_timeout(&dev->dma_completion,
+				msecs_to_jiffies(SAHARA_TIMEOUT_MS));
+	if (!timeout) {
+		dev_err(dev->device, "timeout, resetting the engine\n");
+		sahara_reset_hw(dev);
+		return -ETIMEDOUT;
+	}
+
+	return dev->error;
+}
+
+/* number of sg entries that cover nbytes */
+static int sahara_sg_length(struct scatterlist *sg, unsigned int nbytes)
+{
+	int nents = 0;
+
+	while (nbytes && sg) {
+		nbytes -= min(sg->length, nbytes);
+		nents++;
+		sg = sg_next(sg);
+	}
+
+	return nents;
+}
+
+/*
+ * Describe nbytes of a mapped sg list with links, starting at link
+ * first. Returns the index of the next free link.
+ */
+static int sahara_sg_links(struct sahara_dev *dev, struct scatterlist *sg,
+		int nents, unsigned int nbytes, int first)
+{
+	struct sahara_hw_link *link = dev->hw->link;
+	int i;
+
+	for (i = first; i < first + nents; i++) {
+		link[i].len = min(sg_dma_len(sg), nbytes);
+		link[i].p = sg_dma_address(sg);
+		link[i].next = sahara_phys(dev, &link[i + 1]);
+		nbytes -= link[i].len;
+		sg = sg_next(sg);
+	}
+	link[i - 1].next = 0;
+
+	return i;
+}
+
+/*
+ * AES
+ */
+
+/* descriptor 0: load mode, IV and key into SKHA */
+static void sahara_aes_key_desc(struct sahara_dev *dev,
+		struct sahara_ctx *ctx, unsigned long mode)
+{
+	struct sahara_hw_desc *desc = &dev->hw->desc[0];
+	u32 hdr;
+
+	hdr = SAHARA_HDR_BASE | SAHARA_HDR_SKHA_ALG_AES | SAHARA_HDR_FORM_KEY |
+		SAHARA_HDR_LLO | SAHARA_HDR_CHA_SKHA;
+	if (mode & FLAGS_CBC)
+		hdr |= SAHARA_HDR_SKHA_MODE_CBC;
+	if (mode & FLAGS_ENCRYPT)
+		hdr |= SAHARA_HDR_SKHA_OP_ENC;
+
+	memcpy(dev->hw->key, ctx->key, ctx->keylen);
+
+	desc->hdr = sahara_hdr_parity(hdr);
+	if (mode & FLAGS_CBC) {
+		desc->len1 = AES_BLOCK_SIZE;
+		desc->p1 = sahara_phys(dev, dev->hw->iv);
+	} else {
+		desc->len1 = 0;
+		desc->p1 = 0;
+	}
+	desc->len2 = ctx->keylen;
+	desc->p2 = sahara_phys(dev, dev->hw->key);
+	desc->next = sahara_phys(dev, &dev->hw->desc[1]);
+}
+
+/* descriptor 1: run nbytes through SKHA, in and out as link lists */
+static void sahara_aes_data_desc(struct sahara_dev *dev, unsigned int nbytes,
+		int in_link, int out_link)
+{
+	struct sahara_hw_desc *desc = &dev->hw->desc[1];
+
+	desc->hdr = sahara_hdr_parity(SAHARA_HDR_BASE | SAHARA_HDR_FORM_DATA |
+				      SAHARA_HDR_CHA_SKHA);
+	desc->len1 = nbytes;
+	desc->p1 = sahara_phys(dev, &dev->hw->link[in_link]);
+	desc->len2 = nbytes;
+	desc->p2 = sahara_phys(dev, &dev->hw->link[out_link]);
+	desc->next = 0;
+}
+
+static int sahara_aes_process(struct ablkcipher_request *req)
+{
+	struct sahara_dev *dev = dev_ptr;
+	struct sahara_ctx *ctx = crypto_ablkcipher_ctx(
+					crypto_ablkcipher_reqtfm(req));
+	struct sahara_aes_reqctx *rctx = ablkcipher_request_ctx(req);
+	unsigned int nbytes = req->nbytes;
+	u8 next_iv[AES_BLOCK_SIZE];
+	int nb_in, nb_out, link, ret;
+
+	nb_in = sahara_sg_length(req->src, nbytes);
+	nb_out = sahara_sg_length(req->dst, nbytes);
+	if (nb_in + nb_out > SAHARA_MAX_HW_LINK) {
+		dev_err(dev->device, "not enough hw links (%d)\n",
+			nb_in + nb_out);
+		return -EINVAL;
+	}
+
+	if (rctx->mode & FLAGS_CBC) {
+		memcpy(dev->hw->iv, req->info, AES_BLOCK_SIZE);
+		/* the last ciphertext block chains into the next request */
+		if (!(rctx->mode & FLAGS_ENCRYPT))
+			scatterwalk_map_and_copy(next_iv, req->src,
+				nbytes - AES_BLOCK_SIZE, AES_BLOCK_SIZE, 0);
+	}
+
+	if (!dma_map_sg(dev->device, req->src, nb_in, DMA_TO_DEVICE))
+		return -EINVAL;
+	if (!dma_map_sg(dev->device, req->dst, nb_out, DMA_FROM_DEVICE)) {
+		dma_unmap_sg(dev->device, req->src, nb_in, DMA_TO_DEVICE);
+		return -EINVAL;
+	}
+
+	sahara_aes_key_desc(dev, ctx, rctx->mode);
+	link = sahara_sg_links(dev, req->src, nb_in, nbytes, 0);
+	sahara_sg_links(dev, req->dst, nb_out, nbytes, link);
+	sahara_aes_data_desc(dev, nbytes, 0, link);
+
+	ret = sahara_run(dev);
+
+	dma_unmap_sg(dev->device, req->dst, nb_out, DMA_FROM_DEVICE);
+	dma_unmap_sg(dev->device, req->src, nb_in, DMA_TO_DEVICE);
+
+	if (!ret && rctx->mode & FLAGS_CBC) {
+		if (rctx->mode & FLAGS_ENCRYPT)
+			scatterwalk_map_and_copy(req->info, req->dst,
+				nbytes - AES_BLOCK_SIZE, AES_BLOCK_SIZE, 0);
+		else
+			memcpy(req->info, next_iv, AES_BLOCK_SIZE);
+	}
+
+	return ret;
+}
+
+/*
+ * CTR: the engine ECB-encrypts a chunk of counter blocks into keystream,
+ * which is then XORed into the data by the CPU.
+ */
+static int sahara_aes_ctr_process(struct ablkcipher_request *req)
+{
+	struct sahara_dev *dev = dev_ptr;
+	struct sahara_ctx *ctx = crypto_ablkcipher_ctx(
+					crypto_ablkcipher_reqtfm(req));
+	struct sahara_hw_link *link = dev->hw->link;
+	unsigned int offset = 0, n, len, i;
+	dma_addr_t ctr_phys;
+	int ret = 0;
+
+	while (offset < req->nbytes) {
+		n = min_t(unsigned int, req->nbytes - offset,
+			  SAHARA_CTR_CHUNK);
+		len = ALIGN(n, AES_BLOCK_SIZE);
+
+		for (i = 0; i < len; i += AES_BLOCK_SIZE) {
+			memcpy(dev->ctr_buf + i, req->info, AES_BLOCK_SIZE);
+			crypto_inc(req->info, AES_BLOCK_SIZE);
+		}
+
+		ctr_phys = dma_map_single(dev->device, dev->ctr_buf, len,
+					  DMA_BIDIRECTIONAL);
+
+		sahara_aes_key_desc(dev, ctx, FLAGS_ENCRYPT);
+		link[0].len = len;
+		link[0].p = ctr_phys;
+		link[0].next = 0;
+		link[1] = link[0];
+		sahara_aes_data_desc(dev, len, 0, 1);
+
+		ret = sahara_run(dev);
+
+		dma_unmap_single(dev->device, ctr_phys, len,
+				 DMA_BIDIRECTIONAL);
+		if (ret)
+			break;
+
+		scatterwalk_map_and_copy(dev->ctr_data, req->src, offset, n, 0);
+		crypto_xor(dev->ctr_data, dev->ctr_buf, n);
+		scatterwalk_map_and_copy(dev->ctr_data, req->dst, offset, n, 1);
+
+		offset += n;
+	}
+
+	return ret;
+}
+
+static int sahara_aes_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
+			     unsigned int keylen)
+{
+	struct sahara_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+	int ret;
+
+	ctx->keylen = keylen;
+
+	if (keylen != AES_KEYSIZE_128 && keylen != AES_KEYSIZE_192 &&
+	    keylen != AES_KEYSIZE_256) {
+		crypto_ablkcipher_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+
+	/* SAHARA only supports 128bit keys */
+	if (keylen == AES_KEYSIZE_128)
+		memcpy(ctx->key, key, keylen);
+
+	/*
+	 * The other key sizes go to the software fallback, and so do
+	 * requests with more sg entries than the engine has links.
+	 */
+	ctx->fallback->base.crt_flags &= ~CRYPTO_TFM_REQ_MASK;
+	ctx->fallback->base.crt_flags |=
+		tfm->base.crt_flags & CRYPTO_TFM_REQ_MASK;
+
+	ret = crypto_ablkcipher_setkey(ctx->fallback, key, keylen);
+	if (ret) {
+		tfm->base.crt_flags &= ~CRYPTO_TFM_RES_MASK;
+		tfm->base.crt_flags |=
+			ctx->fallback->base.crt_flags & CRYPTO_TFM_RES_MASK;
+	}
+
+	return ret;
+}
+
+static int sahara_aes_fallback(struct ablkcipher_request *req,
+			       unsigned long mode)
+{
+	struct crypto_ablkcipher *tfm = crypto_ablkcipher_reqtfm(req);
+	struct sahara_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+	int ret;
+
+	ablkcipher_request_set_tfm(req, ctx->fallback);
+	if (mode & FLAGS_ENCRYPT)
+		ret = crypto_ablkcipher_encrypt(req);
+	else
+		ret = crypto_ablkcipher_decrypt(req);
+	ablkcipher_request_set_tfm(req, tfm);
+
+	return ret;
+}
+
+static int sahara_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
+{
+	struct sahara_ctx *ctx = crypto_ablkcipher_ctx(
+					crypto_ablkcipher_reqtfm(req));
+	struct sahara_aes_reqctx *rctx = ablkcipher_request_ctx(req);
+	struct sahara_dev *dev = dev_ptr;
+	int err;
+
+	if (unlikely(ctx->keylen != AES_KEYSIZE_128))
+		return sahara_aes_fallback(req, mode);
+
+	if (!(mode & FLAGS_CTR) && !IS_ALIGNED(req->nbytes, AES_BLOCK_SIZE)) {
+		crypto_ablkcipher_set_flags(crypto_ablkcipher_reqtfm(req),
+					    CRYPTO_TFM_RES_BAD_BLOCK_LEN);
+		return -EINVAL;
+	}
+
+	if (!req->nbytes)
+		return 0;
+
+	/* CTR goes through a bounce buffer and needs no links for the data */
+	if (!(mode & FLAGS_CTR) &&
+	    sahara_sg_length(req->src, req->nbytes) +
+	    sahara_sg_length(req->dst, req->nbytes) > SAHARA_MAX_HW_LINK)
+		return sahara_aes_fallback(req, mode);
+
+	rctx->mode = mode;
+
+	spin_lock_bh(&dev->queue_lock);
+	err = ablkcipher_enqueue_request(&dev->queue, req);
+	spin_unlock_bh(&dev->queue_lock);
+
+	wake_up_process(dev->kthread);
+
+	return err;
+}
+
+static int sahara_aes_ecb_encrypt(struct ablkcipher_request *req)
+{
+	return sahara_aes_crypt(req, FLAGS_ENCRYPT);
+}
+
+static int sahara_aes_ecb_decrypt(struct ablkcipher_request *req)
+{
+	return sahara_aes_crypt(req, 0);
+}
+
+static int sahara_aes_cbc_encrypt(struct ablkcipher_request *req)
+{
+	return sahara_aes_crypt(req, FLAGS_ENCRYPT | FLAGS_CBC);
+}
+
+static int sahara_aes_cbc_decrypt(struct ablkcipher_request *req)
+{
+	return sahara_aes_crypt(req, FLAGS_CBC);
+}
+
+/* CTR decryption is the same as encryption */
+static int sahara_aes_ctr_crypt(struct ablkcipher_request *req)
+{
+	return sahara_aes_crypt(req, FLAGS_ENCRYPT | FLAGS_CTR);
+}
+
+static int sahara_aes_cra_init(struct crypto_tfm *tfm)
+{
+	const char *name = crypto_tfm_alg_name(tfm);
+	struct sahara_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->fallback = crypto_alloc_ablkcipher(name, 0,
+				CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(ctx->fallback)) {
+		pr_err("Error allocating fallback algo %s\n", name);
+		return PTR_ERR(ctx->fallback);
+	}
+
+	tfm->crt_ablkcipher.reqsize = sizeof(struct sahara_aes_reqctx);
+
+	return 0;
+}
+
+static void sahara_aes_cra_exit(struct crypto_tfm *tfm)
+{
+	struct sahara_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	if (ctx->fallback)
+		crypto_free_ablkcipher(ctx->fallback);
+	ctx->fallback = NULL;
+}
+
+/*
+ * SHA
+ */
+
+static u32 sahara_sha_init_hdr(struct sahara_sha_reqctx *rctx)
+{
+	u32 hdr = rctx->mode;
+
+	if (rctx->first) {
+		hdr |= SAHARA_HDR_MDHA_SET_MODE_HASH;
+		hdr |= SAHARA_HDR_MDHA_INIT;
+	} else {
+		hdr |= SAHARA_HDR_MDHA_SET_MODE_MD_KEY;
+	}
+
+	if (rctx->last)
+		hdr |= SAHARA_HDR_MDHA_PDATA;
+
+	return sahara_hdr_parity(hdr);
+}
+
+/*
+ * One pass through MDHA: the remainder of the previous pass and reqbytes
+ * from src, of which a tail short of a block is kept for the next pass
+ * unless this is the last one.
+ */
+static int sahara_sha_pass(struct ahash_request *req, struct scatterlist *src,
+			   unsigned int reqbytes)
+{
+	struct sahara_dev *dev = dev_ptr;
+	struct sahara_sha_reqctx *rctx = ahash_request_ctx(req);
+	struct crypto_ahash *tfm = crypto_ahash_reqtfm(req);
+	unsigned int block_size = crypto_tfm_alg_blocksize(
+					crypto_ahash_tfm(tfm));
+	struct sahara_hw_desc *desc = dev->hw->desc;
+	struct sahara_hw_link *link = dev->hw->link;
+	unsigned int hash_later, nbytes, rem, total;
+	int nb_in = 0, i = 0, l = 0, ret;
+
+	/* only the last transfer can be padded in hardware */
+	if (!rctx->last && rctx->buf_cnt + reqbytes < block_size) {
+		scatterwalk_map_and_copy(rctx->buf + rctx->buf_cnt, src,
+					 0, reqbytes, 0);
+		rctx->buf_cnt += reqbytes;
+		return 0;
+	}
+
+	/* whole blocks go to the engine, the tail waits for the next call */
+	hash_later = rctx->last ? 0 :
+		(rctx->buf_cnt + reqbytes) & (block_size - 1);
+	nbytes = reqbytes - hash_later;
+
+	rem = rctx->buf_cnt;
+	memcpy(dev->hw->rembuf, rctx->buf, rem);
+	if (hash_later)
+		scatterwalk_map_and_copy(rctx->buf, src, nbytes,
+					 hash_later, 0);
+	rctx->buf_cnt = hash_later;
+
+	total = rem + nbytes;
+
+	if (nbytes) {
+		nb_in = sahara_sg_length(src, nbytes);
+		if (!dma_map_sg(dev->device, src, nb_in, DMA_TO_DEVICE))
+			return -EINVAL;
+	}
+
+	/* restore the context of the previous call */
+	if (!rctx->first) {
+		memcpy(dev->hw->context, rctx->context, rctx->context_size);
+
+		desc[i].hdr = sahara_sha_init_hdr(rctx);
+		desc[i].len1 = rctx->context_size;
+		desc[i].p1 = sahara_phys(dev, &link[l]);
+		desc[i].len2 = 0;
+		desc[i].p2 = 0;
+		desc[i].next = sahara_phys(dev, &desc[i + 1]);
+
+		link[l].len = rctx->context_size;
+		link[l].p = sahara_phys(dev, dev->hw->context);
+		link[l].next = 0;
+
+		i++;
+		l++;
+	}
+
+	/* hash the data, then save the context */
+	if (rctx->first)
+		desc[i].hdr = sahara_sha_init_hdr(rctx);
+	else
+		desc[i].hdr = SAHARA_HDR_MDHA_HASH;
+	desc[i].len1 = total;
+	desc[i].p1 = total ? sahara_phys(dev, &link[l]) : 0;
+
+	if (rem) {
+		link[l].len = rem;
+		link[l].p = sahara_phys(dev, dev->hw->rembuf);
+		link[l].next = sahara_phys(dev, &link[l + 1]);
+		l++;
+	}
+	if (nbytes)
+		l = sahara_sg_links(dev, src, nb_in, nbytes, l);
+	else if (rem)
+		link[l - 1].next = 0;
+
+	desc[i].len2 = rctx->context_size;
+	desc[i].p2 = sahara_phys(dev, &link[l]);
+	desc[i].next = 0;
+
+	link[l].len = rctx->context_size;
+	link[l].p = sahara_phys(dev, dev->hw->context);
+	link[l].next = 0;
+
+	ret = sahara_run(dev);
+
+	if (nbytes)
+		dma_unmap_sg(dev->device, src, nb_in, DMA_TO_DEVICE);
+
+	if (ret)
+		return ret;
+
+	memcpy(rctx->context, dev->hw->context, rctx->context_size);
+	rctx->first = 0;
+
+	return 0;
+}
+
+/*
+ * Requests with more sg entries than a pass has links for are hashed in
+ * several passes, the context carries over from one to the next.
+ */
+static int sahara_sha_process(struct ahash_request *req)
+{
+	struct sahara_sha_reqctx *rctx = ahash_request_ctx(req);
+	struct scatterlist *sg = req->src, *start;
+	unsigned int left = req->nbytes, nbytes;
+	int last = rctx->last, nents, ret;
+
+	do {
+		start = sg;
+		nbytes = 0;
+		for (nents = 0; nents < SAHARA_SHA_MAX_LINKS && sg &&
+		     nbytes < left; nents++) {
+			nbytes += min(sg->length, left - nbytes);
+			sg = sg_next(sg);
+		}
+		if (nbytes < left && !sg) {
+			ret = -EINVAL;
+			break;
+		}
+		left -= nbytes;
+
+		rctx->last = last && !left;
+		ret = sahara_sha_pass(req, start, nbytes);
+	} while (!ret && left);
+
+	rctx->last = last;
+
+	if (!ret && last && req->result)
+		memcpy(req->result, rctx->context, rctx->digest_size);
+
+	return ret;
+}
+
+static int sahara_sha_enqueue(struct ahash_request *req, int last)
+{
+	struct sahara_sha_reqctx *rctx = ahash_request_ctx(req);
+	struct sahara_dev *dev = dev_ptr;
+	int ret;
+
+	if (!req->nbytes && !last)
+		return 0;
+
+	rctx->last = last;
+
+	if (!rctx->active) {
+		rctx->active = 1;
+		rctx->first = 1;
+	}
+
+	spin_lock_bh(&dev->queue_lock);
+	ret = crypto_enqueue_request(&dev->queue, &req->base);
+	spin_unlock_bh(&dev->queue_lock);
+
+	wake_up_process(dev->kthread);
+
+	return ret;
+}
+
+static int sahara_sha_init(struct ahash_request *req)
+{
+	struct crypto_ahash *tfm = crypto_ahash_reqtfm(req);
+	struct sahara_sha_reqctx *rctx = ahash_request_ctx(req);
+
+	memset(rctx, 0, sizeof(*rctx));
+
+	switch (crypto_ahash_digestsize(tfm)) {
+	case SHA1_DIGEST_SIZE:
+		rctx->mode |= SAHARA_HDR_MDHA_ALG_SHA1;
+		rctx->digest_size = SHA1_DIGEST_SIZE;
+		break;
+	case SHA256_DIGEST_SIZE:
+		rctx->mode |= SAHARA_HDR_MDHA_ALG_SHA256;
+		rctx->digest_size = SHA256_DIGEST_SIZE;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	/* the digest followed by the message length */
+	rctx->context_size = rctx->digest_size + 4;
+
+	return 0;
+}
+
+static int sahara_sha_update(struct ahash_request *req)
+{
+	return sahara_sha_enqueue(req, 0);
+}
+
+static int sahara_sha_final(struct ahash_request *req)
+{
+	req->nbytes = 0;
+	return sahara_sha_enqueue(req, 1);
+}
+
+static int sahara_sha_finup(struct ahash_request *req)
+{
+	return sahara_sha_enqueue(req, 1);
+}
+
+static int sahara_sha_digest(struct ahash_request *req)
+{
+	sahara_sha_init(req);
+
+	return sahara_sha_finup(req);
+}
+
+static int sahara_sha_export(struct ahash_request *req, void *out)
+{
+	memcpy(out, ahash_request_ctx(req), sizeof(struct sahara_sha_reqctx));
+
+	return 0;
+}
+
+static int sahara_sha_import(struct ahash_request *req, const void *in)
+{
+	memcpy(ahash_request_ctx(req), in, sizeof(struct sahara_sha_reqctx));
+
+	return 0;
+}
+
+static int sahara_sha_cra_init(struct crypto_tfm *tfm)
+{
+	crypto_ahash_set_reqsize(__crypto_ahash_cast(tfm),
+				 sizeof(struct sahara_sha_reqctx));
+
+	return 0;
+}
+
+/*
+ * Queue
+ */
+
+static int sahara_queue_manage(void *data)
+{
+	struct sahara_dev *dev = data;
+	struct crypto_async_request *async_req;
+	struct crypto_async_request *backlog;
+	struct sahara_aes_reqctx *rctx;
+	int ret;
+
+	do {
+		__set_current_state(TASK_INTERRUPTIBLE);
+
+		spin_lock_bh(&dev->queue_lock);
+		backlog = crypto_get_backlog(&dev->queue);
+		async_req = crypto_dequeue_request(&dev->queue);
+		spin_unlock_bh(&dev->queue_lock);
+
+		if (!async_req) {
+			schedule();
+			continue;
+		}
+
+		__set_current_state(TASK_RUNNING);
+
+		if (backlog) {
+			local_bh_disable();
+			backlog->complete(backlog, -EINPROGRESS);
+			local_bh_enable();
+		}
+
+		if (crypto_tfm_alg_type(async_req->tfm) ==
+		    CRYPTO_ALG_TYPE_AHASH) {
+			ret = sahara_sha_process(ahash_request_cast(async_req));
+		} else {
+			struct ablkcipher_request *req =
+				ablkcipher_request_cast(async_req);
+
+			rctx = ablkcipher_request_ctx(req);
+			if (rctx->mode & FLAGS_CTR)
+				ret = sahara_aes_ctr_process(req);
+			else
+				ret = sahara_aes_process(req);
+		}
+
+		local_bh_disable();
+		async_req->complete(async_req, ret);
+		local_bh_enable();
+	} while (!kthread_should_stop());
+
+	return 0;
+}
+
+static struct crypto_alg aes_algs[] = {
+{
+	.cra_name		= "ecb(aes)",
+	.cra_driver_name	= "sahara-ecb-aes",
+	.cra_priority		= SAHARA_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+			CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct sahara_ctx),
+	.cra_alignmask		= 0x0,
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= sahara_aes_cra_init,
+	.cra_exit		= sahara_aes_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.setkey		= sahara_aes_setkey,
+		.encrypt	= sahara_aes_ecb_encrypt,
+		.decrypt	= sahara_aes_ecb_decrypt,
+	}
+}, {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "sahara-cbc-aes",
+	.cra_priority		= SAHARA_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+			CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct sahara_ctx),
+	.cra_alignmask		= 0x0,
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= sahara_aes_cra_init,
+	.cra_exit		= sahara_aes_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= sahara_aes_setkey,
+		.encrypt	= sahara_aes_cbc_encrypt,
+		.decrypt	= sahara_aes_cbc_decrypt,
+	}
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "sahara-ctr-aes",
+	.cra_priority		= SAHARA_PRIORITY,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+			CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct sahara_ctx),
+	.cra_alignmask		= 0x0,
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= sahara_aes_cra_init,
+	.cra_exit		= sahara_aes_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= sahara_aes_setkey,
+		.encrypt	= sahara_aes_ctr_crypt,
+		.decrypt	= sahara_aes_ctr_crypt,
+	}
+}
+};
+
+static struct ahash_alg sha_v3_algs[] = {
+{
+	.init		= sahara_sha_init,
+	.update		= sahara_sha_update,
+	.final		= sahara_sha_final,
+	.finup		= sahara_sha_finup,
+	.digest		= sahara_sha_digest,
+	.export		= sahara_sha_export,
+	.import		= sahara_sha_import,
+	.halg.digestsize	= SHA1_DIGEST_SIZE,
+	.halg.statesize		= sizeof(struct sahara_sha_reqctx),
+	.halg.base	= {
+		.cra_name		= "sha1",
+		.cra_driver_name	= "sahara-sha1",
+		.cra_priority		= SAHARA_PRIORITY,
+		.cra_flags		= CRYPTO_ALG_TYPE_AHASH |
+						CRYPTO_ALG_ASYNC,
+		.cra_blocksize		= SHA1_BLOCK_SIZE,
+		.cra_ctxsize		= 0,
+		.cra_alignmask		= 0,
+		.cra_module		= THIS_MODULE,
+		.cra_init		= sahara_sha_cra_init,
+	}
+},
+};
+
+/* SHA-256 on the v3 engine is not usable, only v4 has it */
+static struct ahash_alg sha_v4_algs[] = {
+{
+	.init		= sahara_sha_init,
+	.update		= sahara_sha_update,
+	.final		= sahara_sha_final,
+	.finup		= sahara_sha_finup,
+	.digest		= sahara_sha_digest,
+	.export		= sahara_sha_export,
+	.import		= sahara_sha_import,
+	.halg.digestsize	= SHA256_DIGEST_SIZE,
+	.halg.statesize		= sizeof(struct sahara_sha_reqctx),
+	.halg.base	= {
+		.cra_name		= "sha256",
+		.cra_driver_name	= "sahara-sha256",
+		.cra_priority		= SAHARA_PRIORITY,
+		.cra_flags		= CRYPTO_ALG_TYPE_AHASH |
+						CRYPTO_ALG_ASYNC,
+		.cra_blocksize		= SHA256_BLOCK_SIZE,
+		.cra_ctxsize		= 0,
+		.cra_alignmask		= 0,
+		.cra_module		= THIS_MODULE,
+		.cra_init		= sahara_sha_cra_init,
+	}
+},
+};
+
+static void sahara_unregister_algs(struct sahara_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(aes_algs); i++)
+		crypto_unregister_alg(&aes_algs[i]);
+
+	for (i = 0; i < ARRAY_SIZE(sha_v3_algs); i++)
+		crypto_unregister_ahash(&sha_v3_algs[i]);
+
+	if (dev->version > SAHARA_VERSION_3)
+		for (i = 0; i < ARRAY_SIZE(sha_v4_algs); i++)
+			crypto_unregister_ahash(&sha_v4_algs[i]);
+}
+
+static int sahara_register_algs(struct sahara_dev *dev)
+{
+	int err;
+	unsigned int i, j, k, l;
+
+	for (i = 0; i < ARRAY_SIZE(aes_algs); i++) {
+		INIT_LIST_HEAD(&aes_algs[i].cra_list);
+		err = crypto_register_alg(&aes_algs[i]);
+		if (err)
+			goto err_aes_algs;
+	}
+
+	for (k = 0; k < ARRAY_SIZE(sha_v3_algs); k++) {
+		err = crypto_register_ahash(&sha_v3_algs[k]);
+		if (err)
+			goto err_sha_v3_algs;
+	}
+
+	if (dev->version > SAHARA_VERSION_3)
+		for (l = 0; l < ARRAY_SIZE(sha_v4_algs); l++) {
+			err = crypto_register_ahash(&sha_v4_algs[l]);
+			if (err)
+				goto err_sha_v4_algs;
+		}
+
+	return 0;
+
+err_sha_v4_algs:
+	for (j = 0; j < l; j++)
+		crypto_unregister_ahash(&sha_v4_algs[j]);
+
+err_sha_v3_algs:
+	for (j = 0; j < k; j++)
+		crypto_unregister_ahash(&sha_v3_algs[j]);
+
+err_aes_algs:
+	for (j = 0; j < i; j++)
+		crypto_unregister_alg(&aes_algs[j]);
+
+	return err;
+}
+
+static int __devinit sahara_probe(struct platform_device *pdev)
+{
+	struct sahara_dev *dev;
+	struct resource *res;
+	u32 version;
+	int err;
+
+	if (dev_ptr)
+		return -EEXIST;
+
+	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	if (!res)
+		return -ENODEV;
+
+	dev = devm_kzalloc(&pdev->dev, sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return -ENOMEM;
+
+	dev->device = &pdev->dev;
+	platform_set_drvdata(pdev, dev);
+
+	if (!devm_request_mem_region(&pdev->dev, res->start,
+				     resource_size(res), pdev->name))
+		return -EBUSY;
+
+	dev->regs_base = devm_ioremap(&pdev->dev, res->start,
+				      resource_size(res));
+	if (!dev->regs_base)
+		return -ENOMEM;
+
+	dev->irq = platform_get_irq(pdev, 0);
+	if (dev->irq < 0)
+		return dev->irq;
+
+	dev->clk = clk_get(&pdev->dev, "sahara2");
+	if (IS_ERR(dev->clk)) {
+		dev_err(&pdev->dev, "Could not get clock\n");
+		return PTR_ERR(dev->clk);
+	}
+
+	dev->hw = dma_alloc_coherent(&pdev->dev, sizeof(*dev->hw),
+				     &dev->hw_phys, GFP_KERNEL);
+	if (!dev->hw) {
+		err = -ENOMEM;
+		goto err_hw;
+	}
+
+	dev->ctr_buf = kmalloc(SAHARA_CTR_CHUNK, GFP_KERNEL);
+	dev->ctr_data = kmalloc(SAHARA_CTR_CHUNK, GFP_KERNEL);
+	if (!dev->ctr_buf || !dev->ctr_data) {
+		err = -ENOMEM;
+		goto err_ctr;
+	}
+
+	spin_lock_init(&dev->queue_lock);
+	crypto_init_queue(&dev->queue, SAHARA_QUEUE_LENGTH);
+	init_completion(&dev->dma_completion);
+
+	clk_enable(dev->clk);
+
+	/* v4 keeps the version in the second byte */
+	version = sahara_read(dev, SAHARA_REG_VERSION);
+	if (version != SAHARA_VERSION_3)
+		version = (version >> 8) & 0xff;
+	if (version != SAHARA_VERSION_3 && version != SAHARA_VERSION_4) {
+		dev_err(&pdev->dev, "SAHARA version %d not supported\n",
+			version);
+		err = -ENODEV;
+		goto err_version;
+	}
+	dev->version = version;
+
+	sahara_reset_hw(dev);
+
+	/* the handler needs the completion and a clocked engine */
+	err = devm_request_irq(&pdev->dev, dev->irq, sahara_irq_handler, 0,
+			       dev_name(&pdev->dev), dev);
+	if (err) {
+		dev_err(&pdev->dev, "failed to request irq\n");
+		goto err_version;
+	}
+
+	dev_ptr = dev;
+
+	dev->kthread = kthread_run(sahara_queue_manage, dev, "sahara_crypto");
+	if (IS_ERR(dev->kthread)) {
+		err = PTR_ERR(dev->kthread);
+		goto err_kthread;
+	}
+
+	err = sahara_register_algs(dev);
+	if (err)
+		goto err_algs;
+
+	dev_info(&pdev->dev, "SAHARA version %d initialized\n", version);
+
+	return 0;
+
+err_algs:
+	kthread_stop(dev->kthread);
+err_kthread:
+	dev_ptr = NULL;
+	devm_free_irq(&pdev->dev, dev->irq, dev);
+err_version:
+	clk_disable(dev->clk);
+err_ctr:
+	kfree(dev->ctr_data);
+	kfree(dev->ctr_buf);
+	dma_free_coherent(&pdev->dev, sizeof(*dev->hw), dev->hw, dev->hw_phys);
+err_hw:
+	clk_put(dev->clk);
+
+	return err;
+}
+
+static int __devexit sahara_remove(struct platform_device *pdev)
+{
+	struct sahara_dev *dev = platform_get_drvdata(pdev);
+
+	sahara_unregister_algs(dev);
+
+	kthread_stop(dev->kthread);
+
+	devm_free_irq(&pdev->dev, dev->irq, dev);
+	clk_disable(dev->clk);
+	clk_put(dev->clk);
+
+	kfree(dev->ctr_data);
+	kfree(dev->ctr_buf);
+	dma_free_coherent(&pdev->dev, sizeof(*dev->hw), dev->hw, dev->hw_phys);
+
+	dev_ptr = NULL;
+
+	return 0;
+}
+
+static struct platform_driver sahara_driver = {
+	.probe		= sahara_probe,
+	.remove		= __devexit_p(sahara_remove),
+	.driver		= {
+		.name	= SAHARA_NAME,
+		.owner	= THIS_MODULE,
+	},
+};
+
+static int __init sahara_init(void)
+{
+	return platform_driver_register(&sahara_driver);
+}
+module_init(sahara_init);
+
+static void __exit sahara_exit(void)
+{
+	platform_driver_unregister(&sahara_driver);
+}
+module_exit(sahara_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("SAHARA2 HW crypto accelerator");
+MODULE_ALIAS("platform:" SAHARA_NAME);
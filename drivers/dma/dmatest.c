@@ -13,6 +13,8 @@
 #include <linux/freezer.h>
 #include <linux/init.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/random.h>
@@ -61,6 +63,11 @@ module_param(timeout, uint, S_IRUGO);
 MODULE_PARM_DESC(timeout, "Transfer Timeout in msec (default: 3000), "
 		 "Pass -1 for infinite timeout");
 
+static bool noverify;
+module_param(noverify, bool, S_IRUGO);
+MODULE_PARM_DESC(noverify, "Copy whole buffers without verifying them and "
+		 "report DMA and CPU memcpy throughput (default: off)");
+
 /*
  * Initialization patterns. All bytes in the source buffer has bit 7
  * set, all bytes in the destination buffer has bit 7 cleared.
@@ -219,6 +226,15 @@ static void dmatest_callback(void *completion)
 	complete(completion);
 }
 
+static unsigned long long dmatest_kbps(u64 len, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+
+	/* bytes per ns to KB/s: * 10^9 / 2^10, done in two steps */
+	return div64_u64(len * 1000000, ns) * 1000 >> 10;
+}
+
 /*
  * This function repeatedly tests DMA transfers of various lengths and
  * offsets for a given operation type until it is told to exit by
@@ -242,6 +258,10 @@ static int dmatest_func(void *data)
 	unsigned int		error_count;
 	unsigned int		failed_tests = 0;
 	unsigned int		total_tests = 0;
+	u64			total_len = 0;
+	s64			dma_ns = 0;
+	s64			cpu_ns = 0;
+	ktime_t			ktime;
 	dma_cookie_t		cookie;
 	enum dma_status		status;
 	enum dma_ctrl_flags 	flags;
@@ -327,18 +347,23 @@ static int dmatest_func(void *data)
 			break;
 		}
 
-		len = dmatest_random() % test_buf_size + 1;
-		len = (len >> align) << align;
-		if (!len)
-			len = 1 << align;
-		src_off = dmatest_random() % (test_buf_size - len + 1);
-		dst_off = dmatest_random() % (test_buf_size - len + 1);
-
-		src_off = (src_off >> align) << align;
-		dst_off = (dst_off >> align) << align;
-
-		dmatest_init_srcs(thread->srcs, src_off, len);
-		dmatest_init_dsts(thread->dsts, dst_off, len);
+		if (noverify) {
+			len = (test_buf_size >> align) << align;
+			src_off = dst_off = 0;
+		} else {
+			len = dmatest_random() % test_buf_size + 1;
+			len = (len >> align) << align;
+			if (!len)
+				len = 1 << align;
+			src_off = dmatest_random() % (test_buf_size - len + 1);
+			dst_off = dmatest_random() % (test_buf_size - len + 1);
+
+			src_off = (src_off >> align) << align;
+			dst_off = (dst_off >> align) << align;
+
+			dmatest_init_srcs(thread->srcs, src_off, len);
+			dmatest_init_dsts(thread->dsts, dst_off, len);
+		}
 
 		for (i = 0; i < src_cnt; i++) {
 			u8 *buf = thread->srcs[i] + src_off;
@@ -394,6 +419,7 @@ static int dmatest_func(void *data)
 		init_completion(&cmp);
 		tx->callback = dmatest_callback;
 		tx->callback_param = &cmp;
+		ktime = ktime_get();
 		cookie = tx->tx_submit(tx);
 
 		if (dma_submit_error(cookie)) {
@@ -419,6 +445,7 @@ static int dmatest_func(void *data)
 		} while (tmo == -ERESTARTSYS);
 
 		status = dma_async_is_tx_complete(chan, cookie, NULL, NULL);
+		ktime = ktime_sub(ktime_get(), ktime);
 
 		if (tmo == 0) {
 			pr_warning("%s: #%u: test timed out\n",
@@ -439,6 +466,20 @@ static int dmatest_func(void *data)
 			dma_unmap_single(dev->dev, dma_dsts[i], test_buf_size,
 					 DMA_BIDIRECTIONAL);
 
+		if (noverify) {
+			dma_ns += ktime_to_ns(ktime);
+			total_len += len;
+
+			/* same copy done by the CPU, as a baseline */
+			if (thread->type == DMA_MEMCPY) {
+				ktime = ktime_get();
+				memcpy(thread->dsts[0], thread->srcs[0], len);
+				cpu_ns += ktime_to_ns(ktime_sub(ktime_get(),
+								ktime));
+			}
+			continue;
+		}
+
 		error_count = 0;
 
 		pr_debug("%s: verifying source buffer...\n", thread_name);
@@ -489,6 +530,11 @@ err_srcbuf:
 err_srcs:
 	pr_notice("%s: terminating after %u tests, %u failures (status %d)\n",
 			thread_name, total_tests, failed_tests, ret);
+	if (noverify && dma_ns)
+		pr_notice("%s: %llu bytes, dma %llu KB/s, cpu %llu KB/s\n",
+			  thread_name, total_len,
+			  dmatest_kbps(total_len, dma_ns),
+			  dmatest_kbps(total_len, cpu_ns));
 
 	/* terminate all transfers on specified channels */
 	chan->device->device_control(chan, DMA_TERMINATE_ALL, 0);
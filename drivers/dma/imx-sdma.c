@@ -23,6 +23,7 @@
 #include <linux/mm.h>
 #include <linux/interrupt.h>
 #include <linux/clk.h>
+#include <linux/delay.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
 #include <linux/semaphore.h>
@@ -230,6 +231,31 @@ struct sdma_context_data {
 
 struct sdma_engine;
 
+/**
+ * struct sdma_desc - a transfer on a SDMA channel
+ *
+ * @txd		dmaengine descriptor handed out to the client
+ * @node	entry in the free, prepared or active list of the channel
+ * @bd_first	index of the first buffer descriptor in the channel's ring
+ * @num_bd	number of buffer descriptors used by this transfer
+ * @chn_count	bytes set up by the prep call
+ * @memcpy_src	source of a prep_dma_memcpy transfer, for unmapping
+ * @memcpy_dst	destination of a prep_dma_memcpy transfer
+ * @memcpy_len	length of a prep_dma_memcpy transfer, 0 for other
+ *		transfer types
+ */
+struct sdma_desc {
+	struct dma_async_tx_descriptor	txd;
+	struct list_head		node;
+	unsigned int			bd_first;
+	unsigned int			num_bd;
+	unsigned int			chn_count;
+	dma_addr_t			memcpy_src, memcpy_dst;
+	size_t				memcpy_len;
+};
+
+#define SDMA_NUM_DESC	16
+
 /**
  * struct sdma_channel - housekeeping for a SDMA channel
  *
@@ -242,7 +268,15 @@ struct sdma_engine;
  * @word_size		peripheral access size
  * @buf_tail		ID of the buffer that was processed
  * @done		channel completion
- * @num_bd		max NUM_BD. number of descriptors currently handling
+ * @num_bd		number of periods of a cyclic transfer
+ * @pc_to_pc		script for memory to memory transfers
+ * @descs		pool of SDMA_NUM_DESC transfer descriptors
+ * @desc_free		descriptors available to the prep calls
+ * @desc_prepared	descriptors set up but not submitted yet
+ * @desc_active		submitted descriptors, in the order the script runs them
+ * @bd_head		next free entry in the buffer descriptor ring
+ * @bd_used		ring entries owned by prepared and active descriptors
+ * @last_residue	bytes not transferred by the last completed descriptor
  */
 struct sdma_channel {
 	struct sdma_engine		*sdma;
@@ -258,6 +292,7 @@ struct sdma_channel {
 	struct sdma_buffer_descriptor	*bd;
 	dma_addr_t			bd_phys;
 	unsigned int			pc_from_device, pc_to_device;
+	unsigned int			pc_to_pc;
 	unsigned long			flags;
 	dma_addr_t			per_address;
 	u32				event_mask0, event_mask1;
@@ -265,13 +300,37 @@ struct sdma_channel {
 	u32				shp_addr, per_addr;
 	struct dma_chan			chan;
 	spinlock_t			lock;
-	struct dma_async_tx_descriptor	desc;
+	struct sdma_desc		*descs;
+	struct list_head		desc_free;
+	struct list_head		desc_prepared;
+	struct list_head		desc_active;
+	unsigned int			bd_head;
+	unsigned int			bd_used;
 	dma_cookie_t			last_completed;
 	enum dma_status			status;
+	unsigned int			last_residue;
 };
 
 #define IMX_DMA_SG_LOOP		(1 << 0)
 
+/*
+ * The page of buffer descriptors of a channel is used as a ring. Each
+ * prepared transfer takes the next free entries, and all entries keep
+ * BD_CONT, so the script runs from one submitted transfer straight into
+ * the next one. It stops at the first entry without BD_DONE and is
+ * restarted by the next tx_submit. BD_DONE of the first entry of a
+ * transfer is only set on submit, which also keeps the script away from
+ * transfers that are prepared but not submitted yet. Transfers therefore
+ * have to be submitted in the order they were prepared.
+ */
+
+/*
+ * Memory to memory transfers run the ap_2_ap script, which copies
+ * bd->mode.count bytes from buffer_addr to ext_buffer_addr in words.
+ * Larger copies are chained over several buffer descriptors.
+ */
+#define SDMA_BD_MAX_CNT		0xfffc
+
 #define MAX_DMA_CHANNELS 32
 #define MXC_SDMA_DEFAULT_PRIORITY 1
 #define MXC_SDMA_MIN_PRIORITY 1
@@ -320,7 +379,7 @@ struct sdma_engine {
 	dma_addr_t			context_phys;
 	struct dma_device		dma_device;
 	struct clk			*clk;
-	struct mutex			channel_0_lock;
+	spinlock_t			channel_0_lock;
 	struct sdma_script_start_addrs	*script_addrs;
 };
 
@@ -393,21 +452,34 @@ static int sdma_config_ownership(struct sdma_channel *sdmac,
 }
 
 /*
- * sdma_run_channel - run a channel and wait till it's done
+ * sdma_run_channel0 - run channel 0 and busy wait till it's done
+ *
+ * Channel 0 only loads scripts and channel contexts which takes a few
+ * microseconds. Polling instead of sleeping allows prep_slave_sg and
+ * slave_config to be used from atomic context, e.g. from a completion
+ * callback or with a uart port lock held.
  */
-static int sdma_run_channel(struct sdma_channel *sdmac)
+static int sdma_run_channel0(struct sdma_engine *sdma)
 {
-	struct sdma_engine *sdma = sdmac->sdma;
-	int channel = sdmac->channel;
-	int ret;
+	unsigned long timeout = 500;
+	u32 stat;
 
-	init_completion(&sdmac->done);
+	__raw_writel(1, sdma->regs + SDMA_H_START);
 
-	__raw_writel(1 << channel, sdma->regs + SDMA_H_START);
+	while (!((stat = __raw_readl(sdma->regs + SDMA_H_INTR)) & 1)) {
+		if (!timeout--)
+			break;
+		udelay(1);
+	}
+
+	if (!(stat & 1)) {
+		dev_err(sdma->dev, "timeout waiting for channel 0\n");
+		return -ETIMEDOUT;
+	}
 
-	ret = wait_for_completion_timeout(&sdmac->done, HZ);
+	__raw_writel(1, sdma->regs + SDMA_H_INTR);
 
-	return ret ? 0 : -ETIMEDOUT;
+	return 0;
 }
 
 static int sdma_load_script(struct sdma_engine *sdma, void *buf, int size,
@@ -416,17 +488,16 @@ static int sdma_load_script(struct sdma_engine *sdma, void *buf, int size,
 	struct sdma_buffer_descriptor *bd0 = sdma->channel[0].bd;
 	void *buf_virt;
 	dma_addr_t buf_phys;
+	unsigned long flags;
 	int ret;
 
-	mutex_lock(&sdma->channel_0_lock);
-
 	buf_virt = dma_alloc_coherent(NULL,
 			size,
 			&buf_phys, GFP_KERNEL);
-	if (!buf_virt) {
-		ret = -ENOMEM;
-		goto err_out;
-	}
+	if (!buf_virt)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&sdma->channel_0_lock, flags);
 
 	bd0->mode.command = C0_SETPM;
 	bd0->mode.status = BD_DONE | BD_INTR | BD_WRAP | BD_EXTD;
@@ -436,12 +507,11 @@ static int sdma_load_script(struct sdma_engine *sdma, void *buf, int size,
 
 	memcpy(buf_virt, buf, size);
 
-	ret = sdma_run_channel(&sdma->channel[0]);
+	ret = sdma_run_channel0(sdma);
 
-	dma_free_coherent(NULL, size, buf_virt, buf_phys);
+	spin_unlock_irqrestore(&sdma->channel_0_lock, flags);
 
-err_out:
-	mutex_unlock(&sdma->channel_0_lock);
+	dma_free_coherent(NULL, size, buf_virt, buf_phys);
 
 	return ret;
 }
@@ -473,6 +543,7 @@ static void sdma_event_disable(struct sdma_channel *sdmac, unsigned int event)
 static void sdma_handle_channel_loop(struct sdma_channel *sdmac)
 {
 	struct sdma_buffer_descriptor *bd;
+	struct sdma_desc *desc;
 
 	/*
 	 * loop mode. Iterate over descriptors, re-setup them and
@@ -493,35 +564,102 @@ static void sdma_handle_channel_loop(struct sdma_channel *sdmac)
 		sdmac->buf_tail++;
 		sdmac->buf_tail %= sdmac->num_bd;
 
-		if (sdmac->desc.callback)
-			sdmac->desc.callback(sdmac->desc.callback_param);
+		desc = list_first_entry(&sdmac->desc_active, struct sdma_desc,
+				node);
+		if (desc->txd.callback)
+			desc->txd.callback(desc->txd.callback_param);
+	}
+}
+
+static struct sdma_buffer_descriptor *sdma_desc_bd(struct sdma_channel *sdmac,
+		struct sdma_desc *desc, unsigned int i)
+{
+	return &sdmac->bd[(desc->bd_first + i) % NUM_BD];
+}
+
+static void sdma_unmap_memcpy(struct sdma_channel *sdmac,
+		struct sdma_desc *desc)
+{
+	struct device *dev = sdmac->sdma->dev;
+	unsigned long flags = desc->txd.flags;
+
+	if (!(flags & DMA_COMPL_SKIP_DEST_UNMAP)) {
+		if (flags & DMA_COMPL_DEST_UNMAP_SINGLE)
+			dma_unmap_single(dev, desc->memcpy_dst,
+					 desc->memcpy_len, DMA_FROM_DEVICE);
+		else
+			dma_unmap_page(dev, desc->memcpy_dst,
+				       desc->memcpy_len, DMA_FROM_DEVICE);
+	}
+	if (!(flags & DMA_COMPL_SKIP_SRC_UNMAP)) {
+		if (flags & DMA_COMPL_SRC_UNMAP_SINGLE)
+			dma_unmap_single(dev, desc->memcpy_src,
+					 desc->memcpy_len, DMA_TO_DEVICE);
+		else
+			dma_unmap_page(dev, desc->memcpy_src,
+				       desc->memcpy_len, DMA_TO_DEVICE);
 	}
 }
 
 static void mxc_sdma_handle_channel_normal(struct sdma_channel *sdmac)
 {
 	struct sdma_buffer_descriptor *bd;
-	int i, error = 0;
+	struct sdma_desc *desc;
+	dma_async_tx_callback callback;
+	void *param;
+	unsigned int i, count;
+	int error;
+
+	spin_lock(&sdmac->lock);
 
 	/*
-	 * non loop mode. Iterate over all descriptors, collect
-	 * errors and call callback function
+	 * non loop mode. Retire the transfers whose last descriptor the
+	 * script has handed back, oldest first, collect errors and call
+	 * the callback function
 	 */
-	for (i = 0; i < sdmac->num_bd; i++) {
-		bd = &sdmac->bd[i];
+	while (!list_empty(&sdmac->desc_active)) {
+		desc = list_first_entry(&sdmac->desc_active, struct sdma_desc,
+				node);
 
-		 if (bd->mode.status & (BD_DONE | BD_RROR))
-			error = -EIO;
-	}
+		bd = sdma_desc_bd(sdmac, desc, desc->num_bd - 1);
+		if (bd->mode.status & BD_DONE)
+			break;
 
-	if (error)
-		sdmac->status = DMA_ERROR;
-	else
-		sdmac->status = DMA_SUCCESS;
+		error = 0;
+		count = 0;
+		for (i = 0; i < desc->num_bd; i++) {
+			bd = sdma_desc_bd(sdmac, desc, i);
+
+			if (bd->mode.status & (BD_DONE | BD_RROR))
+				error = -EIO;
+			/* scripts like uart_2_mcu close a buffer early on aging */
+			count += bd->mode.count;
+		}
+
+		if (error)
+			sdmac->status = DMA_ERROR;
+		else
+			sdmac->status = DMA_SUCCESS;
 
-	if (sdmac->desc.callback)
-		sdmac->desc.callback(sdmac->desc.callback_param);
-	sdmac->last_completed = sdmac->desc.cookie;
+		if (desc->memcpy_len)
+			sdma_unmap_memcpy(sdmac, desc);
+
+		sdmac->last_residue = desc->chn_count - count;
+		sdmac->last_completed = desc->txd.cookie;
+		sdmac->bd_used -= desc->num_bd;
+
+		callback = desc->txd.callback;
+		param = desc->txd.callback_param;
+		list_move_tail(&desc->node, &sdmac->desc_free);
+
+		/* the callback may queue the next transfer */
+		spin_unlock(&sdmac->lock);
+		if (callback)
+			callback(param);
+		spin_lock(&sdmac->lock);
+	}
+
+	spin_unlock(&sdmac->lock);
 }
 
 static void mxc_sdma_handle_channel(struct sdma_channel *sdmac)
@@ -543,7 +681,8 @@ static irqreturn_t sdma_int_handler(int irq, void *dev_id)
 	struct sdma_engine *sdma = dev_id;
 	u32 stat;
 
-	stat = __raw_readl(sdma->regs + SDMA_H_INTR);
+	/* channel 0 is polled in sdma_run_channel0() */
+	stat = __raw_readl(sdma->regs + SDMA_H_INTR) & ~1;
 	__raw_writel(stat, sdma->regs + SDMA_H_INTR);
 
 	while (stat) {
@@ -574,6 +713,7 @@ static void sdma_get_pc(struct sdma_channel *sdmac,
 
 	sdmac->pc_from_device = 0;
 	sdmac->pc_to_device = 0;
+	sdmac->pc_to_pc = 0;
 
 	switch (peripheral_type) {
 	case IMX_DMATYPE_MEMORY:
@@ -639,6 +779,7 @@ static void sdma_get_pc(struct sdma_channel *sdmac,
 
 	sdmac->pc_from_device = per_2_emi;
 	sdmac->pc_to_device = emi_2_per;
+	sdmac->pc_to_pc = emi_2_emi;
 }
 
 static int sdma_load_context(struct sdma_channel *sdmac)
@@ -648,9 +789,12 @@ static int sdma_load_context(struct sdma_channel *sdmac)
 	int load_address;
 	struct sdma_context_data *context = sdma->context;
 	struct sdma_buffer_descriptor *bd0 = sdma->channel[0].bd;
+	unsigned long flags;
 	int ret;
 
-	if (sdmac->direction == DMA_FROM_DEVICE) {
+	if (sdmac->peripheral_type == IMX_DMATYPE_MEMORY) {
+		load_address = sdmac->pc_to_pc;
+	} else if (sdmac->direction == DMA_FROM_DEVICE) {
 		load_address = sdmac->pc_from_device;
 	} else {
 		load_address = sdmac->pc_to_device;
@@ -666,7 +810,7 @@ static int sdma_load_context(struct sdma_channel *sdmac)
 	dev_dbg(sdma->dev, "event_mask0 = 0x%08x\n", sdmac->event_mask0);
 	dev_dbg(sdma->dev, "event_mask1 = 0x%08x\n", sdmac->event_mask1);
 
-	mutex_lock(&sdma->channel_0_lock);
+	spin_lock_irqsave(&sdma->channel_0_lock, flags);
 
 	memset(context, 0, sizeof(*context));
 	context->channel_state.pc = load_address;
@@ -686,9 +830,9 @@ static int sdma_load_context(struct sdma_channel *sdmac)
 	bd0->buffer_addr = sdma->context_phys;
 	bd0->ext_buffer_addr = 2048 + (sizeof(*context) / 4) * channel;
 
-	ret = sdma_run_channel(&sdma->channel[0]);
+	ret = sdma_run_channel0(sdma);
 
-	mutex_unlock(&sdma->channel_0_lock);
+	spin_unlock_irqrestore(&sdma->channel_0_lock, flags);
 
 	return ret;
 }
@@ -702,6 +846,27 @@ static void sdma_disable_channel(struct sdma_channel *sdmac)
 	sdmac->status = DMA_ERROR;
 }
 
+static void sdma_terminate_all(struct sdma_channel *sdmac)
+{
+	unsigned long flags;
+
+	sdma_disable_channel(sdmac);
+
+	spin_lock_irqsave(&sdmac->lock, flags);
+
+	list_splice_tail_init(&sdmac->desc_active, &sdmac->desc_free);
+	list_splice_tail_init(&sdmac->desc_prepared, &sdmac->desc_free);
+	sdmac->flags &= ~IMX_DMA_SG_LOOP;
+	sdmac->last_completed = sdmac->chan.cookie;
+
+	/* don't leave entries of aborted transfers behind for the script */
+	memset(sdmac->bd, 0, PAGE_SIZE);
+	sdmac->bd_head = 0;
+	sdmac->bd_used = 0;
+
+	spin_unlock_irqrestore(&sdmac->lock, flags);
+}
+
 static int sdma_config_channel(struct sdma_channel *sdmac)
 {
 	int ret;
@@ -714,7 +879,7 @@ static int sdma_config_channel(struct sdma_channel *sdmac)
 	sdmac->per_addr = 0;
 
 	if (sdmac->event_id0) {
-		if (sdmac->event_id0 > 32)
+		if (sdmac->event_id0 >= sdmac->sdma->num_events)
 			return -EINVAL;
 		sdma_event_enable(sdmac, sdmac->event_id0);
 	}
@@ -743,8 +908,9 @@ static int sdma_config_channel(struct sdma_channel *sdmac)
 			sdmac->event_mask0 = 1 << (sdmac->event_id0 % 32);
 			if (sdmac->event_id0 > 31)
 				sdmac->watermark_level |= 1 << 30;
-		} else {
+		} else if (sdmac->event_id0 < 32) {
 			sdmac->event_mask0 = 1 << sdmac->event_id0;
+		} else {
 			sdmac->event_mask1 = 1 << (sdmac->event_id0 - 32);
 		}
 		/* Watermark Level */
@@ -812,7 +978,8 @@ static void sdma_enable_channel(struct sdma_engine *sdma, int channel)
 	__raw_writel(1 << channel, sdma->regs + SDMA_H_START);
 }
 
-static dma_cookie_t sdma_assign_cookie(struct sdma_channel *sdmac)
+static dma_cookie_t sdma_assign_cookie(struct sdma_channel *sdmac,
+		struct sdma_desc *desc)
 {
 	dma_cookie_t cookie = sdmac->chan.cookie;
 
@@ -820,7 +987,7 @@ static dma_cookie_t sdma_assign_cookie(struct sdma_channel *sdmac)
 		cookie = 1;
 
 	sdmac->chan.cookie = cookie;
-	sdmac->desc.cookie = cookie;
+	desc->txd.cookie = cookie;
 
 	return cookie;
 }
@@ -830,31 +997,139 @@ static struct sdma_channel *to_sdma_chan(struct dma_chan *chan)
 	return container_of(chan, struct sdma_channel, chan);
 }
 
+static struct sdma_desc *to_sdma_desc(struct dma_async_tx_descriptor *tx)
+{
+	return container_of(tx, struct sdma_desc, txd);
+}
+
 static dma_cookie_t sdma_tx_submit(struct dma_async_tx_descriptor *tx)
 {
 	struct sdma_channel *sdmac = to_sdma_chan(tx->chan);
 	struct sdma_engine *sdma = sdmac->sdma;
+	struct sdma_desc *desc = to_sdma_desc(tx);
 	dma_cookie_t cookie;
+	unsigned long flags;
 
-	spin_lock_irq(&sdmac->lock);
+	spin_lock_irqsave(&sdmac->lock, flags);
 
-	cookie = sdma_assign_cookie(sdmac);
+	cookie = sdma_assign_cookie(sdmac, desc);
+	list_move_tail(&desc->node, &sdmac->desc_active);
 
+	/*
+	 * Hand the transfer to the script. It either still runs an earlier
+	 * transfer and continues into this one, or it stopped right at
+	 * this entry and is restarted.
+	 */
+	wmb();
+	sdma_desc_bd(sdmac, desc, 0)->mode.status |= BD_DONE;
 	sdma_enable_channel(sdma, sdmac->channel);
 
-	spin_unlock_irq(&sdmac->lock);
+	spin_unlock_irqrestore(&sdmac->lock, flags);
 
 	return cookie;
 }
 
+/*
+ * Take a descriptor from the pool for a new transfer. An idle channel
+ * starts over at the top of its ring with a freshly loaded context.
+ * Otherwise the new transfer is chained behind the queued ones, which
+ * needs the same script. Called with sdmac->lock held.
+ */
+static struct sdma_desc *sdma_desc_get(struct sdma_channel *sdmac,
+		enum dma_data_direction direction)
+{
+	struct sdma_engine *sdma = sdmac->sdma;
+	struct sdma_desc *desc;
+
+	if (sdmac->flags & IMX_DMA_SG_LOOP || list_empty(&sdmac->desc_free))
+		return NULL;
+
+	if (list_empty(&sdmac->desc_active) &&
+	    list_empty(&sdmac->desc_prepared)) {
+		sdmac->direction = direction;
+		sdmac->bd_head = 0;
+		sdma->channel_control[sdmac->channel].current_bd_ptr =
+			sdmac->bd_phys;
+		if (sdma_load_context(sdmac))
+			return NULL;
+	} else if (direction != sdmac->direction) {
+		return NULL;
+	}
+
+	desc = list_first_entry(&sdmac->desc_free, struct sdma_desc, node);
+	desc->bd_first = sdmac->bd_head;
+	desc->num_bd = 0;
+	desc->chn_count = 0;
+	desc->memcpy_len = 0;
+
+	return desc;
+}
+
+/*
+ * Append the next ring entry to a transfer, NULL if the ring is full.
+ * The status only carries BD_WRAP for the last entry of the ring, the
+ * caller adds its own bits.
+ */
+static struct sdma_buffer_descriptor *sdma_desc_add_bd(
+		struct sdma_channel *sdmac, struct sdma_desc *desc)
+{
+	struct sdma_buffer_descriptor *bd;
+
+	if (sdmac->bd_used == NUM_BD)
+		return NULL;
+
+	bd = &sdmac->bd[sdmac->bd_head];
+	bd->mode.status = sdmac->bd_head == NUM_BD - 1 ? BD_WRAP : 0;
+
+	sdmac->bd_head = (sdmac->bd_head + 1) % NUM_BD;
+	sdmac->bd_used++;
+	desc->num_bd++;
+
+	return bd;
+}
+
+/* Give back the ring entries of a transfer that could not be set up. */
+static void sdma_desc_abort(struct sdma_channel *sdmac,
+		struct sdma_desc *desc)
+{
+	unsigned int i;
+
+	for (i = 0; i < desc->num_bd; i++)
+		sdma_desc_bd(sdmac, desc, i)->mode.status = 0;
+
+	sdmac->bd_head = desc->bd_first;
+	sdmac->bd_used -= desc->num_bd;
+}
+
+static struct dma_async_tx_descriptor *sdma_desc_finish(
+		struct sdma_channel *sdmac, struct sdma_desc *desc,
+		unsigned long flags)
+{
+	sdma_desc_bd(sdmac, desc, desc->num_bd - 1)->mode.status |= BD_INTR;
+	/* held back until tx_submit */
+	sdma_desc_bd(sdmac, desc, 0)->mode.status &= ~BD_DONE;
+
+	desc->txd.flags = flags;
+	list_move_tail(&desc->node, &sdmac->desc_prepared);
+
+	return &desc->txd;
+}
+
 static int sdma_alloc_chan_resources(struct dma_chan *chan)
 {
 	struct sdma_channel *sdmac = to_sdma_chan(chan);
 	struct imx_dma_data *data = chan->private;
-	int prio, ret;
-
-	if (!data)
-		return -EINVAL;
+	struct imx_dma_data mem_data;
+	struct sdma_desc *desc;
+	int prio, ret, i;
+
+	/* memcpy users request a channel without filter data */
+	if (!data) {
+		mem_data.dma_request = 0;
+		mem_data.peripheral_type = IMX_DMATYPE_MEMORY;
+		mem_data.priority = DMA_PRIO_MEDIUM;
+		data = &mem_data;
+	}
 
 	switch (data->priority) {
 	case DMA_PRIO_HIGH:
@@ -875,16 +1150,47 @@ static int sdma_alloc_chan_resources(struct dma_chan *chan)
 	if (ret)
 		return ret;
 
+	sdmac->descs = kcalloc(SDMA_NUM_DESC, sizeof(*desc), GFP_KERNEL);
+	if (!sdmac->descs)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&sdmac->desc_free);
+	INIT_LIST_HEAD(&sdmac->desc_prepared);
+	INIT_LIST_HEAD(&sdmac->desc_active);
+	sdmac->bd_head = 0;
+	sdmac->bd_used = 0;
+
+	for (i = 0; i < SDMA_NUM_DESC; i++) {
+		desc = &sdmac->descs[i];
+		dma_async_tx_descriptor_init(&desc->txd, chan);
+		desc->txd.tx_submit = sdma_tx_submit;
+		/* txd.flags will be overwritten in prep funcs */
+		desc->txd.flags = DMA_CTRL_ACK;
+		list_add_tail(&desc->node, &sdmac->desc_free);
+	}
+
 	ret = sdma_request_channel(sdmac);
 	if (ret)
-		return ret;
+		goto err_free_descs;
 
-	dma_async_tx_descriptor_init(&sdmac->desc, chan);
-	sdmac->desc.tx_submit = sdma_tx_submit;
-	/* txd.flags will be overwritten in prep funcs */
-	sdmac->desc.flags = DMA_CTRL_ACK;
+	/* slave channels are configured through DMA_SLAVE_CONFIG */
+	if (sdmac->peripheral_type == IMX_DMATYPE_MEMORY) {
+		ret = sdma_config_channel(sdmac);
+		if (ret)
+			goto err_release;
+	}
 
 	return 0;
+
+err_release:
+	sdma_set_channel_priority(sdmac, 0);
+	dma_free_coherent(NULL, PAGE_SIZE, sdmac->bd, sdmac->bd_phys);
+	clk_disable(sdmac->sdma->clk);
+err_free_descs:
+	kfree(sdmac->descs);
+	sdmac->descs = NULL;
+
+	return ret;
 }
 
 static void sdma_free_chan_resources(struct dma_chan *chan)
@@ -892,7 +1198,7 @@ static void sdma_free_chan_resources(struct dma_chan *chan)
 	struct sdma_channel *sdmac = to_sdma_chan(chan);
 	struct sdma_engine *sdma = sdmac->sdma;
 
-	sdma_disable_channel(sdmac);
+	sdma_terminate_all(sdmac);
 
 	if (sdmac->event_id0)
 		sdma_event_disable(sdmac, sdmac->event_id0);
@@ -905,6 +1211,7 @@ static void sdma_free_chan_resources(struct dma_chan *chan)
 	sdma_set_channel_priority(sdmac, 0);
 
 	dma_free_coherent(NULL, PAGE_SIZE, sdmac->bd, sdmac->bd_phys);
+	kfree(sdmac->descs);
 
 	clk_disable(sdma->clk);
 }
@@ -916,35 +1223,39 @@ static struct dma_async_tx_descriptor *sdma_prep_slave_sg(
 {
 	struct sdma_channel *sdmac = to_sdma_chan(chan);
 	struct sdma_engine *sdma = sdmac->sdma;
-	int ret, i, count;
+	struct dma_async_tx_descriptor *tx;
+	struct sdma_desc *desc;
+	unsigned long irqflags;
+	int i, count;
 	int channel = sdmac->channel;
 	struct scatterlist *sg;
 
-	if (sdmac->status == DMA_IN_PROGRESS)
-		return NULL;
-	sdmac->status = DMA_IN_PROGRESS;
-
-	sdmac->flags = 0;
-
 	dev_dbg(sdma->dev, "setting up %d entries for channel %d.\n",
 			sg_len, channel);
 
-	sdmac->direction = direction;
-	ret = sdma_load_context(sdmac);
-	if (ret)
-		goto err_out;
-
 	if (sg_len > NUM_BD) {
 		dev_err(sdma->dev, "SDMA channel %d: maximum number of sg exceeded: %d > %d\n",
 				channel, sg_len, NUM_BD);
-		ret = -EINVAL;
-		goto err_out;
+		return NULL;
 	}
 
+	if (sdmac->word_size > DMA_SLAVE_BUSWIDTH_4_BYTES)
+		return NULL;
+
+	spin_lock_irqsave(&sdmac->lock, irqflags);
+
+	desc = sdma_desc_get(sdmac, direction);
+	if (!desc)
+		goto err_unlock;
+
 	for_each_sg(sgl, sg, sg_len, i) {
-		struct sdma_buffer_descriptor *bd = &sdmac->bd[i];
+		struct sdma_buffer_descriptor *bd;
 		int param;
 
+		bd = sdma_desc_add_bd(sdmac, desc);
+		if (!bd)
+			goto err_out;
+
 		bd->buffer_addr = sg->dma_address;
 
 		count = sg->length;
@@ -952,57 +1263,48 @@ static struct dma_async_tx_descriptor *sdma_prep_slave_sg(
 		if (count > 0xffff) {
 			dev_err(sdma->dev, "SDMA channel %d: maximum bytes for sg entry exceeded: %d > %d\n",
 					channel, count, 0xffff);
-			ret = -EINVAL;
 			goto err_out;
 		}
 
 		bd->mode.count = count;
-
-		if (sdmac->word_size > DMA_SLAVE_BUSWIDTH_4_BYTES) {
-			ret =  -EINVAL;
-			goto err_out;
-		}
+		desc->chn_count += count;
 
 		switch (sdmac->word_size) {
 		case DMA_SLAVE_BUSWIDTH_4_BYTES:
 			bd->mode.command = 0;
 			if (count & 3 || sg->dma_address & 3)
-				return NULL;
+				goto err_out;
 			break;
 		case DMA_SLAVE_BUSWIDTH_2_BYTES:
 			bd->mode.command = 2;
 			if (count & 1 || sg->dma_address & 1)
-				return NULL;
+				goto err_out;
 			break;
 		case DMA_SLAVE_BUSWIDTH_1_BYTE:
 			bd->mode.command = 1;
 			break;
 		default:
-			return NULL;
+			goto err_out;
 		}
 
 		param = BD_DONE | BD_EXTD | BD_CONT;
 
-		if (i + 1 == sg_len) {
-			param |= BD_INTR;
-			param |= BD_LAST;
-			param &= ~BD_CONT;
-		}
-
 		dev_dbg(sdma->dev, "entry %d: count: %d dma: 0x%08x %s%s\n",
 				i, count, sg->dma_address,
-				param & BD_WRAP ? "wrap" : "",
-				param & BD_INTR ? " intr" : "");
+				bd->mode.status & BD_WRAP ? "wrap" : "",
+				i + 1 == sg_len ? " intr" : "");
 
-		bd->mode.status = param;
+		bd->mode.status |= param;
 	}
 
-	sdmac->num_bd = sg_len;
-	sdma->channel_control[channel].current_bd_ptr = sdmac->bd_phys;
+	tx = sdma_desc_finish(sdmac, desc, flags);
+	spin_unlock_irqrestore(&sdmac->lock, irqflags);
 
-	return &sdmac->desc;
+	return tx;
 err_out:
-	sdmac->status = DMA_ERROR;
+	sdma_desc_abort(sdmac, desc);
+err_unlock:
+	spin_unlock_irqrestore(&sdmac->lock, irqflags);
 	return NULL;
 }
 
@@ -1012,45 +1314,53 @@ static struct dma_async_tx_descriptor *sdma_prep_dma_cyclic(
 {
 	struct sdma_channel *sdmac = to_sdma_chan(chan);
 	struct sdma_engine *sdma = sdmac->sdma;
+	struct dma_async_tx_descriptor *tx;
+	struct sdma_desc *desc;
 	int num_periods = buf_len / period_len;
 	int channel = sdmac->channel;
-	int ret, i = 0, buf = 0;
+	unsigned long flags;
+	int i = 0, buf = 0;
 
 	dev_dbg(sdma->dev, "%s channel: %d\n", __func__, channel);
 
-	if (sdmac->status == DMA_IN_PROGRESS)
-		return NULL;
-
-	sdmac->status = DMA_IN_PROGRESS;
-
-	sdmac->flags |= IMX_DMA_SG_LOOP;
-	sdmac->direction = direction;
-	ret = sdma_load_context(sdmac);
-	if (ret)
-		goto err_out;
-
-	if (num_periods > NUM_BD) {
+	if (!num_periods || num_periods > NUM_BD) {
 		dev_err(sdma->dev, "SDMA channel %d: maximum number of sg exceeded: %d > %d\n",
 				channel, num_periods, NUM_BD);
-		goto err_out;
+		return NULL;
 	}
 
 	if (period_len > 0xffff) {
 		dev_err(sdma->dev, "SDMA channel %d: maximum period size exceeded: %d > %d\n",
 				channel, period_len, 0xffff);
-		goto err_out;
+		return NULL;
 	}
 
+	if (sdmac->word_size > DMA_SLAVE_BUSWIDTH_4_BYTES)
+		return NULL;
+
+	spin_lock_irqsave(&sdmac->lock, flags);
+
+	/* a cyclic transfer needs the whole ring for itself */
+	if (!list_empty(&sdmac->desc_active) ||
+	    !list_empty(&sdmac->desc_prepared))
+		goto err_unlock;
+
+	desc = sdma_desc_get(sdmac, direction);
+	if (!desc)
+		goto err_unlock;
+
 	while (buf < buf_len) {
-		struct sdma_buffer_descriptor *bd = &sdmac->bd[i];
+		struct sdma_buffer_descriptor *bd;
 		int param;
 
+		bd = sdma_desc_add_bd(sdmac, desc);
+		if (!bd)
+			goto err_out;
+
 		bd->buffer_addr = dma_addr;
 
 		bd->mode.count = period_len;
 
-		if (sdmac->word_size > DMA_SLAVE_BUSWIDTH_4_BYTES)
-			goto err_out;
 		if (sdmac->word_size == DMA_SLAVE_BUSWIDTH_4_BYTES)
 			bd->mode.command = 0;
 		else
@@ -1065,7 +1375,7 @@ static struct dma_async_tx_descriptor *sdma_prep_dma_cyclic(
 				param & BD_WRAP ? "wrap" : "",
 				param & BD_INTR ? " intr" : "");
 
-		bd->mode.status = param;
+		bd->mode.status |= param;
 
 		dma_addr += period_len;
 		buf += period_len;
@@ -1073,12 +1383,174 @@ static struct dma_async_tx_descriptor *sdma_prep_dma_cyclic(
 		i++;
 	}
 
+	sdmac->status = DMA_IN_PROGRESS;
+	sdmac->flags |= IMX_DMA_SG_LOOP;
 	sdmac->num_bd = num_periods;
-	sdma->channel_control[channel].current_bd_ptr = sdmac->bd_phys;
+	sdmac->buf_tail = 0;
+	/* the periods are recycled, nobody else gets a ring entry */
+	sdmac->bd_used = NUM_BD;
 
-	return &sdmac->desc;
+	tx = sdma_desc_finish(sdmac, desc, DMA_CTRL_ACK);
+	spin_unlock_irqrestore(&sdmac->lock, flags);
+
+	return tx;
 err_out:
-	sdmac->status = DMA_ERROR;
+	sdma_desc_abort(sdmac, desc);
+err_unlock:
+	spin_unlock_irqrestore(&sdmac->lock, flags);
+	return NULL;
+}
+
+static struct sdma_desc *sdma_memory_begin(struct sdma_channel *sdmac)
+{
+	if (sdmac->peripheral_type != IMX_DMATYPE_MEMORY)
+		return NULL;
+
+	return sdma_desc_get(sdmac, DMA_NONE);
+}
+
+static int sdma_memory_bd(struct sdma_channel *sdmac, struct sdma_desc *desc,
+		dma_addr_t dst, dma_addr_t src, size_t count)
+{
+	struct sdma_buffer_descriptor *bd;
+
+	if ((dst | src | count) & 3)
+		return -EINVAL;
+
+	bd = sdma_desc_add_bd(sdmac, desc);
+	if (!bd)
+		return -ENOSPC;
+
+	bd->buffer_addr = src;
+	bd->ext_buffer_addr = dst;
+	bd->mode.count = count;
+	bd->mode.command = 0;
+	bd->mode.status |= BD_DONE | BD_EXTD | BD_CONT;
+	desc->chn_count += count;
+
+	return 0;
+}
+
+static struct dma_async_tx_descriptor *sdma_prep_dma_memcpy(
+		struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
+		size_t len, unsigned long flags)
+{
+	struct sdma_channel *sdmac = to_sdma_chan(chan);
+	struct sdma_engine *sdma = sdmac->sdma;
+	struct dma_async_tx_descriptor *tx;
+	struct sdma_desc *desc;
+	dma_addr_t d = dest, s = src;
+	size_t left = len, count;
+	unsigned long irqflags;
+
+	if (!len)
+		return NULL;
+
+	spin_lock_irqsave(&sdmac->lock, irqflags);
+
+	desc = sdma_memory_begin(sdmac);
+	if (!desc)
+		goto err_unlock;
+
+	dev_dbg(sdma->dev, "memcpy %d bytes 0x%08x -> 0x%08x on channel %d\n",
+			len, src, dest, sdmac->channel);
+
+	while (left) {
+		count = min_t(size_t, left, SDMA_BD_MAX_CNT);
+		if (sdma_memory_bd(sdmac, desc, d, s, count))
+			goto err_out;
+		d += count;
+		s += count;
+		left -= count;
+	}
+
+	desc->memcpy_src = src;
+	desc->memcpy_dst = dest;
+	desc->memcpy_len = len;
+
+	tx = sdma_desc_finish(sdmac, desc, flags);
+	spin_unlock_irqrestore(&sdmac->lock, irqflags);
+
+	return tx;
+err_out:
+	sdma_desc_abort(sdmac, desc);
+	/* callers may probe with unaligned copies and fall back quietly */
+	dev_dbg(sdma->dev, "SDMA channel %d: invalid memcpy of %d bytes\n",
+			sdmac->channel, len);
+err_unlock:
+	spin_unlock_irqrestore(&sdmac->lock, irqflags);
+	return NULL;
+}
+
+static struct dma_async_tx_descriptor *sdma_prep_dma_sg(
+		struct dma_chan *chan,
+		struct scatterlist *dst_sg, unsigned int dst_nents,
+		struct scatterlist *src_sg, unsigned int src_nents,
+		unsigned long flags)
+{
+	struct sdma_channel *sdmac = to_sdma_chan(chan);
+	struct sdma_engine *sdma = sdmac->sdma;
+	struct dma_async_tx_descriptor *tx;
+	struct sdma_desc *desc;
+	size_t dst_avail, src_avail, count;
+	dma_addr_t dst, src;
+	unsigned long irqflags;
+
+	if (!dst_nents || !src_nents)
+		return NULL;
+
+	spin_lock_irqsave(&sdmac->lock, irqflags);
+
+	desc = sdma_memory_begin(sdmac);
+	if (!desc)
+		goto err_unlock;
+
+	dst_avail = sg_dma_len(dst_sg);
+	src_avail = sg_dma_len(src_sg);
+
+	/* one descriptor for each overlap of a source and a dest entry */
+	while (true) {
+		count = min_t(size_t, dst_avail, src_avail);
+		count = min_t(size_t, count, SDMA_BD_MAX_CNT);
+
+		if (count) {
+			dst = sg_dma_address(dst_sg) + sg_dma_len(dst_sg) -
+				dst_avail;
+			src = sg_dma_address(src_sg) + sg_dma_len(src_sg) -
+				src_avail;
+			if (sdma_memory_bd(sdmac, desc, dst, src, count))
+				goto err_out;
+			dst_avail -= count;
+			src_avail -= count;
+		}
+
+		if (!dst_avail) {
+			if (!--dst_nents)
+				break;
+			dst_sg = sg_next(dst_sg);
+			dst_avail = sg_dma_len(dst_sg);
+		}
+		if (!src_avail) {
+			if (!--src_nents)
+				break;
+			src_sg = sg_next(src_sg);
+			src_avail = sg_dma_len(src_sg);
+		}
+	}
+
+	if (!desc->num_bd)
+		goto err_out;
+
+	tx = sdma_desc_finish(sdmac, desc, flags);
+	spin_unlock_irqrestore(&sdmac->lock, irqflags);
+
+	return tx;
+err_out:
+	sdma_desc_abort(sdmac, desc);
+	dev_dbg(sdma->dev, "SDMA channel %d: invalid sg copy\n",
+			sdmac->channel);
+err_unlock:
+	spin_unlock_irqrestore(&sdmac->lock, irqflags);
 	return NULL;
 }
 
@@ -1090,7 +1562,7 @@ static int sdma_control(struct dma_chan *chan, enum dma_ctrl_cmd cmd,
 
 	switch (cmd) {
 	case DMA_TERMINATE_ALL:
-		sdma_disable_channel(sdmac);
+		sdma_terminate_all(sdmac);
 		return 0;
 	case DMA_SLAVE_CONFIG:
 		if (dmaengine_cfg->direction == DMA_FROM_DEVICE) {
@@ -1115,19 +1587,43 @@ static enum dma_status sdma_tx_status(struct dma_chan *chan,
 					    struct dma_tx_state *txstate)
 {
 	struct sdma_channel *sdmac = to_sdma_chan(chan);
+	struct sdma_desc *desc;
 	dma_cookie_t last_used;
+	enum dma_status ret;
+	unsigned int residue = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sdmac->lock, flags);
 
 	last_used = chan->cookie;
 
-	dma_set_tx_state(txstate, sdmac->last_completed, last_used, 0);
+	if (sdmac->flags & IMX_DMA_SG_LOOP) {
+		ret = sdmac->status;
+	} else {
+		ret = dma_async_is_complete(cookie, sdmac->last_completed,
+				last_used);
+		if (cookie == sdmac->last_completed) {
+			ret = sdmac->status;
+			residue = sdmac->last_residue;
+		} else if (ret != DMA_SUCCESS) {
+			list_for_each_entry(desc, &sdmac->desc_active, node)
+				if (desc->txd.cookie == cookie)
+					residue = desc->chn_count;
+		}
+	}
+
+	dma_set_tx_state(txstate, sdmac->last_completed, last_used, residue);
+
+	spin_unlock_irqrestore(&sdmac->lock, flags);
 
-	return sdmac->status;
+	return ret;
 }
 
 static void sdma_issue_pending(struct dma_chan *chan)
 {
 	/*
-	 * Nothing to do. We only have a single descriptor
+	 * Nothing to do. tx_submit already chains the transfer into
+	 * the running ring
 	 */
 }
 
@@ -1298,7 +1794,7 @@ static int __init sdma_probe(struct platform_device *pdev)
 	if (!sdma)
 		return -ENOMEM;
 
-	mutex_init(&sdma->channel_0_lock);
+	spin_lock_init(&sdma->channel_0_lock);
 
 	sdma->dev = &pdev->dev;
 
@@ -1347,6 +1843,15 @@ static int __init sdma_probe(struct platform_device *pdev)
 
 	dma_cap_set(DMA_SLAVE, sdma->dma_device.cap_mask);
 	dma_cap_set(DMA_CYCLIC, sdma->dma_device.cap_mask);
+	dma_cap_set(DMA_MEMCPY, sdma->dma_device.cap_mask);
+	dma_cap_set(DMA_SG, sdma->dma_device.cap_mask);
+	/*
+	 * Channels are handed out by dma_request_channel() only. Public
+	 * memcpy channels would be grabbed all at once by dmaengine_get()
+	 * users and leave none for the peripherals. This keeps async_tx
+	 * and net_dma from using the memcpy capability.
+	 */
+	dma_cap_set(DMA_PRIVATE, sdma->dma_device.cap_mask);
 
 	INIT_LIST_HEAD(&sdma->dma_device.channels);
 	/* Initialize channel parameters */
@@ -1405,6 +1910,10 @@ static int __init sdma_probe(struct platform_device *pdev)
 	sdma->dma_device.device_tx_status = sdma_tx_status;
 	sdma->dma_device.device_prep_slave_sg = sdma_prep_slave_sg;
 	sdma->dma_device.device_prep_dma_cyclic = sdma_prep_dma_cyclic;
+	sdma->dma_device.device_prep_dma_memcpy = sdma_prep_dma_memcpy;
+	sdma->dma_device.device_prep_dma_sg = sdma_prep_dma_sg;
+	/* the ap_2_ap script copies whole words */
+	sdma->dma_device.copy_align = 2;
 	sdma->dma_device.device_control = sdma_control;
 	sdma->dma_device.device_issue_pending = sdma_issue_pending;
 	sdma->dma_device.dev->dma_parms = &sdma->dma_parms;
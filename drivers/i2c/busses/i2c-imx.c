@@ -115,6 +115,14 @@ static u16 __initdata i2c_clk_div[50][2] = {
 	{ 3072,	0x1E }, { 3840,	0x1F }
 };
 
+/* where the interrupt handler is within the current transfer */
+enum i2c_imx_state {
+	I2C_IMX_IDLE,		/* no transfer running, or it has finished */
+	I2C_IMX_ADDR,		/* slave address of the current message sent */
+	I2C_IMX_WRITE,		/* sending data bytes */
+	I2C_IMX_READ,		/* receiving data bytes */
+};
+
 struct imx_i2c_struct {
 	struct i2c_adapter	adapter;
 	struct resource		*res;
@@ -122,11 +130,19 @@ struct imx_i2c_struct {
 	void __iomem		*base;
 	int			irq;
 	wait_queue_head_t	queue;
-	unsigned long		i2csr;
 	unsigned int 		disable_delay;
 	int			stopped;
 	unsigned int		ifdr; /* IMX_I2C_IFDR */
 	int                     (*handle_arbloss)(void);
+
+	/* transfer state, advanced by the interrupt handler */
+	spinlock_t		lock;
+	enum i2c_imx_state	state;
+	struct i2c_msg		*msgs;
+	int			num;
+	int			msg_idx;
+	int			buf_idx;
+	int			xfer_result;
 };
 
 static const struct of_device_id i2c_imx_dt_ids[] = {
@@ -153,14 +169,9 @@ static int i2c_imx_bus_busy(struct imx_i2c_struct *i2c_imx, int for_busy)
 		if (temp & I2SR_IAL) {
 		        dev_dbg(&i2c_imx->adapter.dev,
 				"<%s> I2C bus arbitration loss\n", __func__);
-			
-			/* resolve arbitration loss (if function defined in boardfile) */	
-			if ( i2c_imx->handle_arbloss ) {
-			        i2c_imx->handle_arbloss();
-			}
-			
-			/* reset arbitration loss bit */	
-			writeb(temp & (!I2SR_IAL), i2c_imx->base + IMX_I2C_I2SR);
+
+			/* reset arbitration loss bit, i2c_imx_xfer() recovers */
+			writeb(temp & ~I2SR_IAL, i2c_imx->base + IMX_I2C_I2SR);
 		        return -EPROTO;
 		}
 		if (signal_pending(current)) {
@@ -179,30 +190,6 @@ static int i2c_imx_bus_busy(struct imx_i2c_struct *i2c_imx, int for_busy)
 	return 0;
 }
 
-static int i2c_imx_trx_complete(struct imx_i2c_struct *i2c_imx)
-{
-	wait_event_timeout(i2c_imx->queue, i2c_imx->i2csr & I2SR_IIF, HZ / 10);
-
-	if (unlikely(!(i2c_imx->i2csr & I2SR_IIF))) {
-		dev_dbg(&i2c_imx->adapter.dev, "<%s> Timeout\n", __func__);
-		return -ETIMEDOUT;
-	}
-	dev_dbg(&i2c_imx->adapter.dev, "<%s> TRX complete\n", __func__);
-	i2c_imx->i2csr = 0;
-	return 0;
-}
-
-static int i2c_imx_acked(struct imx_i2c_struct *i2c_imx)
-{
-	if (readb(i2c_imx->base + IMX_I2C_I2SR) & I2SR_RXAK) {
-		dev_dbg(&i2c_imx->adapter.dev, "<%s> No ACK\n", __func__);
-		return -EIO;  /* No ACK */
-	}
-
-	dev_dbg(&i2c_imx->adapter.dev, "<%s> ACK received\n", __func__);
-	return 0;
-}
-
 static int i2c_imx_start(struct imx_i2c_struct *i2c_imx)
 {
 	unsigned int temp = 0;
@@ -300,123 +287,177 @@ static void __init i2c_imx_set_clk(struct imx_i2c_struct *i2c_imx,
 #endif
 }
 
-static irqreturn_t i2c_imx_isr(int irq, void *dev_id)
+/*
+ * Called with i2c_imx->lock held.
+ */
+static void i2c_imx_xfer_done(struct imx_i2c_struct *i2c_imx, int result)
 {
-	struct imx_i2c_struct *i2c_imx = dev_id;
+	i2c_imx->xfer_result = result;
+	i2c_imx->state = I2C_IMX_IDLE;
+	wake_up(&i2c_imx->queue);
+}
+
+/*
+ * Send the slave address of the current message, preceded by a repeated
+ * start for all but the first message. Called with i2c_imx->lock held.
+ */
+static void i2c_imx_send_addr(struct imx_i2c_struct *i2c_imx, int repeated)
+{
+	struct i2c_msg *msg = &i2c_imx->msgs[i2c_imx->msg_idx];
 	unsigned int temp;
 
-	temp = readb(i2c_imx->base + IMX_I2C_I2SR);
-	if (temp & I2SR_IIF) {
-		/* save status register */
-		i2c_imx->i2csr = temp;
-		temp &= ~I2SR_IIF;
-		writeb(temp, i2c_imx->base + IMX_I2C_I2SR);
-		wake_up(&i2c_imx->queue);
-		return IRQ_HANDLED;
+	if (repeated) {
+		dev_dbg(&i2c_imx->adapter.dev,
+			"<%s> repeated start\n", __func__);
+		temp = readb(i2c_imx->base + IMX_I2C_I2CR);
+		temp |= I2CR_RSTA | I2CR_MTX;
+		writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
 	}
 
-	return IRQ_NONE;
+	dev_dbg(&i2c_imx->adapter.dev, "<%s> message %d: addr=0x%x len=%d\n",
+		__func__, i2c_imx->msg_idx,
+		(msg->addr << 1) | (msg->flags & I2C_M_RD ? 1 : 0), msg->len);
+
+	i2c_imx->buf_idx = 0;
+	i2c_imx->state = I2C_IMX_ADDR;
+	writeb((msg->addr << 1) | (msg->flags & I2C_M_RD ? 1 : 0),
+		i2c_imx->base + IMX_I2C_I2DR);
 }
 
-static int i2c_imx_write(struct imx_i2c_struct *i2c_imx, struct i2c_msg *msgs)
+static void i2c_imx_next_msg(struct imx_i2c_struct *i2c_imx)
 {
-	int i, result;
-
-	dev_dbg(&i2c_imx->adapter.dev, "<%s> write slave address: addr=0x%x\n",
-		__func__, msgs->addr << 1);
+	if (++i2c_imx->msg_idx == i2c_imx->num)
+		i2c_imx_xfer_done(i2c_imx, 0);
+	else
+		i2c_imx_send_addr(i2c_imx, 1);
+}
 
-	/* write slave address */
-	writeb(msgs->addr << 1, i2c_imx->base + IMX_I2C_I2DR);
-	result = i2c_imx_trx_complete(i2c_imx);
-	if (result)
-		return result;
-	result = i2c_imx_acked(i2c_imx);
-	if (result)
-		return result;
-	dev_dbg(&i2c_imx->adapter.dev, "<%s> write data\n", __func__);
+/*
+ * One step of the transfer, run for every byte the controller has
+ * finished. Called with i2c_imx->lock held.
+ */
+static void i2c_imx_advance(struct imx_i2c_struct *i2c_imx, unsigned int i2sr)
+{
+	struct i2c_msg *msg = &i2c_imx->msgs[i2c_imx->msg_idx];
+	unsigned int temp;
+	int last;
 
-	/* write data */
-	for (i = 0; i < msgs->len; i++) {
+	if (i2sr & I2SR_IAL) {
 		dev_dbg(&i2c_imx->adapter.dev,
-			"<%s> write byte: B%d=0x%X\n",
-			__func__, i, msgs->buf[i]);
-		writeb(msgs->buf[i], i2c_imx->base + IMX_I2C_I2DR);
-		result = i2c_imx_trx_complete(i2c_imx);
-		if (result)
-			return result;
-		result = i2c_imx_acked(i2c_imx);
-		if (result)
-			return result;
+			"<%s> I2C bus arbitration loss\n", __func__);
+		i2c_imx_xfer_done(i2c_imx, -EPROTO);
+		return;
 	}
-	return 0;
-}
 
-static int i2c_imx_read(struct imx_i2c_struct *i2c_imx, struct i2c_msg *msgs)
-{
-	int i, result;
-	unsigned int temp;
+	switch (i2c_imx->state) {
+	case I2C_IMX_ADDR:
+		if (i2sr & I2SR_RXAK) {
+			dev_dbg(&i2c_imx->adapter.dev,
+				"<%s> No ACK for address\n", __func__);
+			i2c_imx_xfer_done(i2c_imx, -EIO);
+			return;
+		}
 
-	dev_dbg(&i2c_imx->adapter.dev,
-		"<%s> write slave address: addr=0x%x\n",
-		__func__, (msgs->addr << 1) | 0x01);
+		if (!msg->len) {
+			i2c_imx_next_msg(i2c_imx);
+			return;
+		}
 
-	/* write slave address */
-	writeb((msgs->addr << 1) | 0x01, i2c_imx->base + IMX_I2C_I2DR);
-	result = i2c_imx_trx_complete(i2c_imx);
-	if (result)
-		return result;
-	result = i2c_imx_acked(i2c_imx);
-	if (result)
-		return result;
+		if (!(msg->flags & I2C_M_RD)) {
+			i2c_imx->state = I2C_IMX_WRITE;
+			writeb(msg->buf[i2c_imx->buf_idx++],
+				i2c_imx->base + IMX_I2C_I2DR);
+			return;
+		}
 
-	dev_dbg(&i2c_imx->adapter.dev, "<%s> setup bus\n", __func__);
+		/* setup bus to read data, NAK right away for one byte */
+		temp = readb(i2c_imx->base + IMX_I2C_I2CR);
+		temp &= ~(I2CR_MTX | I2CR_TXAK);
+		if (msg->len == 1)
+			temp |= I2CR_TXAK;
+		writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
 
-	/* setup bus to read data */
-	temp = readb(i2c_imx->base + IMX_I2C_I2CR);
-	temp &= ~I2CR_MTX;
-	if (msgs->len - 1)
-		temp &= ~I2CR_TXAK;
-	writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
-	readb(i2c_imx->base + IMX_I2C_I2DR); /* dummy read */
+		i2c_imx->state = I2C_IMX_READ;
+		readb(i2c_imx->base + IMX_I2C_I2DR); /* dummy read */
+		return;
+
+	case I2C_IMX_WRITE:
+		if (i2sr & I2SR_RXAK) {
+			dev_dbg(&i2c_imx->adapter.dev,
+				"<%s> No ACK for byte %d\n", __func__,
+				i2c_imx->buf_idx - 1);
+			i2c_imx_xfer_done(i2c_imx, -EIO);
+			return;
+		}
+
+		if (i2c_imx->buf_idx < msg->len)
+			writeb(msg->buf[i2c_imx->buf_idx++],
+				i2c_imx->base + IMX_I2C_I2DR);
+		else
+			i2c_imx_next_msg(i2c_imx);
+		return;
 
-	dev_dbg(&i2c_imx->adapter.dev, "<%s> read data\n", __func__);
+	case I2C_IMX_READ:
+		last = i2c_imx->buf_idx == msg->len - 1;
 
-	/* read data */
-	for (i = 0; i < msgs->len; i++) {
-		result = i2c_imx_trx_complete(i2c_imx);
-		if (result)
-			return result;
-		if (i == (msgs->len - 1)) {
+		temp = readb(i2c_imx->base + IMX_I2C_I2CR);
+		if (last && i2c_imx->msg_idx == i2c_imx->num - 1) {
 			/* It must generate STOP before read I2DR to prevent
 			   controller from generating another clock cycle */
-			dev_dbg(&i2c_imx->adapter.dev,
-				"<%s> clear MSTA\n", __func__);
-			temp = readb(i2c_imx->base + IMX_I2C_I2CR);
 			temp &= ~(I2CR_MSTA | I2CR_MTX);
 			writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
-			i2c_imx_bus_busy(i2c_imx, 0);
-			i2c_imx->stopped = 1;
-		} else if (i == (msgs->len - 2)) {
-			dev_dbg(&i2c_imx->adapter.dev,
-				"<%s> set TXAK\n", __func__);
-			temp = readb(i2c_imx->base + IMX_I2C_I2CR);
+		} else if (last) {
+			/* same for the repeated start that follows */
+			temp |= I2CR_MTX;
+			writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
+		} else if (i2c_imx->buf_idx == msg->len - 2) {
 			temp |= I2CR_TXAK;
 			writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
 		}
-		msgs->buf[i] = readb(i2c_imx->base + IMX_I2C_I2DR);
-		dev_dbg(&i2c_imx->adapter.dev,
-			"<%s> read byte: B%d=0x%X\n",
-			__func__, i, msgs->buf[i]);
+
+		msg->buf[i2c_imx->buf_idx++] =
+			readb(i2c_imx->base + IMX_I2C_I2DR);
+
+		if (last)
+			i2c_imx_next_msg(i2c_imx);
+		return;
+
+	case I2C_IMX_IDLE:
+		/* late interrupt after a timeout */
+		return;
 	}
-	return 0;
+}
+
+static irqreturn_t i2c_imx_isr(int irq, void *dev_id)
+{
+	struct imx_i2c_struct *i2c_imx = dev_id;
+	unsigned int temp;
+
+	temp = readb(i2c_imx->base + IMX_I2C_I2SR);
+	if (temp & I2SR_IIF) {
+		/* both are write zero to clear, IAL is reported below */
+		writeb(temp & ~(I2SR_IIF | I2SR_IAL),
+			i2c_imx->base + IMX_I2C_I2SR);
+
+		spin_lock(&i2c_imx->lock);
+		i2c_imx_advance(i2c_imx, temp);
+		spin_unlock(&i2c_imx->lock);
+
+		return IRQ_HANDLED;
+	}
+
+	return IRQ_NONE;
 }
 
 static int i2c_imx_xfer(struct i2c_adapter *adapter,
 						struct i2c_msg *msgs, int num)
 {
-	unsigned int i, temp;
+	unsigned long flags;
 	int result;
 	struct imx_i2c_struct *i2c_imx = i2c_get_adapdata(adapter);
+#ifdef CONFIG_I2C_DEBUG_BUS
+	unsigned int temp;
+#endif
 
 	dev_dbg(&i2c_imx->adapter.dev, "<%s>\n", __func__);
 
@@ -425,46 +466,57 @@ static int i2c_imx_xfer(struct i2c_adapter *adapter,
 	if (result)
 		goto fail0;
 
-	/* read/write data */
-	for (i = 0; i < num; i++) {
-		if (i) {
-			dev_dbg(&i2c_imx->adapter.dev,
-				"<%s> repeated start\n", __func__);
-			temp = readb(i2c_imx->base + IMX_I2C_I2CR);
-			temp |= I2CR_RSTA;
-			writeb(temp, i2c_imx->base + IMX_I2C_I2CR);
-			result =  i2c_imx_bus_busy(i2c_imx, 1);
-			if (result)
-				goto fail0;
-		}
-		dev_dbg(&i2c_imx->adapter.dev,
-			"<%s> transfer message: %d\n", __func__, i);
-		/* write/read data */
 #ifdef CONFIG_I2C_DEBUG_BUS
-		temp = readb(i2c_imx->base + IMX_I2C_I2CR);
-		dev_dbg(&i2c_imx->adapter.dev, "<%s> CONTROL: IEN=%d, IIEN=%d, "
-			"MSTA=%d, MTX=%d, TXAK=%d, RSTA=%d\n", __func__,
-			(temp & I2CR_IEN ? 1 : 0), (temp & I2CR_IIEN ? 1 : 0),
-			(temp & I2CR_MSTA ? 1 : 0), (temp & I2CR_MTX ? 1 : 0),
-			(temp & I2CR_TXAK ? 1 : 0), (temp & I2CR_RSTA ? 1 : 0));
-		temp = readb(i2c_imx->base + IMX_I2C_I2SR);
-		dev_dbg(&i2c_imx->adapter.dev,
-			"<%s> STATUS: ICF=%d, IAAS=%d, IBB=%d, "
-			"IAL=%d, SRW=%d, IIF=%d, RXAK=%d\n", __func__,
-			(temp & I2SR_ICF ? 1 : 0), (temp & I2SR_IAAS ? 1 : 0),
-			(temp & I2SR_IBB ? 1 : 0), (temp & I2SR_IAL ? 1 : 0),
-			(temp & I2SR_SRW ? 1 : 0), (temp & I2SR_IIF ? 1 : 0),
-			(temp & I2SR_RXAK ? 1 : 0));
+	temp = readb(i2c_imx->base + IMX_I2C_I2CR);
+	dev_dbg(&i2c_imx->adapter.dev, "<%s> CONTROL: IEN=%d, IIEN=%d, "
+		"MSTA=%d, MTX=%d, TXAK=%d, RSTA=%d\n", __func__,
+		(temp & I2CR_IEN ? 1 : 0), (temp & I2CR_IIEN ? 1 : 0),
+		(temp & I2CR_MSTA ? 1 : 0), (temp & I2CR_MTX ? 1 : 0),
+		(temp & I2CR_TXAK ? 1 : 0), (temp & I2CR_RSTA ? 1 : 0));
+	temp = readb(i2c_imx->base + IMX_I2C_I2SR);
+	dev_dbg(&i2c_imx->adapter.dev,
+		"<%s> STATUS: ICF=%d, IAAS=%d, IBB=%d, "
+		"IAL=%d, SRW=%d, IIF=%d, RXAK=%d\n", __func__,
+		(temp & I2SR_ICF ? 1 : 0), (temp & I2SR_IAAS ? 1 : 0),
+		(temp & I2SR_IBB ? 1 : 0), (temp & I2SR_IAL ? 1 : 0),
+		(temp & I2SR_SRW ? 1 : 0), (temp & I2SR_IIF ? 1 : 0),
+		(temp & I2SR_RXAK ? 1 : 0));
 #endif
-		if (msgs[i].flags & I2C_M_RD)
-			result = i2c_imx_read(i2c_imx, &msgs[i]);
-		else
-			result = i2c_imx_write(i2c_imx, &msgs[i]);
-		if (result)
-			goto fail0;
+
+	/*
+	 * Hand all messages to the interrupt handler, it runs them back to
+	 * back with repeated starts and wakes us up once at the end.
+	 */
+	spin_lock_irqsave(&i2c_imx->lock, flags);
+	i2c_imx->msgs = msgs;
+	i2c_imx->num = num;
+	i2c_imx->msg_idx = 0;
+	i2c_imx->xfer_result = 0;
+	i2c_imx_send_addr(i2c_imx, 0);
+	spin_unlock_irqrestore(&i2c_imx->lock, flags);
+
+	wait_event_timeout(i2c_imx->queue, i2c_imx->state == I2C_IMX_IDLE,
+			adapter->timeout);
+
+	spin_lock_irqsave(&i2c_imx->lock, flags);
+	if (i2c_imx->state != I2C_IMX_IDLE) {
+		dev_dbg(&i2c_imx->adapter.dev, "<%s> Timeout in message %d\n",
+			__func__, i2c_imx->msg_idx);
+		i2c_imx->state = I2C_IMX_IDLE;
+		result = -ETIMEDOUT;
+	} else {
+		result = i2c_imx->xfer_result;
 	}
+	spin_unlock_irqrestore(&i2c_imx->lock, flags);
 
 fail0:
+	/*
+	 * resolve arbitration loss (if function defined in boardfile),
+	 * lost during the start or the transfer
+	 */
+	if (result == -EPROTO && i2c_imx->handle_arbloss)
+		i2c_imx->handle_arbloss();
+
 	/* Stop I2C transfer */
 	i2c_imx_stop(i2c_imx);
 
@@ -559,6 +611,7 @@ static int __init i2c_imx_probe(struct platform_device *pdev)
 
 	/* Init queue */
 	init_waitqueue_head(&i2c_imx->queue);
+	spin_lock_init(&i2c_imx->lock);
 
 	/* Set up adapter data */
 	i2c_set_adapdata(&i2c_imx->adapter, i2c_imx);
@@ -20,8 +20,9 @@
  * wrapper around the low level ADC driver. Much of the hardware configuration
  * and touchscreen functionality is implemented in the low level ADC driver.
  * During initialization, this driver creates a kernel thread.  This thread
- * then calls the ADC driver to obtain touchscreen values continously. These
- * values are then passed to the input susbsystem.
+ * sleeps in the ADC driver until the pen down interrupt fires, then obtains
+ * touchscreen values at report_rate until the pen is lifted. These values
+ * are then passed to the input susbsystem.
  *
  * @ingroup touchscreen
  */
@@ -42,6 +43,15 @@
 static struct input_dev *imx_inputdev;
 static u32 input_ts_installed;
 
+static unsigned int report_rate = 100;
+module_param(report_rate, uint, 0644);
+MODULE_PARM_DESC(report_rate, "Samples per second while touched (1-1000)");
+
+static void imx_adc_ts_delay(void)
+{
+	msleep(1000 / clamp_val(report_rate, 1, 1000));
+}
+
 static int ts_thread(void *arg)
 {
 	struct t_touch_screen ts_sample;
@@ -51,19 +61,27 @@ static int ts_thread(void *arg)
 		try_to_freeze();
 
 		memset(&ts_sample, 0, sizeof(ts_sample));
-		if (0 != imx_adc_get_touch_sample(&ts_sample, !wait))
+		if (0 != imx_adc_get_touch_sample(&ts_sample, !wait)) {
+			/* rejected sample, retry at the normal rate */
+			if (wait)
+				imx_adc_ts_delay();
 			continue;
+		}
 
 		if ((ts_sample.x_position != 0) || (ts_sample.contact_resistance == 0)) {
 			input_report_abs(imx_inputdev, ABS_X, ts_sample.x_position);
 			input_report_abs(imx_inputdev, ABS_Y, ts_sample.y_position);
 			input_report_abs(imx_inputdev, ABS_PRESSURE,
 					ts_sample.contact_resistance);
+			input_report_key(imx_inputdev, BTN_TOUCH,
+					ts_sample.contact_resistance);
 			input_sync(imx_inputdev);
 		}
 
+		/* after pen up the next call blocks on the pen down irq */
 		wait = ts_sample.contact_resistance;
-		msleep(10);
+		if (wait)
+			imx_adc_ts_delay();
 	}
 
 	return 0;
@@ -27,11 +27,12 @@
 #include <linux/platform_device.h>
 #include <linux/mutex.h>
 #include <linux/clk.h>
+#include <linux/ktime.h>
 
 #include <media/v4l2-common.h>
 #include <media/v4l2-dev.h>
-#include <media/videobuf-core.h>
-#include <media/videobuf-dma-contig.h>
+#include <media/videobuf2-core.h>
+#include <media/videobuf2-dma-contig.h>
 #include <media/soc_camera.h>
 #include <media/soc_mediabus.h>
 
@@ -46,7 +47,7 @@
 #include <asm/dma.h>
 
 #define MX2_CAM_DRV_NAME "mx2-camera"
-#define MX2_CAM_VERSION "0.0.6"
+#define MX2_CAM_VERSION "0.0.7"
 #define MX2_CAM_DRIVER_DESCRIPTION "i.MX2x_Camera"
 
 /* reset values */
@@ -210,6 +211,18 @@
 
 #define MAX_VIDEO_MEM	16
 
+/* per stream statistics, reported by VIDIOC_LOG_STATUS */
+struct mx2_camera_stats {
+	u32			frames;		/* including dropped ones */
+	u32			dropped;	/* no buffer to hand out */
+	u32			overflows;	/* RX FIFO / PrP overruns */
+	u32			irqs;
+	s64			irq_time_max;	/* ns in the irq handler */
+	s64			irq_time_total;
+	s64			frame_interval_max;	/* ns */
+	ktime_t			last_frame;
+};
+
 struct mx2_camera_dev {
 	struct device		*dev;
 	struct soc_camera_host	soc_host;
@@ -241,18 +254,25 @@ struct mx2_camera_dev {
 	void			*discard_buffer;
 	dma_addr_t		discard_buffer_dma;
 	size_t			discard_size;
+
+	struct vb2_alloc_ctx	*alloc_ctx;
+	struct mx2_camera_stats	stats;
 };
 
 /* buffer for one video frame */
 struct mx2_buffer {
 	/* common v4l buffer stuff -- must be first */
-	struct videobuf_buffer		vb;
-
-	enum v4l2_mbus_pixelcode	code;
+	struct vb2_buffer		vb;
+	struct list_head		queue;
 
 	int bufnum;
 };
 
+static struct mx2_buffer *to_mx2_vb(struct vb2_buffer *vb)
+{
+	return container_of(vb, struct mx2_buffer, vb);
+}
+
 static void mx2_camera_deactivate(struct mx2_camera_dev *pcdev)
 {
 	unsigned long flags;
@@ -366,10 +386,62 @@ static irqreturn_t mx27_camera_irq(int irq_csi, void *data)
 }
 #endif /* CONFIG_MACH_MX27 */
 
+/*
+ * Account for one frame period, returns the sequence number of the frame.
+ * Must be called with pcdev->lock held.
+ */
+static u32 mx2_camera_count_frame(struct mx2_camera_dev *pcdev, bool dropped)
+{
+	ktime_t now = ktime_get();
+	s64 interval;
+
+	if (pcdev->stats.frames) {
+		interval = ktime_to_ns(ktime_sub(now, pcdev->stats.last_frame));
+		if (interval > pcdev->stats.frame_interval_max)
+			pcdev->stats.frame_interval_max = interval;
+	}
+	pcdev->stats.last_frame = now;
+
+	if (dropped)
+		pcdev->stats.dropped++;
+
+	return pcdev->stats.frames++;
+}
+
+static void mx2_camera_irq_stats(struct mx2_camera_dev *pcdev, ktime_t start,
+		bool overflow)
+{
+	s64 delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock(&pcdev->lock);
+	if (overflow)
+		pcdev->stats.overflows++;
+	pcdev->stats.irqs++;
+	pcdev->stats.irq_time_total += delta;
+	if (delta > pcdev->stats.irq_time_max)
+		pcdev->stats.irq_time_max = delta;
+	spin_unlock(&pcdev->lock);
+}
+
+/* Must be called with pcdev->lock held */
+static void mx2_camera_buf_done(struct mx2_camera_dev *pcdev,
+		struct mx2_buffer *buf, enum vb2_buffer_state state)
+{
+	struct vb2_buffer *vb = &buf->vb;
+
+	dev_dbg(pcdev->dev, "%s (vb=0x%p) 0x%08x %lu\n", __func__, vb,
+		vb2_dma_contig_plane_dma_addr(vb, 0),
+		vb2_get_plane_payload(vb, 0));
+
+	do_gettimeofday(&vb->v4l2_buf.timestamp);
+	vb->v4l2_buf.field = V4L2_FIELD_NONE;
+	vb->v4l2_buf.sequence = mx2_camera_count_frame(pcdev, false);
+	vb2_buffer_done(vb, state);
+}
+
 static void mx25_camera_frame_done(struct mx2_camera_dev *pcdev, int fb,
-		int state)
+		enum vb2_buffer_state state)
 {
-	struct videobuf_buffer *vb;
 	struct mx2_buffer *buf;
 	struct mx2_buffer **fb_active = fb == 1 ? &pcdev->fb1_active :
 		&pcdev->fb2_active;
@@ -381,28 +453,23 @@ static void mx25_camera_frame_done(struct mx2_camera_dev *pcdev, int fb,
 	if (*fb_active == NULL)
 		goto out;
 
-	vb = &(*fb_active)->vb;
-	dev_dbg(pcdev->dev, "%s (vb=0x%p) 0x%08lx %d\n", __func__,
-		vb, vb->baddr, vb->bsize);
-
-	vb->state = state;
-	do_gettimeofday(&vb->ts);
-	vb->field_count++;
-
-	wake_up(&vb->done);
-
+	/*
+	 * Without a buffer to take its place the one just filled stays in
+	 * the slot and the CSI overwrites it with the next frame. The frame
+	 * is dropped, but the DMA keeps running and nothing is copied.
+	 */
 	if (list_empty(&pcdev->capture)) {
-		buf = NULL;
-		writel(0, pcdev->base_csi + fb_reg);
-	} else {
-		buf = list_entry(pcdev->capture.next, struct mx2_buffer,
-				vb.queue);
-		vb = &buf->vb;
-		list_del(&vb->queue);
-		vb->state = VIDEOBUF_ACTIVE;
-		writel(videobuf_to_dma_contig(vb), pcdev->base_csi + fb_reg);
+		mx2_camera_count_frame(pcdev, true);
+		goto out;
 	}
 
+	mx2_camera_buf_done(pcdev, *fb_active, state);
+
+	buf = list_first_entry(&pcdev->capture, struct mx2_buffer, queue);
+	list_del_init(&buf->queue);
+	writel(vb2_dma_contig_plane_dma_addr(&buf->vb, 0),
+			pcdev->base_csi + fb_reg);
+
 	*fb_active = buf;
 
 out:
@@ -412,138 +479,144 @@ out:
 static irqreturn_t mx25_camera_irq(int irq_csi, void *data)
 {
 	struct mx2_camera_dev *pcdev = data;
+	ktime_t start = ktime_get();
 	u32 status = readl(pcdev->base_csi + CSISR);
 
-	if (status & CSISR_DMA_TSF_FB1_INT)
-		mx25_camera_frame_done(pcdev, 1, VIDEOBUF_DONE);
-	else if (status & CSISR_DMA_TSF_FB2_INT)
-		mx25_camera_frame_done(pcdev, 2, VIDEOBUF_DONE);
+	/* leave FB2 pending if both are done, the irq fires again for it */
+	if (status & CSISR_DMA_TSF_FB1_INT) {
+		mx25_camera_frame_done(pcdev, 1, VB2_BUF_STATE_DONE);
+		status &= ~CSISR_DMA_TSF_FB2_INT;
+	} else if (status & CSISR_DMA_TSF_FB2_INT) {
+		mx25_camera_frame_done(pcdev, 2, VB2_BUF_STATE_DONE);
+	}
 
 	/* FIXME: handle CSISR_RFF_OR_INT */
 
 	writel(status, pcdev->base_csi + CSISR);
 
+	mx2_camera_irq_stats(pcdev, start, status & CSISR_RFF_OR_INT);
+
 	return IRQ_HANDLED;
 }
 
 /*
  *  Videobuf operations
  */
-static int mx2_videobuf_setup(struct videobuf_queue *vq, unsigned int *count,
-			      unsigned int *size)
+static int mx2_videobuf_setup(struct vb2_queue *vq,
+			const struct v4l2_format *fmt,
+			unsigned int *count, unsigned int *num_planes,
+			unsigned int sizes[], void *alloc_ctxs[])
 {
-	struct soc_camera_device *icd = vq->priv_data;
-	int bytes_per_line = soc_mbus_bytes_per_line(icd->user_width,
-			icd->current_fmt->host_fmt);
+	struct soc_camera_device *icd = soc_camera_from_vb2q(vq);
+	struct soc_camera_host *ici = to_soc_camera_host(icd->parent);
+	struct mx2_camera_dev *pcdev = ici->priv;
+	int bytes_per_line;
+	unsigned int height;
+
+	if (fmt) {
+		const struct soc_camera_format_xlate *xlate =
+			soc_camera_xlate_by_fourcc(icd,
+					fmt->fmt.pix.pixelformat);
+		if (!xlate)
+			return -EINVAL;
+		bytes_per_line = soc_mbus_bytes_per_line(fmt->fmt.pix.width,
+				xlate->host_fmt);
+		height = fmt->fmt.pix.height;
+	} else {
+		bytes_per_line = soc_mbus_bytes_per_line(icd->user_width,
+				icd->current_fmt->host_fmt);
+		height = icd->user_height;
+	}
 
-	dev_dbg(icd->parent, "count=%d, size=%d\n", *count, *size);
+	dev_dbg(icd->parent, "count=%d, bytes_per_line=%d\n", *count,
+		bytes_per_line);
 
 	if (bytes_per_line < 0)
 		return bytes_per_line;
 
-	*size = bytes_per_line * icd->user_height;
+	sizes[0] = bytes_per_line * height;
+	alloc_ctxs[0] = pcdev->alloc_ctx;
 
 	if (0 == *count)
 		*count = 32;
-	if (*size * *count > MAX_VIDEO_MEM * 1024 * 1024)
-		*count = (MAX_VIDEO_MEM * 1024 * 1024) / *size;
+	/*
+	 * On the MX25 two buffers sit in the CSI frame buffer slots, a frame
+	 * is only handed out when a third one can take its place.
+	 */
+	if (cpu_is_mx25() && !vq->num_buffers && *count < 3)
+		*count = 3;
+	if (sizes[0] * *count > MAX_VIDEO_MEM * 1024 * 1024)
+		*count = (MAX_VIDEO_MEM * 1024 * 1024) / sizes[0];
+
+	*num_planes = 1;
 
 	return 0;
 }
 
-static void free_buffer(struct videobuf_queue *vq, struct mx2_buffer *buf)
+static int mx2_videobuf_init(struct vb2_buffer *vb)
 {
-	struct soc_camera_device *icd = vq->priv_data;
-	struct videobuf_buffer *vb = &buf->vb;
-
-	dev_dbg(icd->parent, "%s (vb=0x%p) 0x%08lx %d\n", __func__,
-		vb, vb->baddr, vb->bsize);
-
-	/*
-	 * This waits until this buffer is out of danger, i.e., until it is no
-	 * longer in state VIDEOBUF_QUEUED or VIDEOBUF_ACTIVE
-	 */
-	videobuf_waiton(vq, vb, 0, 0);
+	struct mx2_buffer *buf = to_mx2_vb(vb);
 
-	videobuf_dma_contig_free(vq, vb);
-	dev_dbg(icd->parent, "%s freed\n", __func__);
+	INIT_LIST_HEAD(&buf->queue);
 
-	vb->state = VIDEOBUF_NEEDS_INIT;
+	return 0;
 }
 
-static int mx2_videobuf_prepare(struct videobuf_queue *vq,
-		struct videobuf_buffer *vb, enum v4l2_field field)
+static int mx2_videobuf_prepare(struct vb2_buffer *vb)
 {
-	struct soc_camera_device *icd = vq->priv_data;
-	struct mx2_buffer *buf = container_of(vb, struct mx2_buffer, vb);
+	struct soc_camera_device *icd = soc_camera_from_vb2q(vb->vb2_queue);
 	int bytes_per_line = soc_mbus_bytes_per_line(icd->user_width,
 			icd->current_fmt->host_fmt);
-	int ret = 0;
+	unsigned long size;
 
-	dev_dbg(icd->parent, "%s (vb=0x%p) 0x%08lx %d\n", __func__,
-		vb, vb->baddr, vb->bsize);
+	dev_dbg(icd->parent, "%s (vb=0x%p) 0x%08x %lu\n", __func__,
+		vb, vb2_dma_contig_plane_dma_addr(vb, 0),
+		vb2_plane_size(vb, 0));
 
 	if (bytes_per_line < 0)
 		return bytes_per_line;
 
+	size = bytes_per_line * icd->user_height;
+	if (vb2_plane_size(vb, 0) < size) {
+		dev_err(icd->parent, "Buffer #%d too small (%lu < %lu)\n",
+			vb->v4l2_buf.index, vb2_plane_size(vb, 0), size);
+		return -EINVAL;
+	}
+
+	/* USERPTR buffers come in at any offset, the DMA writes words */
+	if (vb2_dma_contig_plane_dma_addr(vb, 0) & 3)
+		return -EINVAL;
+
+	vb2_set_plane_payload(vb, 0, size);
+
 #ifdef DEBUG
 	/*
 	 * This can be useful if you want to see if we actually fill
 	 * the buffer with something
 	 */
-	memset((void *)vb->baddr, 0xaa, vb->bsize);
+	if (vb2_plane_vaddr(vb, 0))
+		memset(vb2_plane_vaddr(vb, 0), 0xaa, size);
 #endif
 
-	if (buf->code	!= icd->current_fmt->code ||
-	    vb->width	!= icd->user_width ||
-	    vb->height	!= icd->user_height ||
-	    vb->field	!= field) {
-		buf->code	= icd->current_fmt->code;
-		vb->width	= icd->user_width;
-		vb->height	= icd->user_height;
-		vb->field	= field;
-		vb->state	= VIDEOBUF_NEEDS_INIT;
-	}
-
-	vb->size = bytes_per_line * vb->height;
-	if (vb->baddr && vb->bsize < vb->size) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	if (vb->state == VIDEOBUF_NEEDS_INIT) {
-		ret = videobuf_iolock(vq, vb, NULL);
-		if (ret)
-			goto fail;
-
-		vb->state = VIDEOBUF_PREPARED;
-	}
-
 	return 0;
-
-fail:
-	free_buffer(vq, buf);
-out:
-	return ret;
 }
 
-static void mx2_videobuf_queue(struct videobuf_queue *vq,
-			       struct videobuf_buffer *vb)
+static void mx2_videobuf_queue(struct vb2_buffer *vb)
 {
-	struct soc_camera_device *icd = vq->priv_data;
+	struct soc_camera_device *icd = soc_camera_from_vb2q(vb->vb2_queue);
 	struct soc_camera_host *ici =
 		to_soc_camera_host(icd->parent);
 	struct mx2_camera_dev *pcdev = ici->priv;
-	struct mx2_buffer *buf = container_of(vb, struct mx2_buffer, vb);
+	struct mx2_buffer *buf = to_mx2_vb(vb);
+	dma_addr_t phys = vb2_dma_contig_plane_dma_addr(vb, 0);
 	unsigned long flags;
 
-	dev_dbg(icd->parent, "%s (vb=0x%p) 0x%08lx %d\n", __func__,
-		vb, vb->baddr, vb->bsize);
+	dev_dbg(icd->parent, "%s (vb=0x%p) 0x%08x %lu\n", __func__,
+		vb, phys, vb2_get_plane_payload(vb, 0));
 
 	spin_lock_irqsave(&pcdev->lock, flags);
 
-	vb->state = VIDEOBUF_QUEUED;
-	list_add_tail(&vb->queue, &pcdev->capture);
+	list_add_tail(&buf->queue, &pcdev->capture);
 
 	if (mx27_camera_emma(pcdev)) {
 		goto out;
@@ -552,17 +625,16 @@ static void mx2_videobuf_queue(struct videobuf_queue *vq,
 		int ret;
 
 		if (pcdev->active == NULL) {
-			ret = imx_dma_setup_single(pcdev->dma,
-					videobuf_to_dma_contig(vb), vb->size,
+			ret = imx_dma_setup_single(pcdev->dma, phys,
+					vb2_get_plane_payload(vb, 0),
 					(u32)pcdev->base_dma + 0x10,
 					DMA_MODE_READ);
 			if (ret) {
-				vb->state = VIDEOBUF_ERROR;
-				wake_up(&vb->done);
+				list_del_init(&buf->queue);
+				vb2_buffer_done(vb, VB2_BUF_STATE_ERROR);
 				goto out;
 			}
 
-			vb->state = VIDEOBUF_ACTIVE;
 			pcdev->active = buf;
 		}
 #endif
@@ -570,20 +642,17 @@ static void mx2_videobuf_queue(struct videobuf_queue *vq,
 		u32 csicr3, dma_inten = 0;
 
 		if (pcdev->fb1_active == NULL) {
-			writel(videobuf_to_dma_contig(vb),
-					pcdev->base_csi + CSIDMASA_FB1);
+			writel(phys, pcdev->base_csi + CSIDMASA_FB1);
 			pcdev->fb1_active = buf;
 			dma_inten = CSICR1_FB1_DMA_INTEN;
 		} else if (pcdev->fb2_active == NULL) {
-			writel(videobuf_to_dma_contig(vb),
-					pcdev->base_csi + CSIDMASA_FB2);
+			writel(phys, pcdev->base_csi + CSIDMASA_FB2);
 			pcdev->fb2_active = buf;
 			dma_inten = CSICR1_FB2_DMA_INTEN;
 		}
 
 		if (dma_inten) {
-			list_del(&vb->queue);
-			vb->state = VIDEOBUF_ACTIVE;
+			list_del_init(&buf->queue);
 
 			csicr3 = readl(pcdev->base_csi + CSICR3);
 
@@ -606,84 +675,99 @@ out:
 	spin_unlock_irqrestore(&pcdev->lock, flags);
 }
 
-static void mx2_videobuf_release(struct videobuf_queue *vq,
-				 struct videobuf_buffer *vb)
+static int mx2_start_streaming(struct vb2_queue *q, unsigned int count)
 {
-	struct soc_camera_device *icd = vq->priv_data;
+	struct soc_camera_device *icd = soc_camera_from_vb2q(q);
 	struct soc_camera_host *ici = to_soc_camera_host(icd->parent);
 	struct mx2_camera_dev *pcdev = ici->priv;
-	struct mx2_buffer *buf = container_of(vb, struct mx2_buffer, vb);
 	unsigned long flags;
 
-#ifdef DEBUG
-	dev_dbg(icd->parent, "%s (vb=0x%p) 0x%08lx %d\n", __func__,
-		vb, vb->baddr, vb->bsize);
-
-	switch (vb->state) {
-	case VIDEOBUF_ACTIVE:
-		dev_info(icd->parent, "%s (active)\n", __func__);
-		break;
-	case VIDEOBUF_QUEUED:
-		dev_info(icd->parent, "%s (queued)\n", __func__);
-		break;
-	case VIDEOBUF_PREPARED:
-		dev_info(icd->parent, "%s (prepared)\n", __func__);
-		break;
-	default:
-		dev_info(icd->parent, "%s (unknown) %d\n", __func__,
-				vb->state);
-		break;
-	}
-#endif
+	spin_lock_irqsave(&pcdev->lock, flags);
+	memset(&pcdev->stats, 0, sizeof(pcdev->stats));
+	spin_unlock_irqrestore(&pcdev->lock, flags);
+
+	return 0;
+}
+
+static int mx2_stop_streaming(struct vb2_queue *q)
+{
+	struct soc_camera_device *icd = soc_camera_from_vb2q(q);
+	struct soc_camera_host *ici = to_soc_camera_host(icd->parent);
+	struct mx2_camera_dev *pcdev = ici->priv;
+	struct mx2_buffer *buf, *tmp;
+	unsigned long flags;
 
-	/*
-	 * Terminate only queued but inactive buffers. Active buffers are
-	 * released when they become inactive after videobuf_waiton().
-	 *
-	 * FIXME: implement forced termination of active buffers for mx27 and
-	 * mx27 eMMA, so that the user won't get stuck in an uninterruptible
-	 * state. This requires a specific handling for each of the these DMA
-	 * types.
-	 */
 	spin_lock_irqsave(&pcdev->lock, flags);
-	if (vb->state == VIDEOBUF_QUEUED) {
-		list_del(&vb->queue);
-		vb->state = VIDEOBUF_ERROR;
-	} else if (cpu_is_mx25() && vb->state == VIDEOBUF_ACTIVE) {
-		if (pcdev->fb1_active == buf) {
-			pcdev->csicr1 &= ~CSICR1_FB1_DMA_INTEN;
-			writel(0, pcdev->base_csi + CSIDMASA_FB1);
-			pcdev->fb1_active = NULL;
-		} else if (pcdev->fb2_active == buf) {
-			pcdev->csicr1 &= ~CSICR1_FB2_DMA_INTEN;
-			writel(0, pcdev->base_csi + CSIDMASA_FB2);
-			pcdev->fb2_active = NULL;
+
+	if (mx27_camera_emma(pcdev)) {
+		/* the PrP keeps running, let it write to the discard buffer */
+		writel(pcdev->discard_buffer_dma,
+				pcdev->base_emma + PRP_DEST_RGB1_PTR);
+		writel(pcdev->discard_buffer_dma,
+				pcdev->base_emma + PRP_DEST_RGB2_PTR);
+
+		list_for_each_entry_safe(buf, tmp, &pcdev->active_bufs, queue) {
+			list_del_init(&buf->queue);
+			vb2_buffer_done(&buf->vb, VB2_BUF_STATE_ERROR);
 		}
+#ifdef CONFIG_MACH_MX27
+	} else if (cpu_is_mx27()) {
+		/* the active buffer is still on the capture list */
+		imx_dma_disable(pcdev->dma);
+		pcdev->active = NULL;
+#endif
+	} else if (cpu_is_mx25()) {
+		u32 csicr3 = readl(pcdev->base_csi + CSICR3);
+
+		writel(csicr3 & ~CSICR3_DMA_REQ_EN_RFF,
+				pcdev->base_csi + CSICR3);
+		pcdev->csicr1 &= ~(CSICR1_FB1_DMA_INTEN | CSICR1_FB2_DMA_INTEN);
 		writel(pcdev->csicr1, pcdev->base_csi + CSICR1);
-		vb->state = VIDEOBUF_ERROR;
+		writel(0, pcdev->base_csi + CSIDMASA_FB1);
+		writel(0, pcdev->base_csi + CSIDMASA_FB2);
+
+		if (pcdev->fb1_active)
+			vb2_buffer_done(&pcdev->fb1_active->vb,
+					VB2_BUF_STATE_ERROR);
+		if (pcdev->fb2_active)
+			vb2_buffer_done(&pcdev->fb2_active->vb,
+					VB2_BUF_STATE_ERROR);
+		pcdev->fb1_active = NULL;
+		pcdev->fb2_active = NULL;
+	}
+
+	list_for_each_entry_safe(buf, tmp, &pcdev->capture, queue) {
+		list_del_init(&buf->queue);
+		vb2_buffer_done(&buf->vb, VB2_BUF_STATE_ERROR);
 	}
+
 	spin_unlock_irqrestore(&pcdev->lock, flags);
 
-	free_buffer(vq, buf);
+	return 0;
 }
 
-static struct videobuf_queue_ops mx2_videobuf_ops = {
-	.buf_setup      = mx2_videobuf_setup,
-	.buf_prepare    = mx2_videobuf_prepare,
-	.buf_queue      = mx2_videobuf_queue,
-	.buf_release    = mx2_videobuf_release,
+static struct vb2_ops mx2_videobuf_ops = {
+	.queue_setup	= mx2_videobuf_setup,
+	.buf_init	= mx2_videobuf_init,
+	.buf_prepare	= mx2_videobuf_prepare,
+	.buf_queue	= mx2_videobuf_queue,
+	.wait_prepare	= soc_camera_unlock,
+	.wait_finish	= soc_camera_lock,
+	.start_streaming = mx2_start_streaming,
+	.stop_streaming	= mx2_stop_streaming,
 };
 
-static void mx2_camera_init_videobuf(struct videobuf_queue *q,
+static int mx2_camera_init_videobuf(struct vb2_queue *q,
 			      struct soc_camera_device *icd)
 {
-	struct soc_camera_host *ici = to_soc_camera_host(icd->parent);
-	struct mx2_camera_dev *pcdev = ici->priv;
-
-	videobuf_queue_dma_contig_init(q, &mx2_videobuf_ops, pcdev->dev,
-			&pcdev->lock, V4L2_BUF_TYPE_VIDEO_CAPTURE,
-			V4L2_FIELD_NONE, sizeof(struct mx2_buffer),
-			icd, &icd->video_lock);
+	q->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	q->io_modes = VB2_MMAP | VB2_USERPTR;
+	q->drv_priv = icd;
+	q->ops = &mx2_videobuf_ops;
+	q->mem_ops = &vb2_dma_contig_memops;
+	q->buf_struct_size = sizeof(struct mx2_buffer);
+
+	return vb2_queue_init(q);
 }
 
 #define MX2_BUS_FLAGS	(V4L2_MBUS_MASTER | \
@@ -1035,25 +1119,34 @@ static int mx2_camera_querycap(struct soc_camera_host *ici,
 	return 0;
 }
 
-static int mx2_camera_reqbufs(struct soc_camera_device *icd,
-			      struct v4l2_requestbuffers *p)
+static int mx2_camera_log_status(struct soc_camera_device *icd)
 {
-	int i;
+	struct soc_camera_host *ici = to_soc_camera_host(icd->parent);
+	struct mx2_camera_dev *pcdev = ici->priv;
+	struct mx2_camera_stats stats;
+	unsigned long flags;
 
-	for (i = 0; i < p->count; i++) {
-		struct mx2_buffer *buf = container_of(icd->vb_vidq.bufs[i],
-						      struct mx2_buffer, vb);
-		INIT_LIST_HEAD(&buf->vb.queue);
-	}
+	spin_lock_irqsave(&pcdev->lock, flags);
+	stats = pcdev->stats;
+	spin_unlock_irqrestore(&pcdev->lock, flags);
+
+	v4l2_info(&ici->v4l2_dev, "frames: %u, dropped: %u, overflows: %u\n",
+		  stats.frames, stats.dropped, stats.overflows);
+	v4l2_info(&ici->v4l2_dev, "max frame interval: %lld us\n",
+		  div_s64(stats.frame_interval_max, 1000));
+	v4l2_info(&ici->v4l2_dev, "irq time: max %lld ns, avg %lld ns\n",
+		  stats.irq_time_max, stats.irqs ?
+		  div_s64(stats.irq_time_total, stats.irqs) : 0);
 
 	return 0;
 }
 
 #ifdef CONFIG_MACH_MX27
-static void mx27_camera_frame_done(struct mx2_camera_dev *pcdev, int state)
+static void mx27_camera_frame_done(struct mx2_camera_dev *pcdev,
+		enum vb2_buffer_state state)
 {
-	struct videobuf_buffer *vb;
 	struct mx2_buffer *buf;
+	struct vb2_buffer *vb;
 	unsigned long flags;
 	int ret;
 
@@ -1065,38 +1158,32 @@ static void mx27_camera_frame_done(struct mx2_camera_dev *pcdev, int state)
 		goto out;
 	}
 
-	vb = &pcdev->active->vb;
-	buf = container_of(vb, struct mx2_buffer, vb);
-	WARN_ON(list_empty(&vb->queue));
-	dev_dbg(pcdev->dev, "%s (vb=0x%p) 0x%08lx %d\n", __func__,
-		vb, vb->baddr, vb->bsize);
+	buf = pcdev->active;
+	WARN_ON(list_empty(&buf->queue));
 
 	/* _init is used to debug races, see comment in pxa_camera_reqbufs() */
-	list_del_init(&vb->queue);
-	vb->state = state;
-	do_gettimeofday(&vb->ts);
-	vb->field_count++;
-
-	wake_up(&vb->done);
+	list_del_init(&buf->queue);
+	mx2_camera_buf_done(pcdev, buf, state);
 
 	if (list_empty(&pcdev->capture)) {
 		pcdev->active = NULL;
 		goto out;
 	}
 
-	pcdev->active = list_entry(pcdev->capture.next,
-			struct mx2_buffer, vb.queue);
+	pcdev->active = list_first_entry(&pcdev->capture,
+			struct mx2_buffer, queue);
 
 	vb = &pcdev->active->vb;
-	vb->state = VIDEOBUF_ACTIVE;
 
-	ret = imx_dma_setup_single(pcdev->dma, videobuf_to_dma_contig(vb),
-			vb->size, (u32)pcdev->base_dma + 0x10, DMA_MODE_READ);
+	ret = imx_dma_setup_single(pcdev->dma,
+			vb2_dma_contig_plane_dma_addr(vb, 0),
+			vb2_get_plane_payload(vb, 0),
+			(u32)pcdev->base_dma + 0x10, DMA_MODE_READ);
 
 	if (ret) {
-		vb->state = VIDEOBUF_ERROR;
+		list_del_init(&pcdev->active->queue);
 		pcdev->active = NULL;
-		wake_up(&vb->done);
+		vb2_buffer_done(vb, VB2_BUF_STATE_ERROR);
 	}
 
 out:
@@ -1107,14 +1194,14 @@ static void mx27_camera_dma_err_callback(int channel, void *data, int err)
 {
 	struct mx2_camera_dev *pcdev = data;
 
-	mx27_camera_frame_done(pcdev, VIDEOBUF_ERROR);
+	mx27_camera_frame_done(pcdev, VB2_BUF_STATE_ERROR);
 }
 
 static void mx27_camera_dma_callback(int channel, void *data)
 {
 	struct mx2_camera_dev *pcdev = data;
 
-	mx27_camera_frame_done(pcdev, VIDEOBUF_DONE);
+	mx27_camera_frame_done(pcdev, VB2_BUF_STATE_DONE);
 }
 
 #define DMA_REQ_CSI_RX          31 /* FIXME: Add this to a resource */
@@ -1164,7 +1251,7 @@ static unsigned int mx2_camera_poll(struct file *file, poll_table *pt)
 {
 	struct soc_camera_device *icd = file->private_data;
 
-	return videobuf_poll_stream(file, &icd->vb_vidq, pt);
+	return vb2_poll(&icd->vb2_vidq, file, pt);
 }
 
 static struct soc_camera_host_ops mx2_soc_camera_host_ops = {
@@ -1174,46 +1261,39 @@ static struct soc_camera_host_ops mx2_soc_camera_host_ops = {
 	.set_fmt	= mx2_camera_set_fmt,
 	.set_crop	= mx2_camera_set_crop,
 	.try_fmt	= mx2_camera_try_fmt,
-	.init_videobuf	= mx2_camera_init_videobuf,
-	.reqbufs	= mx2_camera_reqbufs,
+	.init_videobuf2	= mx2_camera_init_videobuf,
+	.log_status	= mx2_camera_log_status,
 	.poll		= mx2_camera_poll,
 	.querycap	= mx2_camera_querycap,
 	.set_bus_param	= mx2_camera_set_bus_param,
 };
 
 static void mx27_camera_frame_done_emma(struct mx2_camera_dev *pcdev,
-		int bufnum, int state)
+		int bufnum, enum vb2_buffer_state state)
 {
-	struct mx2_buffer *buf;
-	struct videobuf_buffer *vb;
+	struct mx2_buffer *buf = NULL;
 	unsigned long phys;
 
-	if (!list_empty(&pcdev->active_bufs)) {
-		buf = list_entry(pcdev->active_bufs.next,
-			struct mx2_buffer, vb.queue);
-
-		BUG_ON(buf->bufnum != bufnum);
+	if (!list_empty(&pcdev->active_bufs))
+		buf = list_first_entry(&pcdev->active_bufs,
+			struct mx2_buffer, queue);
 
-		vb = &buf->vb;
+	/* otherwise this output was parked on the discard buffer */
+	if (buf && buf->bufnum == bufnum) {
 #ifdef DEBUG
-		phys = videobuf_to_dma_contig(vb);
+		phys = vb2_dma_contig_plane_dma_addr(&buf->vb, 0);
 		if (readl(pcdev->base_emma + PRP_DEST_RGB1_PTR + 4 * bufnum)
 				!= phys) {
-			dev_err(pcdev->dev, "%p != %p\n", phys,
+			dev_err(pcdev->dev, "0x%08lx != 0x%08x\n", phys,
 					readl(pcdev->base_emma +
 						PRP_DEST_RGB1_PTR +
 						4 * bufnum));
 		}
 #endif
-		dev_dbg(pcdev->dev, "%s (vb=0x%p) 0x%08lx %d\n", __func__, vb,
-				vb->baddr, vb->bsize);
-
-		list_del(&vb->queue);
-		vb->state = state;
-		do_gettimeofday(&vb->ts);
-		vb->field_count++;
-
-		wake_up(&vb->done);
+		list_del_init(&buf->queue);
+		mx2_camera_buf_done(pcdev, buf, state);
+	} else {
+		mx2_camera_count_frame(pcdev, true);
 	}
 
 	if (list_empty(&pcdev->capture)) {
@@ -1222,23 +1302,20 @@ static void mx27_camera_frame_done_emma(struct mx2_camera_dev *pcdev,
 		return;
 	}
 
-	buf = list_entry(pcdev->capture.next,
-			struct mx2_buffer, vb.queue);
+	buf = list_first_entry(&pcdev->capture, struct mx2_buffer, queue);
 
 	buf->bufnum = !bufnum;
 
-	list_move_tail(pcdev->capture.next, &pcdev->active_bufs);
-
-	vb = &buf->vb;
-	vb->state = VIDEOBUF_ACTIVE;
+	list_move_tail(&buf->queue, &pcdev->active_bufs);
 
-	phys = videobuf_to_dma_contig(vb);
+	phys = vb2_dma_contig_plane_dma_addr(&buf->vb, 0);
 	writel(phys, pcdev->base_emma + PRP_DEST_RGB1_PTR + 4 * bufnum);
 }
 
 static irqreturn_t mx27_camera_emma_irq(int irq_emma, void *data)
 {
 	struct mx2_camera_dev *pcdev = data;
+	ktime_t start = ktime_get();
 	unsigned int status = readl(pcdev->base_emma + PRP_INTRSTATUS);
 	struct mx2_buffer *buf;
 
@@ -1256,6 +1333,8 @@ static irqreturn_t mx27_camera_emma_irq(int irq_emma, void *data)
 		writel(cntl & ~PRP_CNTL_CH1EN, pcdev->base_emma + PRP_CNTL);
 		writel(cntl, pcdev->base_emma + PRP_CNTL);
 	}
+
+	spin_lock(&pcdev->lock);
 	if ((status & (3 << 5)) == (3 << 5)
 			&& !list_empty(&pcdev->active_bufs)) {
 		/*
@@ -1263,17 +1342,21 @@ static irqreturn_t mx27_camera_emma_irq(int irq_emma, void *data)
 		 * to first
 		 */
 		buf = list_entry(pcdev->active_bufs.next,
-			struct mx2_buffer, vb.queue);
-		mx27_camera_frame_done_emma(pcdev, buf->bufnum, VIDEOBUF_DONE);
+			struct mx2_buffer, queue);
+		mx27_camera_frame_done_emma(pcdev, buf->bufnum,
+				VB2_BUF_STATE_DONE);
 		status &= ~(1 << (6 - buf->bufnum)); /* mark processed */
 	}
 	if (status & (1 << 6))
-		mx27_camera_frame_done_emma(pcdev, 0, VIDEOBUF_DONE);
+		mx27_camera_frame_done_emma(pcdev, 0, VB2_BUF_STATE_DONE);
 	if (status & (1 << 5))
-		mx27_camera_frame_done_emma(pcdev, 1, VIDEOBUF_DONE);
+		mx27_camera_frame_done_emma(pcdev, 1, VB2_BUF_STATE_DONE);
+	spin_unlock(&pcdev->lock);
 
 	writel(status, pcdev->base_emma + PRP_INTRSTATUS);
 
+	mx2_camera_irq_stats(pcdev, start, status & PRP_INTR_LBOVF);
+
 	return IRQ_HANDLED;
 }
 
@@ -1435,6 +1518,12 @@ static int __devinit mx2_camera_probe(struct platform_device *pdev)
 		}
 	}
 
+	pcdev->alloc_ctx = vb2_dma_contig_init_ctx(&pdev->dev);
+	if (IS_ERR(pcdev->alloc_ctx)) {
+		err = PTR_ERR(pcdev->alloc_ctx);
+		goto exit_free_emma;
+	}
+
 	pcdev->soc_host.drv_name	= MX2_CAM_DRV_NAME,
 	pcdev->soc_host.ops		= &mx2_soc_camera_host_ops,
 	pcdev->soc_host.priv		= pcdev;
@@ -1442,13 +1531,15 @@ static int __devinit mx2_camera_probe(struct platform_device *pdev)
 	pcdev->soc_host.nr		= pdev->id;
 	err = soc_camera_host_register(&pcdev->soc_host);
 	if (err)
-		goto exit_free_emma;
+		goto exit_free_alloc_ctx;
 
 	dev_info(&pdev->dev, "MX2 Camera (CSI) driver probed, clock frequency: %ld\n",
 			clk_get_rate(pcdev->clk_csi));
 
 	return 0;
 
+exit_free_alloc_ctx:
+	vb2_dma_contig_cleanup_ctx(pcdev->alloc_ctx);
 exit_free_emma:
 	if (mx27_camera_emma(pcdev)) {
 		free_irq(pcdev->irq_emma, pcdev);
@@ -1494,6 +1585,8 @@ static int __devexit mx2_camera_remove(struct platform_device *pdev)
 
 	soc_camera_host_unregister(&pcdev->soc_host);
 
+	vb2_dma_contig_cleanup_ctx(pcdev->alloc_ctx);
+
 	iounmap(pcdev->base_csi);
 
 	if (mx27_camera_emma(pcdev)) {
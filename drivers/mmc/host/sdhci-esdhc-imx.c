@@ -55,6 +55,12 @@
  * exeception. Bit1 of Vendor Spec registor is used to fix it.
  */
 #define ESDHC_FLAG_MULTIBLK_NO_INT	(1 << 1)
+/*
+ * Errata ENGcm07207 on i.MX25: multi-blk IO hangs the same way unless
+ * CMD12/CMD23 go out with CMDTYPE "11". Only the command type is
+ * changed, the SDIO read fix of the imx53 is not needed.
+ */
+#define ESDHC_FLAG_ENGCM07207		(1 << 2)
 
 enum imx_esdhc_type {
 	IMX25_ESDHC,
@@ -163,7 +169,9 @@ static u32 esdhc_readl_le(struct sdhci_host *host, int reg)
 		 * ADMA2 capability of esdhc, but this bit is messed up on
 		 * some SOCs (e.g. on MX25, MX35 this bit is set, but they
 		 * don't actually support ADMA2). So set the BROKEN_ADMA
-		 * uirk on MX25/35 platforms.
+		 * quirk on MX35. The MX25 does ADMA2 as long as it never
+		 * sees a zero length descriptor
+		 * (SDHCI_QUIRK_BROKEN_ADMA_ZEROLEN_DESC).
 		 */
 
 		if (val & SDHCI_CAN_DO_ADMA1) {
@@ -277,7 +285,8 @@ static void esdhc_writew_le(struct sdhci_host *host, u16 val, int reg)
 	case SDHCI_COMMAND:
 		if ((host->cmd->opcode == MMC_STOP_TRANSMISSION ||
 		     host->cmd->opcode == MMC_SET_BLOCK_COUNT) &&
-	            (imx_data->flags & ESDHC_FLAG_MULTIBLK_NO_INT))
+		    (imx_data->flags & (ESDHC_FLAG_MULTIBLK_NO_INT |
+					ESDHC_FLAG_ENGCM07207)))
 			val |= SDHCI_CMD_ABORTCMD;
 
 		if (is_imx6q_usdhc(imx_data)) {
@@ -475,11 +484,15 @@ static int __devinit sdhci_esdhc_imx_probe(struct platform_device *pdev)
 
 	host->quirks |= SDHCI_QUIRK_BROKEN_TIMEOUT_VAL;
 
-	if (is_imx25_esdhc(imx_data) || is_imx35_esdhc(imx_data))
+	if (is_imx35_esdhc(imx_data))
 		/* Fix errata ENGcm07207 present on i.MX25 and i.MX35 */
 		host->quirks |= SDHCI_QUIRK_NO_MULTIBLOCK
 			| SDHCI_QUIRK_BROKEN_ADMA;
 
+	/* the i.MX25 keeps ADMA2 and multiblock, see ESDHC_FLAG_ENGCM07207 */
+	if (is_imx25_esdhc(imx_data))
+		imx_data->flags |= ESDHC_FLAG_ENGCM07207;
+
 	if (is_imx53_esdhc(imx_data))
 		imx_data->flags |= ESDHC_FLAG_MULTIBLK_NO_INT;
 
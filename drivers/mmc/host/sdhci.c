@@ -529,9 +529,16 @@ static int sdhci_adma_table_pre(struct sdhci_host *host,
 
 		BUG_ON(len > 65536);
 
-		/* tran, valid */
-		sdhci_set_adma_desc(desc, addr, len, 0x21);
-		desc += 8;
+		/*
+		 * A length of zero means 65536 bytes to the spec and is
+		 * not handled at all by some controllers, so drop the
+		 * descriptor if the bounce buffer took the whole segment.
+		 */
+		if (len) {
+			/* tran, valid */
+			sdhci_set_adma_desc(desc, addr, len, 0x21);
+			desc += 8;
+		}
 
 		/*
 		 * If this triggers then we have a calculation bug
@@ -140,6 +140,10 @@
 
 #define NFC_V3_DELAY_LINE		(host->regs_ip + 0x34)
 
+/* read cache commands of large page devices */
+#define NAND_CMD_READCACHESEQ		0x31
+#define NAND_CMD_READCACHEEND		0x3f
+
 struct mxc_nand_host {
 	struct mtd_info		mtd;
 	struct nand_chip	nand;
@@ -165,6 +169,26 @@ struct mxc_nand_host {
 	unsigned int		buf_start;
 	int			spare_len;
 
+	/*
+	 * A page read leaves main and spare area in the NFC buffer, they
+	 * are only copied to data_buf once the byte accessors need them.
+	 * page_loaded is set when ecc.write_page has filled the NFC buffer
+	 * directly, so PAGEPROG must not overwrite it from data_buf.
+	 */
+	bool			main_pending;
+	bool			spare_pending;
+	bool			page_loaded;
+
+	/*
+	 * Sequential page reads use the read cache of the chip: while the
+	 * NFC drains page n the chip already fetches page n + 1 from the
+	 * array. last_page is the page of the previous read, cache_page
+	 * the page the chip is fetching, -1 if not in cache read mode.
+	 */
+	int			cache_read;
+	int			last_page;
+	int			cache_page;
+
 	void			(*preset)(struct mtd_info *);
 	void			(*send_cmd)(struct mxc_nand_host *, uint16_t, int);
 	void			(*send_addr)(struct mxc_nand_host *, uint16_t, int);
@@ -607,6 +631,94 @@ static int mxc_nand_calculate_ecc(struct mtd_info *mtd, const u_char *dat,
 	return 0;
 }
 
+/*
+ * Function to transfer data between the spare area and the linear oob
+ * buffer d.
+ */
+static void copy_spare(struct mtd_info *mtd, u8 *d, bool bfrom)
+{
+	struct nand_chip *this = mtd->priv;
+	struct mxc_nand_host *host = this->priv;
+	u16 i, j;
+	u16 n = mtd->writesize >> 9;
+	u8 *s = host->spare0;
+	u16 t = host->spare_len;
+
+	j = (mtd->oobsize / n >> 1) << 1;
+
+	if (bfrom) {
+		for (i = 0; i < n - 1; i++)
+			memcpy(d + i * j, s + i * t, j);
+
+		/* the last section */
+		memcpy(d + i * j, s + i * t, mtd->oobsize - i * j);
+	} else {
+		for (i = 0; i < n - 1; i++)
+			memcpy(&s[i * t], &d[i * j], j);
+
+		/* the last section */
+		memcpy(&s[i * t], &d[i * j], mtd->oobsize - i * j);
+	}
+}
+
+/*
+ * Make the part of data_buf starting at col with length len valid by
+ * fetching whatever the last page read left in the NFC buffer.
+ */
+static void mxc_nand_sync_buf(struct mtd_info *mtd, int col, int len)
+{
+	struct nand_chip *nand_chip = mtd->priv;
+	struct mxc_nand_host *host = nand_chip->priv;
+
+	if (host->main_pending && col < mtd->writesize) {
+		memcpy(host->data_buf, host->main_area0, mtd->writesize);
+		host->main_pending = false;
+	}
+
+	if (host->spare_pending && col + len > mtd->writesize) {
+		copy_spare(mtd, host->data_buf + mtd->writesize, true);
+		host->spare_pending = false;
+	}
+}
+
+/*
+ * Hardware ECC page read. The NFC has already read and corrected the
+ * page on NAND_CMD_READ0, so copy main and spare area straight to the
+ * caller and account the ECC status once for the whole page.
+ */
+static int mxc_nand_read_page(struct mtd_info *mtd, struct nand_chip *chip,
+			      uint8_t *buf, int page)
+{
+	struct mxc_nand_host *host = chip->priv;
+	int stat;
+
+	stat = chip->ecc.correct(mtd, buf, NULL, NULL);
+	if (stat < 0)
+		mtd->ecc_stats.failed++;
+	else
+		mtd->ecc_stats.corrected += stat;
+
+	memcpy(buf, host->main_area0, mtd->writesize);
+	copy_spare(mtd, chip->oob_poi, true);
+
+	return 0;
+}
+
+/*
+ * Hardware ECC page write, fills the NFC buffer directly from the
+ * caller's buffer. The ECC bytes are generated by the NFC on PAGEPROG.
+ */
+static void mxc_nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
+				const uint8_t *buf)
+{
+	struct mxc_nand_host *host = chip->priv;
+
+	memcpy(host->main_area0, buf, mtd->writesize);
+	copy_spare(mtd, chip->oob_poi, false);
+
+	host->page_loaded = true;
+}
+
 static u_char mxc_nand_read_byte(struct mtd_info *mtd)
 {
 	struct nand_chip *nand_chip = mtd->priv;
@@ -617,6 +729,7 @@ static u_char mxc_nand_read_byte(struct mtd_info *mtd)
 	if (host->status_request)
 		return host->get_dev_status(host) & 0xFF;
 
+	mxc_nand_sync_buf(mtd, host->buf_start, 1);
 	ret = *(uint8_t *)(host->data_buf + host->buf_start);
 	host->buf_start++;
 
@@ -629,6 +742,7 @@ static uint16_t mxc_nand_read_word(struct mtd_info *mtd)
 	struct mxc_nand_host *host = nand_chip->priv;
 	uint16_t ret;
 
+	mxc_nand_sync_buf(mtd, host->buf_start, 2);
 	ret = *(uint16_t *)(host->data_buf + host->buf_start);
 	host->buf_start += 2;
 
@@ -666,6 +780,7 @@ static void mxc_nand_read_buf(struct mtd_info *mtd, u_char *buf, int len)
 
 	n = min(n, len);
 
+	mxc_nand_sync_buf(mtd, col, n);
 	memcpy(buf, host->data_buf + col, n);
 
 	host->buf_start += n;
@@ -679,6 +794,21 @@ static int mxc_nand_verify_buf(struct mtd_info *mtd,
 	return -EFAULT;
 }
 
+/*
+ * Leave read cache mode. The page the chip is fetching is dropped.
+ */
+static void mxc_nand_cache_end(struct mtd_info *mtd)
+{
+	struct nand_chip *nand_chip = mtd->priv;
+	struct mxc_nand_host *host = nand_chip->priv;
+
+	if (host->cache_page < 0)
+		return;
+
+	host->send_cmd(host, NAND_CMD_READCACHEEND, true);
+	host->cache_page = -1;
+}
+
 /* This function is used by upper layer for select and
  * deselect of the NAND chip */
 static void mxc_nand_select_chip(struct mtd_info *mtd, int chip)
@@ -687,6 +817,8 @@ static void mxc_nand_select_chip(struct mtd_info *mtd, int chip)
 	struct mxc_nand_host *host = nand_chip->priv;
 
 	if (chip == -1) {
+		mxc_nand_cache_end(mtd);
+
 		/* Disable the NFC clock */
 		if (host->clk_act) {
 			clk_disable(host->clk);
@@ -702,41 +834,13 @@ static void mxc_nand_select_chip(struct mtd_info *mtd, int chip)
 	}
 
 	if (nfc_is_v21()) {
+		if (host->active_cs != chip)
+			host->last_page = -1;
 		host->active_cs = chip;
 		writew(host->active_cs << 4, NFC_V1_V2_BUF_ADDR);
 	}
 }
 
-/*
- * Function to transfer data to/from spare area.
- */
-static void copy_spare(struct mtd_info *mtd, bool bfrom)
-{
-	struct nand_chip *this = mtd->priv;
-	struct mxc_nand_host *host = this->priv;
-	u16 i, j;
-	u16 n = mtd->writesize >> 9;
-	u8 *d = host->data_buf + mtd->writesize;
-	u8 *s = host->spare0;
-	u16 t = host->spare_len;
-
-	j = (mtd->oobsize / n >> 1) << 1;
-
-	if (bfrom) {
-		for (i = 0; i < n - 1; i++)
-			memcpy(d + i * j, s + i * t, j);
-
-		/* the last section */
-		memcpy(d + i * j, s + i * t, mtd->oobsize - i * j);
-	} else {
-		for (i = 0; i < n - 1; i++)
-			memcpy(&s[i * t], &d[i * j], j);
-
-		/* the last section */
-		memcpy(&s[i * t], &d[i * j], mtd->oobsize - i * j);
-	}
-}
-
 static void mxc_do_addr_cycle(struct mtd_info *mtd, int column, int page_addr)
 {
 	struct nand_chip *nand_chip = mtd->priv;
@@ -919,6 +1023,49 @@ static void preset_v3(struct mtd_info *mtd)
 	writel(0, NFC_V3_DELAY_LINE);
 }
 
+/*
+ * Load a page into the chip's page register. Sequential reads switch
+ * to read cache mode, which ends at the last page of a block because
+ * the chip would not continue into the next one on its own.
+ */
+static void mxc_nand_load_page(struct mtd_info *mtd, int column, int page_addr)
+{
+	struct nand_chip *nand_chip = mtd->priv;
+	struct mxc_nand_host *host = nand_chip->priv;
+	int last_in_block = 1;
+
+	if (host->cache_read)
+		last_in_block = !((page_addr + 1) &
+				  (mtd->erasesize / mtd->writesize - 1));
+
+	if (host->cache_page == page_addr) {
+		/* the chip is already fetching this page */
+		if (last_in_block) {
+			host->send_cmd(host, NAND_CMD_READCACHEEND, true);
+			host->cache_page = -1;
+		} else {
+			host->send_cmd(host, NAND_CMD_READCACHESEQ, true);
+			host->cache_page = page_addr + 1;
+		}
+	} else {
+		mxc_nand_cache_end(mtd);
+
+		host->send_cmd(host, NAND_CMD_READ0, false);
+		mxc_do_addr_cycle(mtd, column, page_addr);
+
+		if (mtd->writesize > 512)
+			host->send_cmd(host, NAND_CMD_READSTART, true);
+
+		if (host->cache_read && page_addr == host->last_page + 1 &&
+				!last_in_block) {
+			host->send_cmd(host, NAND_CMD_READCACHESEQ, true);
+			host->cache_page = page_addr + 1;
+		}
+	}
+
+	host->last_page = page_addr;
+}
+
 /* Used by the upper layer to write command to NAND Flash for
  * different operations to be carried out on NAND Flash */
 static void mxc_nand_command(struct mtd_info *mtd, unsigned command,
@@ -926,6 +1073,7 @@ static void mxc_nand_command(struct mtd_info *mtd, unsigned command,
 {
 	struct nand_chip *nand_chip = mtd->priv;
 	struct mxc_nand_host *host = nand_chip->priv;
+	bool page_loaded = host->page_loaded;
 
 	pr_debug("mxc_nand_command (cmd = 0x%x, col = 0x%x, page = 0x%x)\n",
 	      command, column, page_addr);
@@ -933,6 +1081,20 @@ static void mxc_nand_command(struct mtd_info *mtd, unsigned command,
 	/* Reset command state information */
 	host->status_request = false;
 
+	/* status and random data out keep the NFC buffer intact */
+	if (command != NAND_CMD_STATUS && command != NAND_CMD_RNDOUT) {
+		host->main_pending = false;
+		host->spare_pending = false;
+		host->page_loaded = false;
+	}
+
+	/* anything but another page read ends a read cache sequence */
+	if (command != NAND_CMD_READ0 && command != NAND_CMD_READOOB &&
+	    command != NAND_CMD_STATUS && command != NAND_CMD_RNDOUT) {
+		mxc_nand_cache_end(mtd);
+		host->last_page = -1;
+	}
+
 	/* Command pre-processing step */
 	switch (command) {
 	case NAND_CMD_RESET:
@@ -955,24 +1117,22 @@ static void mxc_nand_command(struct mtd_info *mtd, unsigned command,
 		else
 			host->buf_start = column + mtd->writesize;
 
-		command = NAND_CMD_READ0; /* only READ0 is valid */
-
-		host->send_cmd(host, command, false);
-		mxc_do_addr_cycle(mtd, column, page_addr);
-
-		if (mtd->writesize > 512)
-			host->send_cmd(host, NAND_CMD_READSTART, true);
+		mxc_nand_load_page(mtd, column, page_addr);
 
 		host->send_page(mtd, NFC_OUTPUT);
 
-		memcpy(host->data_buf, host->main_area0, mtd->writesize);
-		copy_spare(mtd, true);
+		host->main_pending = true;
+		host->spare_pending = true;
 		break;
 
 	case NAND_CMD_SEQIN:
-		if (column >= mtd->writesize)
+		if (column >= mtd->writesize) {
 			/* call ourself to read a page */
 			mxc_nand_command(mtd, NAND_CMD_READ0, 0, page_addr);
+			mxc_nand_sync_buf(mtd, 0, mtd->writesize + mtd->oobsize);
+			mxc_nand_cache_end(mtd);
+			host->last_page = -1;
+		}
 
 		host->buf_start = column;
 
@@ -981,8 +1141,10 @@ static void mxc_nand_command(struct mtd_info *mtd, unsigned command,
 		break;
 
 	case NAND_CMD_PAGEPROG:
-		memcpy(host->main_area0, host->data_buf, mtd->writesize);
-		copy_spare(mtd, false);
+		if (!page_loaded) {
+			memcpy(host->main_area0, host->data_buf, mtd->writesize);
+			copy_spare(mtd, host->data_buf + mtd->writesize, false);
+		}
 		host->send_page(mtd, NFC_INPUT);
 		host->send_cmd(host, command, true);
 		mxc_do_addr_cycle(mtd, column, page_addr);
@@ -1160,6 +1322,8 @@ static int __init mxcnd_probe(struct platform_device *pdev)
 			this->ecc.correct = mxc_nand_correct_data_v1;
 		else
 			this->ecc.correct = mxc_nand_correct_data_v2_v3;
+		this->ecc.read_page = mxc_nand_read_page;
+		this->ecc.write_page = mxc_nand_write_page;
 		this->ecc.mode = NAND_ECC_HW;
 	} else {
 		this->ecc.mode = NAND_ECC_SOFT;
@@ -1178,6 +1342,9 @@ static int __init mxcnd_probe(struct platform_device *pdev)
 
 	init_completion(&host->op_completion);
 
+	host->last_page = -1;
+	host->cache_page = -1;
+
 	host->irq = platform_get_irq(pdev, 0);
 
 	/*
@@ -1213,6 +1380,10 @@ static int __init mxcnd_probe(struct platform_device *pdev)
 	/* Call preset again, with correct writesize this time */
 	host->preset(mtd);
 
+	/* read cache is only implemented for the v2 large page path */
+	host->cache_read = pdata->cache_read && nfc_is_v21() &&
+				mtd->writesize > 512;
+
 	if (mtd->writesize == 2048)
 		this->ecc.layout = oob_largepage;
 	if (nfc_is_v21() && mtd->writesize == 4096)
@@ -26,8 +26,10 @@
 #include <linux/clk.h>
 #include <linux/delay.h>
 #include <linux/device.h>
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
+#include <linux/kfifo.h>
 #include <linux/platform_device.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
@@ -69,6 +71,42 @@ static struct imx_adc_data *adc_data;
 static DEFINE_SEMAPHORE(general_convert_mutex);
 static DEFINE_SEMAPHORE(ts_convert_mutex);
 
+/* protects TCQMR against the interrupt handler */
+static DEFINE_SPINLOCK(tcqmr_lock);
+
+/* upper bound for one pass of the touch screen queue */
+#define TS_EOQ_TIMEOUT_MS	20
+
+/* upper bound for a general queue pass to finish when a stream stops */
+#define GCQ_STOP_TIMEOUT_US	2000
+/* entries of the general queue FIFO */
+#define GCQ_FIFO_DEPTH		16
+
+/* general purpose channels available for streaming */
+#define IMX_ADC_STREAM_CHANNELS	3
+#define IMX_ADC_STREAM_MAX_RATE	10000
+/* must be a power of two */
+#define IMX_ADC_STREAM_BUF_SIZE	8192
+
+/*
+ * Timer triggered scans of the general convert queue. The timer starts
+ * a queue pass, the end of queue interrupt moves the results into the
+ * fifo, read() and poll() consume them.
+ */
+struct imx_adc_stream {
+	struct hrtimer timer;
+	ktime_t period;
+	struct kfifo fifo;
+	wait_queue_head_t wait;
+	struct mutex lock;
+	struct file *owner;
+	unsigned int nchan;
+	unsigned int overruns;
+	bool running;
+};
+
+static struct imx_adc_stream adc_stream;
+
 unsigned long tsc_base;
 
 int is_imx_adc_ready(void)
@@ -182,6 +220,7 @@ void imx_tsc_init(void)
 	__raw_writel(reg, tsc_base + TCQCR);
 	reg = __raw_readl(tsc_base + TCQMR);
 	reg &= ~TCQMR_PD_IRQ_MSK;
+	reg |= TCQMR_EOQ_IRQ_MSK;
 	__raw_writel(reg, tsc_base + TCQMR);
 
 	/* Debounce time = dbtime*8 adc clock cycles */
@@ -198,11 +237,46 @@ void imx_tsc_init(void)
 	__raw_writel(reg, tsc_base + TGCR);
 }
 
-static irqreturn_t imx_adc_interrupt(int irq, void *dev_id)
+static void imx_adc_stream_eoq(void)
 {
+	unsigned short scan[IMX_ADC_STREAM_CHANNELS];
 	unsigned long reg;
+	unsigned int n = 0;
 
-	if (__raw_readl(tsc_base + TGSR) & 0x4) {
+	/* stop the pass and acknowledge it */
+	reg = __raw_readl(tsc_base + GCQCR);
+	reg &= ~CQCR_FQS;
+	__raw_writel(reg, tsc_base + GCQCR);
+	reg = __raw_readl(tsc_base + GCQSR);
+	reg |= CQSR_EOQ;
+	__raw_writel(reg, tsc_base + GCQSR);
+
+	while (!(__raw_readl(tsc_base + GCQSR) & CQSR_EMPT)) {
+		reg = __raw_readl(tsc_base + GCQFIFO) >> GCQFIFO_ADCOUT_SHIFT;
+		if (n < ARRAY_SIZE(scan))
+			scan[n] = reg;
+		n++;
+	}
+
+	if (n != adc_stream.nchan ||
+	    kfifo_avail(&adc_stream.fifo) < n * sizeof(scan[0])) {
+		adc_stream.overruns++;
+		return;
+	}
+	kfifo_in(&adc_stream.fifo, scan, n * sizeof(scan[0]));
+	wake_up_interruptible(&adc_stream.wait);
+}
+
+static irqreturn_t imx_adc_interrupt(int irq, void *dev_id)
+{
+	unsigned long reg, tcqsr;
+
+	if (adc_stream.running && (__raw_readl(tsc_base + TGSR) & GCQ_INT)) {
+		if (__raw_readl(tsc_base + GCQSR) & CQSR_EOQ)
+			imx_adc_stream_eoq();
+	}
+
+	if (__raw_readl(tsc_base + TGSR) & SLP_INT) {
 		/* deep sleep wakeup interrupt */
 		/* clear tgsr */
 		__raw_writel(0,  tsc_base + TGSR);
@@ -214,23 +288,64 @@ static irqreturn_t imx_adc_interrupt(int irq, void *dev_id)
 		reg = __raw_readl(tsc_base + TCQCR);
 		reg &= ~CQCR_PD_MSK;
 		__raw_writel(reg, tsc_base + TCQCR);
+		spin_lock(&tcqmr_lock);
 		reg = __raw_readl(tsc_base + TCQMR);
 		reg &= ~TCQMR_PD_IRQ_MSK;
 		__raw_writel(reg, tsc_base + TCQMR);
-	} else if ((__raw_readl(tsc_base + TGSR) & 0x1) &&
-		   (__raw_readl(tsc_base + TCQSR) & 0x1)) {
+		spin_unlock(&tcqmr_lock);
+	} else if (__raw_readl(tsc_base + TGSR) & TCQ_INT) {
+		tcqsr = __raw_readl(tsc_base + TCQSR);
 
-		/* mask pen down detect irq */
+		spin_lock(&tcqmr_lock);
 		reg = __raw_readl(tsc_base + TCQMR);
-		reg |= TCQMR_PD_IRQ_MSK;
+		/* mask pen down detect irq */
+		if (tcqsr & CQSR_PD) {
+			reg |= TCQMR_PD_IRQ_MSK;
+			ts_data_ready = 1;
+		}
+		/* the waiter clears EOQ, keep it from firing until then */
+		if (tcqsr & CQSR_EOQ)
+			reg |= TCQMR_EOQ_IRQ_MSK;
 		__raw_writel(reg, tsc_base + TCQMR);
+		spin_unlock(&tcqmr_lock);
 
-		ts_data_ready = 1;
-		wake_up_interruptible(&tsq);
+		wake_up(&tsq);
 	}
 	return IRQ_HANDLED;
 }
 
+static void imx_adc_tcqmr_modify(unsigned long clear, unsigned long set)
+{
+	unsigned long reg, flags;
+
+	spin_lock_irqsave(&tcqmr_lock, flags);
+	reg = __raw_readl(tsc_base + TCQMR);
+	reg &= ~clear;
+	reg |= set;
+	__raw_writel(reg, tsc_base + TCQMR);
+	spin_unlock_irqrestore(&tcqmr_lock, flags);
+}
+
+/*!
+ * This function sleeps until the touch screen queue has finished its
+ * conversions. The EOQ interrupt is only unmasked for the duration of
+ * the wait.
+ *
+ * @return       This function returns 0 on success, -ETIMEDOUT otherwise.
+ */
+static int imx_adc_wait_ts_eoq(void)
+{
+	long ret;
+
+	imx_adc_tcqmr_modify(TCQMR_EOQ_IRQ_MSK, 0);
+	ret = wait_event_timeout(tsq,
+				 __raw_readl(tsc_base + TCQSR) & CQSR_EOQ,
+				 msecs_to_jiffies(TS_EOQ_TIMEOUT_MS));
+	imx_adc_tcqmr_modify(0, TCQMR_EOQ_IRQ_MSK);
+
+	return ret ? 0 : -ETIMEDOUT;
+}
+
 enum IMX_ADC_STATUS imx_adc_read_general(unsigned short *result)
 {
 	unsigned long reg;
@@ -257,6 +372,136 @@ enum IMX_ADC_STATUS imx_adc_read_general(unsigned short *result)
 	return IMX_ADC_SUCCESS;
 }
 
+static enum hrtimer_restart imx_adc_stream_timer(struct hrtimer *timer)
+{
+	unsigned long reg;
+
+	reg = __raw_readl(tsc_base + GCQCR);
+	if (reg & CQCR_FQS) {
+		/* the previous pass has not finished yet */
+		adc_stream.overruns++;
+	} else {
+		reg |= CQCR_FQS;
+		__raw_writel(reg, tsc_base + GCQCR);
+	}
+
+	hrtimer_forward_now(timer, adc_stream.period);
+	return HRTIMER_RESTART;
+}
+
+/*!
+ * This function starts timer triggered scans of the general purpose
+ * channels. The general convert queue stays reserved until the scans
+ * are stopped.
+ *
+ * @param        file      the file that owns the scans
+ * @param        param     channels and rate
+ *
+ * @return       This function returns 0 if successful.
+ */
+static int imx_adc_stream_start(struct file *file,
+				struct t_adc_stream_param *param)
+{
+	static const unsigned long gcc[IMX_ADC_STREAM_CHANNELS] = {
+		TSC_GENERAL_ADC_GCC0,
+		TSC_GENERAL_ADC_GCC1,
+		TSC_GENERAL_ADC_GCC2,
+	};
+	unsigned long reg, items = 0;
+	unsigned int ch, n = 0;
+	int ret = 0;
+
+	if (!param->channels ||
+	    param->channels & ~((1 << IMX_ADC_STREAM_CHANNELS) - 1))
+		return -EINVAL;
+	if (!param->rate || param->rate > IMX_ADC_STREAM_MAX_RATE)
+		return -EINVAL;
+
+	mutex_lock(&adc_stream.lock);
+	if (adc_stream.running || down_trylock(&general_convert_mutex)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	/* one sample per channel, queue item n converts with GCCn */
+	for (ch = 0; ch < IMX_ADC_STREAM_CHANNELS; ch++) {
+		if (!(param->channels & (1 << ch)))
+			continue;
+		reg = gcc[ch] | (16 << CC_SETTLING_TIME_SHIFT);
+		__raw_writel(reg, tsc_base + GCC0 + n * 4);
+		items |= (GCQ_ITEM_GCC0 + n) << (n * GCQ_ITEM1_SHIFT);
+		n++;
+	}
+	__raw_writel(items, tsc_base + GCQ_ITEM_7_0);
+
+	reg = (0xf << CQCR_FIFOWATERMARK_SHIFT) |
+	      ((n - 1) << CQCR_LAST_ITEM_ID_SHIFT) | CQCR_QSM_FQS;
+	__raw_writel(reg, tsc_base + GCQCR);
+
+	kfifo_reset(&adc_stream.fifo);
+	adc_stream.nchan = n;
+	adc_stream.overruns = 0;
+	adc_stream.owner = file;
+	adc_stream.period = ns_to_ktime(NSEC_PER_SEC / param->rate);
+	adc_stream.running = true;
+
+	reg = __raw_readl(tsc_base + GCQMR);
+	reg &= ~GCQMR_EOQ_IRQ_MSK;
+	__raw_writel(reg, tsc_base + GCQMR);
+
+	hrtimer_start(&adc_stream.timer, adc_stream.period, HRTIMER_MODE_REL);
+out:
+	mutex_unlock(&adc_stream.lock);
+	return ret;
+}
+
+/*!
+ * This function stops the scans and releases the general convert queue.
+ * Samples still in the buffer remain readable.
+ */
+static void imx_adc_stream_stop(void)
+{
+	unsigned long reg;
+	int i;
+
+	mutex_lock(&adc_stream.lock);
+	if (!adc_stream.running)
+		goto out;
+
+	hrtimer_cancel(&adc_stream.timer);
+
+	reg = __raw_readl(tsc_base + GCQMR);
+	reg |= GCQMR_EOQ_IRQ_MSK;
+	__raw_writel(reg, tsc_base + GCQMR);
+
+	/* let a pass in flight finish, then discard it */
+	for (i = 0; i < GCQ_STOP_TIMEOUT_US / 10; i++) {
+		if (!(__raw_readl(tsc_base + GCQCR) & CQCR_FQS) ||
+		    __raw_readl(tsc_base + GCQSR) & CQSR_EOQ)
+			break;
+		udelay(10);
+	}
+	if (i == GCQ_STOP_TIMEOUT_US / 10)
+		pr_warning("imx_adc: general queue did not finish, "
+			   "forcing it to stop\n");
+	reg = __raw_readl(tsc_base + GCQCR);
+	reg &= ~CQCR_FQS;
+	__raw_writel(reg, tsc_base + GCQCR);
+	reg = __raw_readl(tsc_base + GCQSR);
+	reg |= CQSR_EOQ;
+	__raw_writel(reg, tsc_base + GCQSR);
+	for (i = 0; i < GCQ_FIFO_DEPTH &&
+	     !(__raw_readl(tsc_base + GCQSR) & CQSR_EMPT); i++)
+		__raw_readl(tsc_base + GCQFIFO);
+
+	adc_stream.running = false;
+	adc_stream.owner = NULL;
+	up(&general_convert_mutex);
+	wake_up_interruptible(&adc_stream.wait);
+out:
+	mutex_unlock(&adc_stream.lock);
+}
+
 /*!
  * This function will get raw (X,Y) value by converting the voltage
  * @param        touch_sample Pointer to touch sample
@@ -271,6 +516,7 @@ enum IMX_ADC_STATUS imx_adc_read_ts(struct t_touch_screen *touch_sample,
 	unsigned long reg;
 	int data_num = 0;
 	int detect_sample1, detect_sample2;
+	int timeout;
 
 	memset(ts_data_buf, 0, sizeof ts_data_buf);
 	touch_sample->valid_flag = 1;
@@ -287,13 +533,12 @@ enum IMX_ADC_STATUS imx_adc_read_ts(struct t_touch_screen *touch_sample,
 		__raw_writel(reg, tsc_base + TCQCR);
 
 		/* unmask pen down detect irq */
-		reg = __raw_readl(tsc_base + TCQMR);
-		reg &= ~TCQMR_PD_IRQ_MSK;
-		__raw_writel(reg, tsc_base + TCQMR);
+		imx_adc_tcqmr_modify(TCQMR_PD_IRQ_MSK, 0);
 
-		wait_event_interruptible(tsq, ts_data_ready);
-		while (!(__raw_readl(tsc_base + TCQSR) & CQSR_EOQ))
-			continue;
+		/* no conversions and no wake-ups until the pen touches */
+		if (wait_event_interruptible(tsq, ts_data_ready))
+			return IMX_ADC_ERROR;
+		timeout = imx_adc_wait_ts_eoq();
 
 		/* stop the conversion */
 		reg = __raw_readl(tsc_base + TCQCR);
@@ -323,8 +568,7 @@ enum IMX_ADC_STATUS imx_adc_read_ts(struct t_touch_screen *touch_sample,
 		reg = __raw_readl(tsc_base + TCQCR);
 		reg |= CQCR_FQS;
 		__raw_writel(reg, tsc_base + TCQCR);
-		while (!(__raw_readl(tsc_base + TCQSR) & CQSR_EOQ))
-			continue;
+		timeout = imx_adc_wait_ts_eoq();
 
 		/* stop FQS */
 		reg = __raw_readl(tsc_base + TCQCR);
@@ -376,6 +620,10 @@ enum IMX_ADC_STATUS imx_adc_read_ts(struct t_touch_screen *touch_sample,
 
 	if (tsi_data == FQS_DATA)
 		up(&ts_convert_mutex);
+	if (timeout) {
+		pr_debug("imx_adc_read_ts: conversion timed out\n");
+		return IMX_ADC_ERROR;
+	}
 	return IMX_ADC_SUCCESS;
 }
 
@@ -606,6 +854,10 @@ static int imx_adc_suspend(struct platform_device *pdev, pm_message_t state)
 {
 	unsigned long reg;
 
+	/* scans resume with the device, the buffer is kept */
+	if (adc_stream.running)
+		hrtimer_cancel(&adc_stream.timer);
+
 	/* Config idle for 4-wire */
 	reg = TSC_4WIRE_PRECHARGE;
 	__raw_writel(reg, tsc_base + TICR);
@@ -668,6 +920,15 @@ static int imx_adc_resume(struct platform_device *pdev)
 	reg |= TGCR_POWER_SAVE;
 	__raw_writel(reg, tsc_base + TGCR);
 
+	if (adc_stream.running) {
+		/* drop a pass interrupted by the suspend */
+		reg = __raw_readl(tsc_base + GCQCR);
+		reg &= ~CQCR_FQS;
+		__raw_writel(reg, tsc_base + GCQCR);
+		hrtimer_start(&adc_stream.timer, adc_stream.period,
+			      HRTIMER_MODE_REL);
+	}
+
 	return 0;
 }
 
@@ -699,10 +960,72 @@ static int imx_adc_open(struct inode *inode, struct file *file)
  */
 static int imx_adc_free(struct inode *inode, struct file *file)
 {
+	if (adc_stream.owner == file)
+		imx_adc_stream_stop();
 	pr_debug("imx_adc : imx_adc_free()\n");
 	return 0;
 }
 
+/*!
+ * This function implements the read method on an i.MX ADC device. It
+ * returns whole scans from the stream buffer, one unsigned short per
+ * scanned channel.
+ *
+ * @param        file        pointer on the file
+ * @param        buf         user buffer
+ * @param        count       size of the user buffer
+ * @param        ppos        file position, unused
+ * @return       This function returns the number of bytes read.
+ */
+static ssize_t imx_adc_read(struct file *file, char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	unsigned int copied, scan;
+	int ret;
+
+	mutex_lock(&adc_stream.lock);
+	scan = adc_stream.nchan * sizeof(unsigned short);
+	while (kfifo_is_empty(&adc_stream.fifo)) {
+		if (!adc_stream.running) {
+			mutex_unlock(&adc_stream.lock);
+			return 0;
+		}
+		mutex_unlock(&adc_stream.lock);
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(adc_stream.wait,
+				!kfifo_is_empty(&adc_stream.fifo) ||
+				!adc_stream.running))
+			return -ERESTARTSYS;
+		mutex_lock(&adc_stream.lock);
+		scan = adc_stream.nchan * sizeof(unsigned short);
+	}
+
+	if (count < scan) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = kfifo_to_user(&adc_stream.fifo, buf, count - count % scan,
+			    &copied);
+	if (!ret)
+		ret = copied;
+out:
+	mutex_unlock(&adc_stream.lock);
+	return ret;
+}
+
+static unsigned int imx_adc_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &adc_stream.wait, wait);
+
+	if (!kfifo_is_empty(&adc_stream.fifo))
+		return POLLIN | POLLRDNORM;
+	/* read() returns 0 once the stream has stopped and drained */
+	if (!adc_stream.running)
+		return POLLIN | POLLRDNORM | POLLHUP;
+	return 0;
+}
+
 /*!
  * This function initializes all ADC registers with default values. This
  * function also registers the interrupt events.
@@ -733,6 +1056,11 @@ int imx_adc_init(void)
 
 	imx_tsc_init();
 
+	/* general queue results are polled unless streaming */
+	reg = __raw_readl(tsc_base + GCQMR);
+	reg |= GCQMR_EOQ_IRQ_MSK;
+	__raw_writel(reg, tsc_base + GCQMR);
+
 	imx_adc_initialized = 1;
 
 	return IMX_ADC_SUCCESS;
@@ -769,6 +1097,10 @@ enum IMX_ADC_STATUS imx_adc_convert(enum t_channel channel,
 	int lastitemid;
 	struct t_touch_screen touch_sample;
 
+	/* the general convert queue is reserved while streaming */
+	if (channel >= GER_PURPOSE_ADC0 && adc_stream.running)
+		return IMX_ADC_ERROR;
+
 	switch (channel) {
 
 	case TS_X_POS:
@@ -782,9 +1114,7 @@ enum IMX_ADC_STATUS imx_adc_convert(enum t_channel channel,
 			reg |= CQCR_QSM_PEN;
 			__raw_writel(reg, tsc_base + TCQCR);
 
-			reg = __raw_readl(tsc_base + TCQMR);
-			reg &= ~TCQMR_PD_IRQ_MSK;
-			__raw_writel(reg, tsc_base + TCQMR);
+			imx_adc_tcqmr_modify(TCQMR_PD_IRQ_MSK, 0);
 		}
 		break;
 
@@ -799,9 +1129,7 @@ enum IMX_ADC_STATUS imx_adc_convert(enum t_channel channel,
 			reg |= CQCR_QSM_PEN;
 			__raw_writel(reg, tsc_base + TCQCR);
 
-			reg = __raw_readl(tsc_base + TCQMR);
-			reg &= ~TCQMR_PD_IRQ_MSK;
-			__raw_writel(reg, tsc_base + TCQMR);
+			imx_adc_tcqmr_modify(TCQMR_PD_IRQ_MSK, 0);
 		}
 		break;
 
@@ -923,6 +1251,8 @@ static long imx_adc_ioctl(struct file *file,
 			 unsigned int cmd, unsigned long arg)
 {
 	struct t_adc_convert_param *convert_param;
+	struct t_adc_stream_param stream_param;
+	struct t_adc_stream_status stream_status;
 
 	if ((_IOC_TYPE(cmd) != 'p') && (_IOC_TYPE(cmd) != 'D'))
 		return -ENOTTY;
@@ -994,6 +1324,28 @@ static long imx_adc_ioctl(struct file *file,
 		kfree(convert_param);
 		break;
 
+	case IMX_ADC_STREAM_START:
+		if (copy_from_user(&stream_param,
+				   (struct t_adc_stream_param *)arg,
+				   sizeof(stream_param)))
+			return -EFAULT;
+		return imx_adc_stream_start(file, &stream_param);
+
+	case IMX_ADC_STREAM_STOP:
+		if (adc_stream.owner != file)
+			return -EPERM;
+		imx_adc_stream_stop();
+		break;
+
+	case IMX_ADC_STREAM_STATUS:
+		stream_status.overruns = adc_stream.overruns;
+		stream_status.pending = kfifo_len(&adc_stream.fifo);
+		stream_status.running = adc_stream.running;
+		if (copy_to_user((struct t_adc_stream_status *)arg,
+				 &stream_status, sizeof(stream_status)))
+			return -EFAULT;
+		break;
+
 	default:
 		pr_debug("imx_adc_ioctl: unsupported ioctl command 0x%x\n",
 			 cmd);
@@ -1005,6 +1357,8 @@ static long imx_adc_ioctl(struct file *file,
 static struct file_operations imx_adc_fops = {
 	.owner = THIS_MODULE,
 	.unlocked_ioctl = imx_adc_ioctl,
+	.read = imx_adc_read,
+	.poll = imx_adc_poll,
 	.open = imx_adc_open,
 	.release = imx_adc_free,
 };
@@ -1030,12 +1384,22 @@ static int imx_adc_module_probe(struct platform_device *pdev)
 	}
 	tsc_base = (unsigned long)base;
 
+	ret = kfifo_alloc(&adc_stream.fifo, IMX_ADC_STREAM_BUF_SIZE,
+			  GFP_KERNEL);
+	if (ret)
+		goto err_out0;
+	init_waitqueue_head(&adc_stream.wait);
+	mutex_init(&adc_stream.lock);
+	hrtimer_init(&adc_stream.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	adc_stream.timer.function = imx_adc_stream_timer;
+
 	/* create the chrdev */
 	imx_adc_major = register_chrdev(0, "imx_adc", &imx_adc_fops);
 
 	if (imx_adc_major < 0) {
 		dev_err(&pdev->dev, "Unable to get a major for imx_adc\n");
-		return imx_adc_major;
+		ret = imx_adc_major;
+		goto err_out0;
 	}
 	init_waitqueue_head(&suspendq);
 	init_waitqueue_head(&tsq);
@@ -1089,6 +1453,7 @@ err_out2:
 err_out1:
 	unregister_chrdev(imx_adc_major, "imx_adc");
 err_out0:
+	kfifo_free(&adc_stream.fifo);
 	return ret;
 }
 
@@ -1101,6 +1466,7 @@ static int imx_adc_module_remove(struct platform_device *pdev)
 	unregister_chrdev(imx_adc_major, "imx_adc");
 	free_irq(adc_data->irq, MOD_NAME);
 	kfree(adc_data);
+	kfifo_free(&adc_stream.fifo);
 	pr_debug("i.MX ADC successfully removed\n");
 	return 0;
 }
@@ -204,6 +204,7 @@
 #define GCQSR                  0x808
 /* GeneralADC Convert Queue Mask Register */
 #define GCQMR                  0x80c
+#define GCQMR_EOQ_IRQ_MSK      (1 << 1)
 
 /* GeneralADC Convert Queue ITEM 7~0 */
 #define GCQ_ITEM_7_0           0x820
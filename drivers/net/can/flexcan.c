@@ -35,11 +35,15 @@
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
+#include <linux/rtnetlink.h>
+#include <linux/string.h>
 
 #define DRV_NAME			"flexcan"
 
 /* 8 for RX fifo and 2 error handling */
 #define FLEXCAN_NAPI_WEIGHT		(8 + 2)
+/* 32 from the RX ring in mailbox mode and 2 error handling */
+#define FLEXCAN_NAPI_WEIGHT_MB		(32 + 2)
 
 /* FLEXCAN module configuration register (CANMCR) bits */
 #define FLEXCAN_MCR_MDIS		BIT(31)
@@ -60,7 +64,7 @@
 #define FLEXCAN_MCR_BCC			BIT(16)
 #define FLEXCAN_MCR_LPRIO_EN		BIT(13)
 #define FLEXCAN_MCR_AEN			BIT(12)
-#define FLEXCAN_MCR_MAXMB(x)		((x) & 0x1f)
+#define FLEXCAN_MCR_MAXMB(x)		((x) & 0x3f)
 #define FLEXCAN_MCR_IDAM_A		(0 << 8)
 #define FLEXCAN_MCR_IDAM_B		(1 << 8)
 #define FLEXCAN_MCR_IDAM_C		(2 << 8)
@@ -123,13 +127,25 @@
 /* Errata ERR005829 step7: Reserve first valid MB */
 #define FLEXCAN_TX_BUF_RESERVED		8
 #define FLEXCAN_TX_BUF_ID		9
+/* TX mailboxes are FLEXCAN_TX_BUF_ID onwards, all in IFLAG1 */
+#define FLEXCAN_TX_BUF_MAX		(32 - FLEXCAN_TX_BUF_ID)
+/* mailbox RX mode: first valid MB is 0, RX uses all MBs after TX */
+#define FLEXCAN_MB_TX_BUF_RESERVED	0
+#define FLEXCAN_MB_NUM			64
+#define FLEXCAN_RX_RING_SIZE		128	/* power of 2 */
+
+/* RX FIFO ID filter table, format A, one element per filter */
+#define FLEXCAN_FIFO_FILTER_NUM		8
+#define FLEXCAN_FIFO_FILTER_RTR		BIT(31)
+#define FLEXCAN_FIFO_FILTER_IDE		BIT(30)
+#define FLEXCAN_FIFO_FILTER_STD(x)	(((x) & CAN_SFF_MASK) << 19)
+#define FLEXCAN_FIFO_FILTER_EXT(x)	(((x) & CAN_EFF_MASK) << 1)
 #define FLEXCAN_IFLAG_BUF(x)		BIT(x)
 #define FLEXCAN_IFLAG_RX_FIFO_OVERFLOW	BIT(7)
 #define FLEXCAN_IFLAG_RX_FIFO_WARN	BIT(6)
 #define FLEXCAN_IFLAG_RX_FIFO_AVAILABLE	BIT(5)
 #define FLEXCAN_IFLAG_DEFAULT \
-	(FLEXCAN_IFLAG_RX_FIFO_OVERFLOW | FLEXCAN_IFLAG_RX_FIFO_AVAILABLE | \
-	 FLEXCAN_IFLAG_BUF(FLEXCAN_TX_BUF_ID))
+	(FLEXCAN_IFLAG_RX_FIFO_OVERFLOW | FLEXCAN_IFLAG_RX_FIFO_AVAILABLE)
 
 /* FLEXCAN message buffers */
 #define FLEXCAN_MB_CNT_CODE(x)		(((x) & 0xf) << 24)
@@ -149,8 +165,11 @@
 #define FLEXCAN_MB_CNT_RTR		BIT(20)
 #define FLEXCAN_MB_CNT_LENGTH(x)	(((x) & 0xf) << 16)
 #define FLEXCAN_MB_CNT_TIMESTAMP(x)	((x) & 0xffff)
+/* an RX mailbox only takes frames of the format its IDE bit selects */
+#define FLEXCAN_MB_RX_EFF		(FLEXCAN_MB_CNT_IDE | FLEXCAN_MB_CNT_SRR)
 
 #define FLEXCAN_MB_CODE_MASK		(0xf0ffffff)
+#define FLEXCAN_MB_CODE(x)		((x) & (0xf << 24))
 
 /* Structure of the message buffer */
 struct flexcan_mb {
@@ -176,6 +195,8 @@ struct flexcan_regs {
 	u32 iflag1;		/* 0x30 */
 	u32 _reserved2[19];
 	struct flexcan_mb cantxfg[64];
+	u32 _reserved3[256];	/* 0x480 */
+	u32 rximr[64];		/* 0x880 */
 };
 
 struct flexcan_priv {
@@ -186,11 +207,61 @@ struct flexcan_priv {
 	void __iomem *base;
 	u32 reg_esr;
 	u32 reg_ctrl_default;
+	u32 reg_imask1_default;
+
+	/*
+	 * TX mailbox pool. The core sends the lowest active mailbox
+	 * first (FLEXCAN_CTRL_LBUF), so mailboxes are filled in
+	 * ascending order and tx_next only goes back to the first one
+	 * once all of them have been sent. This keeps frames on the wire
+	 * in the order they were queued.
+	 */
+	spinlock_t tx_lock;
+	unsigned int tx_num;
+	unsigned int tx_next;
+	unsigned int tx_reserved;
+	u32 tx_mask;
+	u32 tx_pending;
+
+	/*
+	 * Mailbox RX mode: instead of the RX FIFO all mailboxes from
+	 * rx_first on receive. The interrupt handler empties them into
+	 * rx_ring, sorted by their receive timestamp, and NAPI feeds the
+	 * stack from the ring. rx_batch is scratch space for sorting.
+	 */
+	bool rx_mb;
+	unsigned int rx_first;
+	u32 rx_mask1;
+	u32 rx_mask2;
+	unsigned int rx_head;
+	unsigned int rx_tail;
+	struct can_frame rx_ring[FLEXCAN_RX_RING_SIZE];
+	struct {
+		struct can_frame cf;
+		u16 stamp;
+	} rx_batch[FLEXCAN_MB_NUM];
+
+	/*
+	 * Hardware acceptance filters set through sysfs, in CAN_RAW
+	 * can_filter notation. None means accept everything.
+	 */
+	unsigned int filter_num;
+	struct can_filter filter[FLEXCAN_FIFO_FILTER_NUM];
 
 	struct clk *clk;
 	struct flexcan_platform_data *pdata;
 };
 
+static unsigned int tx_mailboxes = 8;
+module_param(tx_mailboxes, uint, S_IRUGO);
+MODULE_PARM_DESC(tx_mailboxes, "Number of TX mailboxes used in FIFO order "
+		 "(1-" __stringify(FLEXCAN_TX_BUF_MAX) ", default 8)");
+
+static bool rx_mailboxes;
+module_param(rx_mailboxes, bool, S_IRUGO);
+MODULE_PARM_DESC(rx_mailboxes, "Receive through all free mailboxes and a "
+		 "timestamp sorted ring instead of the 6 frame RX FIFO");
+
 static struct can_bittiming_const flexcan_bittiming_const = {
 	.name = DRV_NAME,
 	.tseg1_min = 4,
@@ -281,17 +352,26 @@ static int flexcan_get_berr_counter(const struct net_device *dev,
 
 static int flexcan_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
-	const struct flexcan_priv *priv = netdev_priv(dev);
+	struct flexcan_priv *priv = netdev_priv(dev);
 	struct net_device_stats *stats = &dev->stats;
 	struct flexcan_regs __iomem *regs = priv->base;
 	struct can_frame *cf = (struct can_frame *)skb->data;
+	struct flexcan_mb __iomem *mb;
+	unsigned long flags;
 	u32 can_id;
 	u32 ctrl = FLEXCAN_MB_CNT_CODE(0xc) | (cf->can_dlc << 16);
 
 	if (can_dropped_invalid_skb(dev, skb))
 		return NETDEV_TX_OK;
 
-	netif_stop_queue(dev);
+	spin_lock_irqsave(&priv->tx_lock, flags);
+
+	mb = &regs->cantxfg[FLEXCAN_TX_BUF_ID + priv->tx_next];
+	priv->tx_pending |= FLEXCAN_IFLAG_BUF(FLEXCAN_TX_BUF_ID + priv->tx_next);
+
+	/* last mailbox used, wait until the whole pool has been sent */
+	if (++priv->tx_next == priv->tx_num)
+		netif_stop_queue(dev);
 
 	if (cf->can_id & CAN_EFF_FLAG) {
 		can_id = cf->can_id & CAN_EFF_MASK;
@@ -305,23 +385,25 @@ static int flexcan_start_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	if (cf->can_dlc > 0) {
 		u32 data = be32_to_cpup((__be32 *)&cf->data[0]);
-		flexcan_write(data, &regs->cantxfg[FLEXCAN_TX_BUF_ID].data[0]);
+		flexcan_write(data, &mb->data[0]);
 	}
 	if (cf->can_dlc > 3) {
 		u32 data = be32_to_cpup((__be32 *)&cf->data[4]);
-		flexcan_write(data, &regs->cantxfg[FLEXCAN_TX_BUF_ID].data[1]);
+		flexcan_write(data, &mb->data[1]);
 	}
 
-	flexcan_write(can_id, &regs->cantxfg[FLEXCAN_TX_BUF_ID].can_id);
-	flexcan_write(ctrl, &regs->cantxfg[FLEXCAN_TX_BUF_ID].can_ctrl);
+	flexcan_write(can_id, &mb->can_id);
+	flexcan_write(ctrl, &mb->can_ctrl);
 
 	/* Errata ERR005829 step8:
 	 * Write twice INACTIVE(0x8) code to first MB.
 	 */
 	flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
-		      &regs->cantxfg[FLEXCAN_TX_BUF_RESERVED].can_ctrl);
+		      &regs->cantxfg[priv->tx_reserved].can_ctrl);
 	flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
-		      &regs->cantxfg[FLEXCAN_TX_BUF_RESERVED].can_ctrl);
+		      &regs->cantxfg[priv->tx_reserved].can_ctrl);
+
+	spin_unlock_irqrestore(&priv->tx_lock, flags);
 
 	kfree_skb(skb);
 
@@ -501,15 +583,11 @@ static int flexcan_poll_state(struct net_device *dev, u32 reg_esr)
 	return 1;
 }
 
-static void flexcan_read_fifo(const struct net_device *dev,
-			      struct can_frame *cf)
+static void flexcan_read_mb(struct flexcan_mb __iomem *mb, u32 reg_ctrl,
+			    struct can_frame *cf)
 {
-	const struct flexcan_priv *priv = netdev_priv(dev);
-	struct flexcan_regs __iomem *regs = priv->base;
-	struct flexcan_mb __iomem *mb = &regs->cantxfg[0];
-	u32 reg_ctrl, reg_id;
+	u32 reg_id;
 
-	reg_ctrl = flexcan_read(&mb->can_ctrl);
 	reg_id = flexcan_read(&mb->can_id);
 	if (reg_ctrl & FLEXCAN_MB_CNT_IDE)
 		cf->can_id = ((reg_id >> 0) & CAN_EFF_MASK) | CAN_EFF_FLAG;
@@ -522,6 +600,16 @@ static void flexcan_read_fifo(const struct net_device *dev,
 
 	*(__be32 *)(cf->data + 0) = cpu_to_be32(flexcan_read(&mb->data[0]));
 	*(__be32 *)(cf->data + 4) = cpu_to_be32(flexcan_read(&mb->data[1]));
+}
+
+static void flexcan_read_fifo(const struct net_device *dev,
+			      struct can_frame *cf)
+{
+	const struct flexcan_priv *priv = netdev_priv(dev);
+	struct flexcan_regs __iomem *regs = priv->base;
+	struct flexcan_mb __iomem *mb = &regs->cantxfg[0];
+
+	flexcan_read_mb(mb, flexcan_read(&mb->can_ctrl), cf);
 
 	/* mark as read */
 	flexcan_write(FLEXCAN_IFLAG_RX_FIFO_AVAILABLE, &regs->iflag1);
@@ -549,6 +637,106 @@ static int flexcan_read_frame(struct net_device *dev)
 	return 1;
 }
 
+/*
+ * Mailbox RX mode, called from the interrupt handler: empty all RX
+ * mailboxes flagged in iflag1/iflag2 and append them to the RX ring in
+ * the order they were received. The mailboxes are not filled in
+ * arrival order, the core always picks the lowest free one.
+ */
+static void flexcan_rx_mailboxes(struct net_device *dev,
+				 u32 iflag1, u32 iflag2)
+{
+	struct flexcan_priv *priv = netdev_priv(dev);
+	struct net_device_stats *stats = &dev->stats;
+	struct flexcan_regs __iomem *regs = priv->base;
+	int i, j, n = 0;
+
+	for (i = priv->rx_first; i < FLEXCAN_MB_NUM; i++) {
+		struct flexcan_mb __iomem *mb = &regs->cantxfg[i];
+		u32 flag = i < 32 ? iflag1 & BIT(i) : iflag2 & BIT(i - 32);
+		u32 reg_ctrl;
+		u16 stamp;
+
+		if (!flag)
+			continue;
+
+		/* reading the control word locks the mailbox */
+		reg_ctrl = flexcan_read(&mb->can_ctrl);
+		if (FLEXCAN_MB_CODE(reg_ctrl) == FLEXCAN_MB_CODE_RX_OVERRRUN) {
+			stats->rx_over_errors++;
+			stats->rx_errors++;
+		}
+
+		/* insertion sort by timestamp, the timer wraps at 16 bit */
+		stamp = FLEXCAN_MB_CNT_TIMESTAMP(reg_ctrl);
+		for (j = n; j > 0 &&
+			     (s16)(stamp - priv->rx_batch[j - 1].stamp) < 0; j--)
+			priv->rx_batch[j] = priv->rx_batch[j - 1];
+
+		flexcan_read_mb(mb, reg_ctrl, &priv->rx_batch[j].cf);
+		priv->rx_batch[j].stamp = stamp;
+		n++;
+
+		/* hand the mailbox back to the core, for the same format */
+		flexcan_write(FLEXCAN_MB_CODE_RX_EMPTY |
+			      (reg_ctrl & FLEXCAN_MB_CNT_IDE ?
+			       FLEXCAN_MB_RX_EFF : 0), &mb->can_ctrl);
+	}
+
+	/* unlock the last mailbox */
+	flexcan_read(&regs->timer);
+
+	if (iflag1)
+		flexcan_write(iflag1, &regs->iflag1);
+	if (iflag2)
+		flexcan_write(iflag2, &regs->iflag2);
+
+	for (i = 0; i < n; i++) {
+		if (priv->rx_head - ACCESS_ONCE(priv->rx_tail) ==
+		    FLEXCAN_RX_RING_SIZE) {
+			stats->rx_over_errors += n - i;
+			stats->rx_errors += n - i;
+			break;
+		}
+		priv->rx_ring[priv->rx_head & (FLEXCAN_RX_RING_SIZE - 1)] =
+			priv->rx_batch[i].cf;
+		smp_wmb();
+		priv->rx_head++;
+	}
+}
+
+static int flexcan_poll_rx_ring(struct net_device *dev, int quota)
+{
+	struct flexcan_priv *priv = netdev_priv(dev);
+	struct net_device_stats *stats = &dev->stats;
+	struct can_frame *cf;
+	struct sk_buff *skb;
+	int work_done = 0;
+
+	while (priv->rx_tail != ACCESS_ONCE(priv->rx_head) &&
+	       work_done < quota) {
+		smp_rmb();
+
+		skb = alloc_can_skb(dev, &cf);
+		if (likely(skb)) {
+			*cf = priv->rx_ring[priv->rx_tail &
+					    (FLEXCAN_RX_RING_SIZE - 1)];
+			netif_receive_skb(skb);
+
+			stats->rx_packets++;
+			stats->rx_bytes += cf->can_dlc;
+		} else {
+			stats->rx_dropped++;
+		}
+
+		smp_mb();
+		priv->rx_tail++;
+		work_done++;
+	}
+
+	return work_done;
+}
+
 static int flexcan_poll(struct napi_struct *napi, int quota)
 {
 	struct net_device *dev = napi->dev;
@@ -566,12 +754,17 @@ static int flexcan_poll(struct napi_struct *napi, int quota)
 	/* handle state changes */
 	work_done += flexcan_poll_state(dev, reg_esr);
 
-	/* handle RX-FIFO */
-	reg_iflag1 = flexcan_read(&regs->iflag1);
-	while (reg_iflag1 & FLEXCAN_IFLAG_RX_FIFO_AVAILABLE &&
-	       work_done < quota) {
-		work_done += flexcan_read_frame(dev);
+	if (priv->rx_mb) {
+		/* handle RX ring, filled by the interrupt handler */
+		work_done += flexcan_poll_rx_ring(dev, quota - work_done);
+	} else {
+		/* handle RX-FIFO */
 		reg_iflag1 = flexcan_read(&regs->iflag1);
+		while (reg_iflag1 & FLEXCAN_IFLAG_RX_FIFO_AVAILABLE &&
+		       work_done < quota) {
+			work_done += flexcan_read_frame(dev);
+			reg_iflag1 = flexcan_read(&regs->iflag1);
+		}
 	}
 
 	/* report bus errors */
@@ -581,8 +774,12 @@ static int flexcan_poll(struct napi_struct *napi, int quota)
 	if (work_done < quota) {
 		napi_complete(napi);
 		/* enable IRQs */
-		flexcan_write(FLEXCAN_IFLAG_DEFAULT, &regs->imask1);
+		flexcan_write(priv->reg_imask1_default, &regs->imask1);
 		flexcan_write(priv->reg_ctrl_default, &regs->ctrl);
+
+		/* frames queued by the irq after the ring was checked */
+		if (priv->rx_mb && priv->rx_tail != ACCESS_ONCE(priv->rx_head))
+			napi_schedule(napi);
 	}
 
 	return work_done;
@@ -594,19 +791,29 @@ static irqreturn_t flexcan_irq(int irq, void *dev_id)
 	struct net_device_stats *stats = &dev->stats;
 	struct flexcan_priv *priv = netdev_priv(dev);
 	struct flexcan_regs __iomem *regs = priv->base;
-	u32 reg_iflag1, reg_esr;
+	u32 reg_iflag1, reg_iflag2 = 0, reg_esr;
 
 	reg_iflag1 = flexcan_read(&regs->iflag1);
+	if (priv->rx_mb)
+		reg_iflag2 = flexcan_read(&regs->iflag2);
 	reg_esr = flexcan_read(&regs->esr);
 	flexcan_write(FLEXCAN_ESR_ERR_INT, &regs->esr);	/* ACK err IRQ */
 
+	/* mailbox RX: empty the mailboxes right away, NAPI does the rest */
+	if ((reg_iflag1 & priv->rx_mask1) || (reg_iflag2 & priv->rx_mask2)) {
+		flexcan_rx_mailboxes(dev, reg_iflag1 & priv->rx_mask1,
+				     reg_iflag2 & priv->rx_mask2);
+		napi_schedule(&priv->napi);
+	}
+
 	/*
 	 * schedule NAPI in case of:
 	 * - rx IRQ
 	 * - state change IRQ
 	 * - bus error IRQ and bus error reporting is activated
 	 */
-	if ((reg_iflag1 & FLEXCAN_IFLAG_RX_FIFO_AVAILABLE) ||
+	if ((!priv->rx_mb &&
+	     (reg_iflag1 & FLEXCAN_IFLAG_RX_FIFO_AVAILABLE)) ||
 	    (reg_esr & FLEXCAN_ESR_ERR_STATE) ||
 	    flexcan_has_and_handle_berr(priv, reg_esr)) {
 		/*
@@ -614,7 +821,7 @@ static irqreturn_t flexcan_irq(int irq, void *dev_id)
 		 * save them for later use.
 		 */
 		priv->reg_esr = reg_esr & FLEXCAN_ESR_ERR_BUS;
-		flexcan_write(FLEXCAN_IFLAG_DEFAULT &
+		flexcan_write(priv->reg_imask1_default &
 			~FLEXCAN_IFLAG_RX_FIFO_AVAILABLE, &regs->imask1);
 		flexcan_write(priv->reg_ctrl_default & ~FLEXCAN_CTRL_ERR_ALL,
 		       &regs->ctrl);
@@ -622,26 +829,124 @@ static irqreturn_t flexcan_irq(int irq, void *dev_id)
 	}
 
 	/* FIFO overflow */
-	if (reg_iflag1 & FLEXCAN_IFLAG_RX_FIFO_OVERFLOW) {
+	if (!priv->rx_mb && (reg_iflag1 & FLEXCAN_IFLAG_RX_FIFO_OVERFLOW)) {
 		flexcan_write(FLEXCAN_IFLAG_RX_FIFO_OVERFLOW, &regs->iflag1);
 		dev->stats.rx_over_errors++;
 		dev->stats.rx_errors++;
 	}
 
 	/* transmission complete interrupt */
-	if (reg_iflag1 & (1 << FLEXCAN_TX_BUF_ID)) {
-		/* tx_bytes is incremented in flexcan_start_xmit */
-		stats->tx_packets++;
-		/* after sending a RTR frame mailbox is in RX mode */
-		flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
-			      &regs->cantxfg[FLEXCAN_TX_BUF_ID].can_ctrl);
-		flexcan_write((1 << FLEXCAN_TX_BUF_ID), &regs->iflag1);
-		netif_wake_queue(dev);
+	if (reg_iflag1 & priv->tx_mask) {
+		u32 done = reg_iflag1 & priv->tx_mask;
+		int i;
+
+		spin_lock(&priv->tx_lock);
+
+		for (i = 0; i < priv->tx_num; i++) {
+			if (!(done & FLEXCAN_IFLAG_BUF(FLEXCAN_TX_BUF_ID + i)))
+				continue;
+
+			/* tx_bytes is incremented in flexcan_start_xmit */
+			stats->tx_packets++;
+			/* after sending a RTR frame mailbox is in RX mode */
+			flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
+				&regs->cantxfg[FLEXCAN_TX_BUF_ID + i].can_ctrl);
+		}
+		flexcan_write(done, &regs->iflag1);
+
+		priv->tx_pending &= ~done;
+		if (!priv->tx_pending) {
+			/* pool drained, start over with the first mailbox */
+			priv->tx_next = 0;
+			netif_wake_queue(dev);
+		}
+
+		spin_unlock(&priv->tx_lock);
 	}
 
 	return IRQ_HANDLED;
 }
 
+static void flexcan_set_mb_filter(struct flexcan_regs __iomem *regs,
+				  unsigned int i, const struct can_filter *f,
+				  bool eff)
+{
+	if (eff) {
+		flexcan_write(f->can_id & CAN_EFF_MASK,
+			      &regs->cantxfg[i].can_id);
+		flexcan_write(f->can_mask & CAN_EFF_MASK, &regs->rximr[i]);
+		flexcan_write(FLEXCAN_MB_CODE_RX_EMPTY | FLEXCAN_MB_RX_EFF,
+			      &regs->cantxfg[i].can_ctrl);
+	} else {
+		flexcan_write((f->can_id & CAN_SFF_MASK) << 18,
+			      &regs->cantxfg[i].can_id);
+		flexcan_write((f->can_mask & CAN_SFF_MASK) << 18,
+			      &regs->rximr[i]);
+		flexcan_write(FLEXCAN_MB_CODE_RX_EMPTY,
+			      &regs->cantxfg[i].can_ctrl);
+	}
+}
+
+/*
+ * Program the acceptance filters, called in freeze mode with
+ * FLEXCAN_MCR_BCC set. In FIFO mode filter i goes into ID table element
+ * i, unused elements repeat the last filter. In mailbox mode the RX
+ * mailboxes are dealt out to the filters in turn.
+ */
+static void flexcan_set_filters(struct flexcan_priv *priv)
+{
+	struct flexcan_regs __iomem *regs = priv->base;
+	u32 __iomem *table = (u32 __iomem *)&regs->cantxfg[6];
+	unsigned int i, j;
+
+	if (!priv->rx_mb) {
+		for (i = 0; i < FLEXCAN_FIFO_FILTER_NUM; i++) {
+			const struct can_filter *f =
+				&priv->filter[min(i, priv->filter_num - 1)];
+			u32 id = 0, mask = 0;
+
+			if (f->can_id & CAN_RTR_FLAG)
+				id |= FLEXCAN_FIFO_FILTER_RTR;
+			if (f->can_mask & CAN_RTR_FLAG)
+				mask |= FLEXCAN_FIFO_FILTER_RTR;
+			if (f->can_mask & CAN_EFF_FLAG)
+				mask |= FLEXCAN_FIFO_FILTER_IDE;
+
+			if (f->can_id & CAN_EFF_FLAG) {
+				id |= FLEXCAN_FIFO_FILTER_IDE |
+					FLEXCAN_FIFO_FILTER_EXT(f->can_id);
+				mask |= FLEXCAN_FIFO_FILTER_EXT(f->can_mask);
+			} else {
+				id |= FLEXCAN_FIFO_FILTER_STD(f->can_id);
+				mask |= FLEXCAN_FIFO_FILTER_STD(f->can_mask);
+			}
+
+			flexcan_write(id, &table[i]);
+			flexcan_write(mask, &regs->rximr[i]);
+		}
+		return;
+	}
+
+	/*
+	 * The IDE bit of a mailbox is always compared, so a filter whose
+	 * mask leaves CAN_EFF_FLAG open takes a standard and an extended
+	 * mailbox.
+	 */
+	i = priv->rx_first;
+	while (i < FLEXCAN_MB_NUM) {
+		for (j = 0; j < priv->filter_num && i < FLEXCAN_MB_NUM; j++) {
+			const struct can_filter *f = &priv->filter[j];
+			bool both = !(f->can_mask & CAN_EFF_FLAG);
+
+			if (both || !(f->can_id & CAN_EFF_FLAG))
+				flexcan_set_mb_filter(regs, i++, f, false);
+			if ((both || f->can_id & CAN_EFF_FLAG) &&
+			    i < FLEXCAN_MB_NUM)
+				flexcan_set_mb_filter(regs, i++, f, true);
+		}
+	}
+}
+
 static void flexcan_set_bittiming(struct net_device *dev)
 {
 	const struct flexcan_priv *priv = netdev_priv(dev);
@@ -716,7 +1021,7 @@ static int flexcan_chip_start(struct net_device *dev)
 	 * MCR
 	 *
 	 * enable freeze
-	 * enable fifo
+	 * enable fifo (unless receiving through mailboxes)
 	 * halt now
 	 * only supervisor access
 	 * enable warning int
@@ -724,11 +1029,20 @@ static int flexcan_chip_start(struct net_device *dev)
 	 *
 	 */
 	reg_mcr = flexcan_read(&regs->mcr);
-	reg_mcr &= ~FLEXCAN_MCR_MAXMB(0xff);
-	reg_mcr |= FLEXCAN_MCR_FRZ | FLEXCAN_MCR_FEN | FLEXCAN_MCR_HALT |
-		FLEXCAN_MCR_SUPV | FLEXCAN_MCR_WRN_EN |
-		FLEXCAN_MCR_IDAM_C |
-		FLEXCAN_MCR_MAXMB(FLEXCAN_TX_BUF_ID);
+	reg_mcr &= ~(FLEXCAN_MCR_MAXMB(0xff) | FLEXCAN_MCR_FEN |
+		     FLEXCAN_MCR_IDAM_D | FLEXCAN_MCR_BCC);
+	reg_mcr |= FLEXCAN_MCR_FRZ | FLEXCAN_MCR_HALT |
+		FLEXCAN_MCR_SUPV | FLEXCAN_MCR_WRN_EN;
+	/* with filters: one full ID per element and individual masks */
+	if (priv->filter_num)
+		reg_mcr |= FLEXCAN_MCR_IDAM_A | FLEXCAN_MCR_BCC;
+	else
+		reg_mcr |= FLEXCAN_MCR_IDAM_C;
+	if (priv->rx_mb)
+		reg_mcr |= FLEXCAN_MCR_MAXMB(FLEXCAN_MB_NUM - 1);
+	else
+		reg_mcr |= FLEXCAN_MCR_FEN |
+			FLEXCAN_MCR_MAXMB(FLEXCAN_TX_BUF_ID + priv->tx_num - 1);
 	dev_dbg(dev->dev.parent, "%s: writing mcr=0x%08x", __func__, reg_mcr);
 	flexcan_write(reg_mcr, &regs->mcr);
 
@@ -759,24 +1073,45 @@ static int flexcan_chip_start(struct net_device *dev)
 	flexcan_write(reg_ctrl, &regs->ctrl);
 
 	/* clear and invalidate all mailboxes first */
-	for (i = FLEXCAN_TX_BUF_ID; i < ARRAY_SIZE(regs->cantxfg); i++) {
+	for (i = priv->rx_mb ? 0 : FLEXCAN_TX_BUF_ID;
+	     i < ARRAY_SIZE(regs->cantxfg); i++) {
 		flexcan_write(FLEXCAN_MB_CODE_RX_INACTIVE,
 			      &regs->cantxfg[i].can_ctrl);
 	}
 
 	/* Errata ERR005829: mark first TX mailbox as INACTIVE */
 	flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
-		      &regs->cantxfg[FLEXCAN_TX_BUF_RESERVED].can_ctrl);
+		      &regs->cantxfg[priv->tx_reserved].can_ctrl);
 
-	/* mark TX mailbox as INACTIVE */
-	flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
-		      &regs->cantxfg[FLEXCAN_TX_BUF_ID].can_ctrl);
+	/* mark TX mailboxes as INACTIVE */
+	for (i = 0; i < priv->tx_num; i++)
+		flexcan_write(FLEXCAN_MB_CODE_TX_INACTIVE,
+			      &regs->cantxfg[FLEXCAN_TX_BUF_ID + i].can_ctrl);
+	priv->tx_next = 0;
+	priv->tx_pending = 0;
+
+	/* arm RX mailboxes, every other one for extended frames */
+	if (priv->rx_mb) {
+		for (i = priv->rx_first; i < FLEXCAN_MB_NUM; i++) {
+			flexcan_write(0, &regs->cantxfg[i].can_id);
+			flexcan_write(FLEXCAN_MB_CODE_RX_EMPTY |
+				      ((i - priv->rx_first) & 1 ?
+				       FLEXCAN_MB_RX_EFF : 0),
+				      &regs->cantxfg[i].can_ctrl);
+		}
+		priv->rx_head = 0;
+		priv->rx_tail = 0;
+	}
 
 	/* acceptance mask/acceptance code (accept everything) */
 	flexcan_write(0x0, &regs->rxgmask);
 	flexcan_write(0x0, &regs->rx14mask);
 	flexcan_write(0x0, &regs->rx15mask);
 
+	/* unless filters are set */
+	if (priv->filter_num)
+		flexcan_set_filters(priv);
+
 	flexcan_transceiver_switch(priv, 1);
 
 	/* synchronize with the can bus */
@@ -786,8 +1121,14 @@ static int flexcan_chip_start(struct net_device *dev)
 
 	priv->can.state = CAN_STATE_ERROR_ACTIVE;
 
-	/* enable FIFO interrupts */
-	flexcan_write(FLEXCAN_IFLAG_DEFAULT, &regs->imask1);
+	/* enable FIFO (or RX mailbox) and TX interrupts */
+	if (priv->rx_mb)
+		priv->reg_imask1_default = priv->rx_mask1 | priv->tx_mask;
+	else
+		priv->reg_imask1_default = FLEXCAN_IFLAG_DEFAULT |
+			priv->tx_mask;
+	flexcan_write(priv->reg_imask1_default, &regs->imask1);
+	flexcan_write(priv->rx_mask2, &regs->imask2);
 
 	/* print chip status */
 	dev_dbg(dev->dev.parent, "%s: reading mcr=0x%08x ctrl=0x%08x\n",
@@ -819,6 +1160,7 @@ static void flexcan_chip_stop(struct net_device *dev)
 
 	/* Disable all interrupts */
 	flexcan_write(0, &regs->imask1);
+	flexcan_write(0, &regs->imask2);
 	flexcan_write(priv->reg_ctrl_default & ~FLEXCAN_CTRL_ERR_ALL,
 		      &regs->ctrl);
 
@@ -954,6 +1296,84 @@ static void __devexit unregister_flexcandev(struct net_device *dev)
 	unregister_candev(dev);
 }
 
+/*
+ * rx_filter: up to FLEXCAN_FIFO_FILTER_NUM "<can_id>:<can_mask>" pairs
+ * in hex, as in struct can_filter (CAN_EFF_FLAG/CAN_RTR_FLAG included).
+ * Frames not matching any of them are dropped by the controller. An
+ * empty write accepts everything again. Only while the interface is
+ * down, the filters are programmed on the next start.
+ */
+static ssize_t flexcan_sysfs_show_rx_filter(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct flexcan_priv *priv = netdev_priv(to_net_dev(dev));
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < priv->filter_num; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%x:%x\n",
+				priv->filter[i].can_id,
+				priv->filter[i].can_mask);
+
+	return len;
+}
+
+static ssize_t flexcan_sysfs_set_rx_filter(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct net_device *ndev = to_net_dev(dev);
+	struct flexcan_priv *priv = netdev_priv(ndev);
+	struct can_filter filter[FLEXCAN_FIFO_FILTER_NUM];
+	unsigned int num = 0;
+	const char *p = buf;
+	ssize_t ret;
+
+	while (*p) {
+		u32 can_id, can_mask;
+		int n;
+
+		p = skip_spaces(p);
+		if (!*p)
+			break;
+
+		if (num == FLEXCAN_FIFO_FILTER_NUM ||
+		    sscanf(p, "%x:%x%n", &can_id, &can_mask, &n) != 2)
+			return -EINVAL;
+		p += n;
+
+		filter[num].can_id = can_id;
+		filter[num].can_mask = can_mask;
+		num++;
+	}
+
+	rtnl_lock();
+
+	if (ndev->flags & IFF_UP) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	memcpy(priv->filter, filter, num * sizeof(*filter));
+	priv->filter_num = num;
+	ret = count;
+
+ out:
+	rtnl_unlock();
+	return ret;
+}
+
+static DEVICE_ATTR(rx_filter, S_IWUSR | S_IRUGO,
+	flexcan_sysfs_show_rx_filter, flexcan_sysfs_set_rx_filter);
+
+static struct attribute *flexcan_sysfs_attrs[] = {
+	&dev_attr_rx_filter.attr,
+	NULL,
+};
+
+static struct attribute_group flexcan_sysfs_attr_group = {
+	.attrs = flexcan_sysfs_attrs,
+};
+
 static int __devinit flexcan_probe(struct platform_device *pdev)
 {
 	struct net_device *dev;
@@ -1026,7 +1446,26 @@ static int __devinit flexcan_probe(struct platform_device *pdev)
 	priv->clk = clk;
 	priv->pdata = pdev->dev.platform_data;
 
-	netif_napi_add(dev, &priv->napi, flexcan_poll, FLEXCAN_NAPI_WEIGHT);
+	spin_lock_init(&priv->tx_lock);
+	priv->tx_num = clamp_t(unsigned int, tx_mailboxes, 1,
+			       FLEXCAN_TX_BUF_MAX);
+	priv->tx_mask = ((1 << priv->tx_num) - 1) << FLEXCAN_TX_BUF_ID;
+	priv->tx_reserved = FLEXCAN_TX_BUF_RESERVED;
+
+	priv->rx_mb = rx_mailboxes;
+	if (priv->rx_mb) {
+		priv->tx_reserved = FLEXCAN_MB_TX_BUF_RESERVED;
+		priv->rx_first = FLEXCAN_TX_BUF_ID + priv->tx_num;
+		priv->rx_mask1 = priv->rx_first < 32 ?
+			~0U << priv->rx_first : 0;
+		priv->rx_mask2 = priv->rx_first < 32 ?
+			~0U : ~0U << (priv->rx_first - 32);
+	}
+
+	netif_napi_add(dev, &priv->napi, flexcan_poll, priv->rx_mb ?
+		       FLEXCAN_NAPI_WEIGHT_MB : FLEXCAN_NAPI_WEIGHT);
+
+	dev->sysfs_groups[0] = &flexcan_sysfs_attr_group;
 
 	dev_set_drvdata(&pdev->dev, dev);
 	SET_NETDEV_DEV(dev, &pdev->dev);
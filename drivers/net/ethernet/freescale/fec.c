@@ -37,6 +37,7 @@
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
 #include <linux/workqueue.h>
+#include <linux/hrtimer.h>
 #include <linux/bitops.h>
 #include <linux/io.h>
 #include <linux/irq.h>
@@ -144,16 +145,25 @@ MODULE_PARM_DESC(macaddr, "FEC Ethernet MAC address");
  * We don't need to allocate pages for the transmitter.  We just use
  * the skbuffer directly.
  */
-#define FEC_ENET_RX_PAGES	8
+#define FEC_ENET_RX_PAGES	32
 #define FEC_ENET_RX_FRSIZE	2048
 #define FEC_ENET_RX_FRPPG	(PAGE_SIZE / FEC_ENET_RX_FRSIZE)
 #define RX_RING_SIZE		(FEC_ENET_RX_FRPPG * FEC_ENET_RX_PAGES)
 #define FEC_ENET_TX_FRSIZE	2048
 #define FEC_ENET_TX_FRPPG	(PAGE_SIZE / FEC_ENET_TX_FRSIZE)
-#define TX_RING_SIZE		16	/* Must be power of two */
-#define TX_RING_MOD_MASK	15	/*   for this to work */
 
-#if (((RX_RING_SIZE + TX_RING_SIZE) * 8) > PAGE_SIZE)
+/* The TX ring size can be changed with ethtool -G; it must be a power of
+ * two and always leave room for a maximally fragmented skb.
+ */
+#define TX_RING_SIZE		64	/* Default */
+#define FEC_TX_RING_MIN		64
+#define FEC_TX_RING_MAX		256
+#define FEC_TX_DESC_PER_SKB	(MAX_SKB_FRAGS + 1)
+
+/* Default limit of bytes queued to the hardware before the queue stops */
+#define FEC_TX_MAX_BYTES	(32 * 1024)
+
+#if (((RX_RING_SIZE + FEC_TX_RING_MAX) * 8) > PAGE_SIZE)
 #error "FEC: descriptor ring size constants too large"
 #endif
 
@@ -170,6 +180,40 @@ MODULE_PARM_DESC(macaddr, "FEC Ethernet MAC address");
 #define FEC_ENET_EBERR	((uint)0x00400000)	/* SDMA bus error */
 
 #define FEC_DEFAULT_IMASK (FEC_ENET_TXF | FEC_ENET_RXF | FEC_ENET_MII)
+/* Mask used while NAPI owns the rings: only MII events stay in hard IRQ */
+#define FEC_NAPI_IMASK	FEC_ENET_MII
+
+#define FEC_NAPI_WEIGHT	64
+
+/* Upper bound of the software interrupt hold-off (ethtool -C rx-usecs).
+ * The RX ring has to absorb whatever arrives while interrupts are held
+ * off.  Minimum sized frames at 100 Mbit/s, with preamble and inter
+ * frame gap, take 6.72 us each, so 64 entries fill after about 430 us,
+ * several times the 123 us a single full sized frame takes.
+ */
+#define FEC_RX_MIN_FRAME_NS	6720
+#define FEC_COAL_USECS_MAX	(RX_RING_SIZE * FEC_RX_MIN_FRAME_NS / 1000)
+
+/* Receive frames up to this size are copied, larger ones keep their page */
+#define FEC_RX_COPYBREAK	256
+/* Bytes of a page-backed frame pulled into the skb linear area */
+#define FEC_RX_HDR_LEN		128
+
+static int napi_weight = FEC_NAPI_WEIGHT;
+module_param(napi_weight, int, S_IRUGO);
+MODULE_PARM_DESC(napi_weight, "FEC NAPI poll budget (frames per poll)");
+
+static int rx_copybreak = FEC_RX_COPYBREAK;
+module_param(rx_copybreak, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_copybreak, "FEC copy-only receive threshold in bytes");
+
+static int tx_ring_size = TX_RING_SIZE;
+module_param(tx_ring_size, int, S_IRUGO);
+MODULE_PARM_DESC(tx_ring_size, "FEC initial TX descriptor ring size");
+
+static int tx_max_bytes = FEC_TX_MAX_BYTES;
+module_param(tx_max_bytes, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tx_max_bytes, "FEC bytes in flight before the TX queue stops (0: no limit)");
 
 /* The FEC stores dest/src/type, data, and checksum for receive packets.
  */
@@ -208,12 +252,15 @@ struct fec_enet_private {
 
 	struct clk *clk;
 
-	/* The saved address of a sent-in-place packet/buffer, for skfree(). */
-	unsigned char *tx_bounce[TX_RING_SIZE];
-	struct	sk_buff* tx_skbuff[TX_RING_SIZE];
-	struct	sk_buff* rx_skbuff[RX_RING_SIZE];
-	ushort	skb_cur;
-	ushort	skb_dirty;
+	/* Bounce buffers for misaligned TX data, allocated on first use */
+	unsigned char *tx_bounce[FEC_TX_RING_MAX];
+	/* The skb of a frame is kept with its last descriptor */
+	struct	sk_buff* tx_skbuff[FEC_TX_RING_MAX];
+	/* Descriptor maps a paged fragment (dma_map_page) */
+	unsigned char tx_frag[FEC_TX_RING_MAX];
+	/* RX buffers: a FEC_ENET_RX_FRSIZE chunk of rx_page at rx_page_off */
+	struct	page *rx_page[RX_RING_SIZE];
+	unsigned int rx_page_off[RX_RING_SIZE];
 
 	/* CPM dual port RAM relative addresses */
 	dma_addr_t	bd_dma;
@@ -224,13 +271,29 @@ struct fec_enet_private {
 	struct bufdesc	*cur_rx, *cur_tx;
 	/* The ring entries to be free()ed */
 	struct bufdesc	*dirty_tx;
-
-	uint	tx_full;
+	/* Bumped by fec_restart() whenever it rewinds cur_rx */
+	uint	rx_restarts;
+
+	uint	tx_ring_size;
+	/* Descriptors, frames and bytes handed to the hardware */
+	uint	tx_bd_used;
+	uint	tx_inflight_pkts;
+	uint	tx_inflight_bytes;
 	/* hold while accessing the HW like ringbuffer for tx/rx but not MAC */
 	spinlock_t hw_lock;
 
 	struct	platform_device *pdev;
 
+	struct	napi_struct napi;
+
+	/* Software interrupt coalescing: after a poll that handled at
+	 * least coal_frames frames, RX/TX interrupts stay masked for
+	 * coal_usecs and the timer restarts polling.
+	 */
+	struct	hrtimer coal_timer;
+	uint	coal_usecs;
+	uint	coal_frames;
+
 	int	opened;
 	int	dev_id;
 
@@ -271,16 +334,56 @@ static void *swap_buffer(void *bufaddr, int len)
 	return bufaddr;
 }
 
+static inline bool fec_enet_tx_avail(struct fec_enet_private *fep)
+{
+	if (fep->tx_ring_size - fep->tx_bd_used < FEC_TX_DESC_PER_SKB)
+		return false;
+
+	return !tx_max_bytes || fep->tx_inflight_bytes < tx_max_bytes;
+}
+
+/*
+ * On some FEC implementations data must be aligned.  Make sure the ring
+ * entries a frame is going to use have bounce buffers for its misaligned
+ * pieces, so nothing has to be undone once descriptors are filled in.
+ */
+static int
+fec_enet_tx_prep_bounce(struct fec_enet_private *fep, struct sk_buff *skb)
+{
+	unsigned int index = fep->cur_tx - fep->tx_bd_base;
+	unsigned long addr = (unsigned long)skb->data;
+	int i;
+
+	for (i = 0; i <= skb_shinfo(skb)->nr_frags; i++) {
+		if (i > 0) {
+			skb_frag_t *frag = &skb_shinfo(skb)->frags[i - 1];
+			addr = frag->page_offset;
+		}
+
+		if ((addr & FEC_ALIGNMENT) && !fep->tx_bounce[index]) {
+			fep->tx_bounce[index] = kmalloc(FEC_ENET_TX_FRSIZE,
+							GFP_ATOMIC);
+			if (!fep->tx_bounce[index])
+				return -ENOMEM;
+		}
+		index = (index + 1) & (fep->tx_ring_size - 1);
+	}
+
+	return 0;
+}
+
 static netdev_tx_t
 fec_enet_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
 	const struct platform_device_id *id_entry =
 				platform_get_device_id(fep->pdev);
-	struct bufdesc *bdp;
+	struct bufdesc *bdp, *bdp_first;
 	void *bufaddr;
-	unsigned short	status;
+	unsigned short	status, status_first = 0;
 	unsigned long flags;
+	unsigned int index, len, offset;
+	int i, nr_frags;
 
 	if (!fep->link) {
 		/* Link is down or autonegotiation is in progress. */
@@ -288,81 +391,127 @@ fec_enet_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 		return NETDEV_TX_OK;
 	}
 
-	spin_lock_irqsave(&fep->hw_lock, flags);
-	/* Fill in a Tx ring entry */
-	bdp = fep->cur_tx;
+	/* We announce checksumming only so the stack hands us paged
+	 * frames; the FEC cannot compute it, so do it here.
+	 */
+	if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb)) {
+		dev_kfree_skb_any(skb);
+		ndev->stats.tx_dropped++;
+		return NETDEV_TX_OK;
+	}
 
-	status = bdp->cbd_sc;
+	nr_frags = skb_shinfo(skb)->nr_frags;
 
-	if (status & BD_ENET_TX_READY) {
+	spin_lock_irqsave(&fep->hw_lock, flags);
+
+	if (fep->tx_ring_size - fep->tx_bd_used < nr_frags + 1) {
 		/* Ooops.  All transmit buffers are full.  Bail out.
-		 * This should not happen, since ndev->tbusy should be set.
+		 * This should not happen, since the queue should be stopped.
 		 */
 		printk("%s: tx queue full!.\n", ndev->name);
+		netif_stop_queue(ndev);
+		spin_unlock_irqrestore(&fep->hw_lock, flags);
+		return NETDEV_TX_BUSY;
+	}
+
+	if (fec_enet_tx_prep_bounce(fep, skb)) {
 		spin_unlock_irqrestore(&fep->hw_lock, flags);
 		dev_kfree_skb_any(skb);
+		ndev->stats.tx_dropped++;
 		return NETDEV_TX_OK;
 	}
 
-	/* Clear all of the status flags */
-	status &= ~BD_ENET_TX_STATS;
+	/* Fill in one Tx ring entry per linear part and fragment */
+	bdp = bdp_first = fep->cur_tx;
+	offset = 0;
 
-	/* Set buffer length and buffer pointer */
-	bufaddr = skb->data;
-	bdp->cbd_datlen = skb->len;
+	for (i = 0; i <= nr_frags; i++) {
+		skb_frag_t *frag = NULL;
 
-	/*
-	 * On some FEC implementations data must be aligned on
-	 * 4-byte boundaries. Use bounce buffers to copy data
-	 * and get it aligned. Ugh.
-	 */
-	if (((unsigned long) bufaddr) & FEC_ALIGNMENT) {
-		unsigned int index;
 		index = bdp - fep->tx_bd_base;
-		memcpy(fep->tx_bounce[index], skb->data, skb->len);
-		bufaddr = fep->tx_bounce[index];
-	}
 
-	/*
-	 * Some design made an incorrect assumption on endian mode of
-	 * the system that it's running on. As the result, driver has to
-	 * swap every frame going to and coming from the controller.
-	 */
-	if (id_entry->driver_data & FEC_QUIRK_SWAP_FRAME)
-		swap_buffer(bufaddr, skb->len);
+		if (i == 0) {
+			bufaddr = skb->data;
+			len = skb_headlen(skb);
+		} else {
+			frag = &skb_shinfo(skb)->frags[i - 1];
+			bufaddr = NULL;
+			len = skb_frag_size(frag);
+		}
 
-	/* Save skb pointer */
-	fep->tx_skbuff[fep->skb_cur] = skb;
+		/* Keep only the wrap bit */
+		status = bdp->cbd_sc & BD_ENET_TX_WRAP;
+		bdp->cbd_datlen = len;
 
-	ndev->stats.tx_bytes += skb->len;
-	fep->skb_cur = (fep->skb_cur+1) & TX_RING_MOD_MASK;
+		if ((frag ? frag->page_offset : (unsigned long)bufaddr)
+		    & FEC_ALIGNMENT) {
+			skb_copy_bits(skb, offset, fep->tx_bounce[index], len);
+			bufaddr = fep->tx_bounce[index];
+		}
 
-	/* Push the data cache so the CPM does not get stale memory
-	 * data.
-	 */
-	bdp->cbd_bufaddr = dma_map_single(&fep->pdev->dev, bufaddr,
-			FEC_ENET_TX_FRSIZE, DMA_TO_DEVICE);
+		/*
+		 * Some design made an incorrect assumption on endian mode of
+		 * the system that it's running on. As the result, driver has
+		 * to swap every frame going to and coming from the
+		 * controller.  Such controllers never get paged frames.
+		 */
+		if (id_entry->driver_data & FEC_QUIRK_SWAP_FRAME)
+			swap_buffer(bufaddr, len);
 
-	/* Send it on its way.  Tell FEC it's ready, interrupt when done,
-	 * it's the last BD of the frame, and to put the CRC on the end.
-	 */
-	status |= (BD_ENET_TX_READY | BD_ENET_TX_INTR
-			| BD_ENET_TX_LAST | BD_ENET_TX_TC);
-	bdp->cbd_sc = status;
+		/* Push the data cache so the CPM does not get stale memory
+		 * data.
+		 */
+		if (bufaddr) {
+			bdp->cbd_bufaddr = dma_map_single(&fep->pdev->dev,
+					bufaddr, len, DMA_TO_DEVICE);
+			fep->tx_frag[index] = 0;
+		} else {
+			bdp->cbd_bufaddr = skb_frag_dma_map(&fep->pdev->dev,
+					frag, 0, len, DMA_TO_DEVICE);
+			fep->tx_frag[index] = 1;
+		}
+
+		/* Tell FEC the last BD of the frame is there, to interrupt
+		 * when done and to put the CRC on the end.
+		 */
+		if (i == nr_frags) {
+			status |= (BD_ENET_TX_INTR | BD_ENET_TX_LAST
+					| BD_ENET_TX_TC);
+			/* Save skb pointer */
+			fep->tx_skbuff[index] = skb;
+		}
+
+		/* The first BD is handed over only when the chain is complete */
+		if (i == 0)
+			status_first = status | BD_ENET_TX_READY;
+		else
+			bdp->cbd_sc = status | BD_ENET_TX_READY;
+
+		offset += len;
+
+		/* If this was the last BD in the ring, start at the
+		 * beginning again.
+		 */
+		if (status & BD_ENET_TX_WRAP)
+			bdp = fep->tx_bd_base;
+		else
+			bdp++;
+	}
+
+	wmb();
+	bdp_first->cbd_sc = status_first;
+
+	ndev->stats.tx_bytes += skb->len;
+	fep->tx_bd_used += nr_frags + 1;
+	fep->tx_inflight_pkts++;
+	fep->tx_inflight_bytes += skb->len;
 
 	/* Trigger transmission start */
 	writel(0, fep->hwp + FEC_X_DES_ACTIVE);
 
-	/* If this was the last BD in the ring, start at the beginning again. */
-	if (status & BD_ENET_TX_WRAP)
-		bdp = fep->tx_bd_base;
-	else
-		bdp++;
-
-	if (bdp == fep->dirty_tx) {
-		fep->tx_full = 1;
+	/* Stop on descriptors as well as on the amount of queued data */
+	if (!fec_enet_tx_avail(fep))
 		netif_stop_queue(ndev);
-	}
 
 	fep->cur_tx = bdp;
 
@@ -373,6 +522,45 @@ fec_enet_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 	return NETDEV_TX_OK;
 }
 
+/*
+ * Release everything the TX ring still holds and reinitialize its
+ * descriptors for the current ring size.  Called with the transmitter
+ * stopped.
+ */
+static void
+fec_enet_tx_ring_reset(struct net_device *ndev)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+	struct bufdesc *bdp = fep->tx_bd_base;
+	int i;
+
+	for (i = 0; i < FEC_TX_RING_MAX; i++, bdp++) {
+		if (bdp->cbd_bufaddr) {
+			if (fep->tx_frag[i])
+				dma_unmap_page(&fep->pdev->dev,
+					bdp->cbd_bufaddr, bdp->cbd_datlen,
+					DMA_TO_DEVICE);
+			else
+				dma_unmap_single(&fep->pdev->dev,
+					bdp->cbd_bufaddr, bdp->cbd_datlen,
+					DMA_TO_DEVICE);
+		}
+		if (fep->tx_skbuff[i]) {
+			dev_kfree_skb_any(fep->tx_skbuff[i]);
+			fep->tx_skbuff[i] = NULL;
+		}
+
+		bdp->cbd_sc = (i == fep->tx_ring_size - 1) ? BD_SC_WRAP : 0;
+		bdp->cbd_bufaddr = 0;
+		fep->tx_frag[i] = 0;
+	}
+
+	fep->dirty_tx = fep->cur_tx = fep->tx_bd_base;
+	fep->tx_bd_used = 0;
+	fep->tx_inflight_pkts = 0;
+	fep->tx_inflight_bytes = 0;
+}
+
 /* This function is called to start or restart the FEC during a link
  * change.  This only happens when switching between half and full
  * duplex.
@@ -383,7 +571,6 @@ fec_restart(struct net_device *ndev, int duplex)
 	struct fec_enet_private *fep = netdev_priv(ndev);
 	const struct platform_device_id *id_entry =
 				platform_get_device_id(fep->pdev);
-	int i;
 	u32 temp_mac[2];
 	u32 rcntl = OPT_FRAME_SIZE | 0x04;
 	u32 ecntl = 0x2; /* ETHEREN */
@@ -421,17 +608,11 @@ fec_restart(struct net_device *ndev, int duplex)
 	writel((unsigned long)fep->bd_dma + sizeof(struct bufdesc) * RX_RING_SIZE,
 			fep->hwp + FEC_X_DES_START);
 
-	fep->dirty_tx = fep->cur_tx = fep->tx_bd_base;
 	fep->cur_rx = fep->rx_bd_base;
+	fep->rx_restarts++;
 
-	/* Reset SKB transmit buffers. */
-	fep->skb_cur = fep->skb_dirty = 0;
-	for (i = 0; i <= TX_RING_MOD_MASK; i++) {
-		if (fep->tx_skbuff[i]) {
-			dev_kfree_skb_any(fep->tx_skbuff[i]);
-			fep->tx_skbuff[i] = NULL;
-		}
-	}
+	/* Reset SKB transmit buffers and descriptors. */
+	fec_enet_tx_ring_reset(ndev);
 
 	/* Enable MII mode */
 	if (duplex) {
@@ -553,27 +734,39 @@ fec_timeout(struct net_device *ndev)
 	netif_wake_queue(ndev);
 }
 
-static void
+static int
 fec_enet_tx(struct net_device *ndev)
 {
 	struct	fec_enet_private *fep;
 	struct bufdesc *bdp;
 	unsigned short status;
 	struct	sk_buff	*skb;
+	unsigned int index;
+	unsigned long flags;
+	int pkts = 0;
 
 	fep = netdev_priv(ndev);
-	spin_lock(&fep->hw_lock);
+	spin_lock_irqsave(&fep->hw_lock, flags);
 	bdp = fep->dirty_tx;
 
-	while (((status = bdp->cbd_sc) & BD_ENET_TX_READY) == 0) {
-		if (bdp == fep->cur_tx && fep->tx_full == 0)
-			break;
+	while (fep->tx_bd_used &&
+	       ((status = bdp->cbd_sc) & BD_ENET_TX_READY) == 0) {
+		index = bdp - fep->tx_bd_base;
 
-		dma_unmap_single(&fep->pdev->dev, bdp->cbd_bufaddr,
-				FEC_ENET_TX_FRSIZE, DMA_TO_DEVICE);
+		if (fep->tx_frag[index])
+			dma_unmap_page(&fep->pdev->dev, bdp->cbd_bufaddr,
+					bdp->cbd_datlen, DMA_TO_DEVICE);
+		else
+			dma_unmap_single(&fep->pdev->dev, bdp->cbd_bufaddr,
+					bdp->cbd_datlen, DMA_TO_DEVICE);
 		bdp->cbd_bufaddr = 0;
+		fep->tx_bd_used--;
+
+		/* Status is only valid in the last BD of a frame */
+		skb = fep->tx_skbuff[index];
+		if (!skb)
+			goto next_bd;
 
-		skb = fep->tx_skbuff[fep->skb_dirty];
 		/* Check for errors. */
 		if (status & (BD_ENET_TX_HB | BD_ENET_TX_LC |
 				   BD_ENET_TX_RL | BD_ENET_TX_UN |
@@ -593,69 +786,148 @@ fec_enet_tx(struct net_device *ndev)
 			ndev->stats.tx_packets++;
 		}
 
-		if (status & BD_ENET_TX_READY)
-			printk("HEY! Enet xmit interrupt and TX_READY.\n");
-
 		/* Deferred means some collisions occurred during transmit,
 		 * but we eventually sent the packet OK.
 		 */
 		if (status & BD_ENET_TX_DEF)
 			ndev->stats.collisions++;
 
+		fep->tx_inflight_pkts--;
+		fep->tx_inflight_bytes -= skb->len;
+		pkts++;
+
 		/* Free the sk buffer associated with this last transmit */
 		dev_kfree_skb_any(skb);
-		fep->tx_skbuff[fep->skb_dirty] = NULL;
-		fep->skb_dirty = (fep->skb_dirty + 1) & TX_RING_MOD_MASK;
+		fep->tx_skbuff[index] = NULL;
 
+next_bd:
 		/* Update pointer to next buffer descriptor to be transmitted */
 		if (status & BD_ENET_TX_WRAP)
 			bdp = fep->tx_bd_base;
 		else
 			bdp++;
-
-		/* Since we have freed up a buffer, the ring is no longer full
-		 */
-		if (fep->tx_full) {
-			fep->tx_full = 0;
-			if (netif_queue_stopped(ndev))
-				netif_wake_queue(ndev);
-		}
 	}
 	fep->dirty_tx = bdp;
-	spin_unlock(&fep->hw_lock);
+
+	/* Since we have freed up buffers, the ring may no longer be full */
+	if (netif_queue_stopped(ndev) && fec_enet_tx_avail(fep))
+		netif_wake_queue(ndev);
+
+	spin_unlock_irqrestore(&fep->hw_lock, flags);
+
+	return pkts;
 }
 
 
+/*
+ * Build an skb from the receive buffer behind bdp.  Small
+ * frames are copied and the buffer stays in the ring.  For larger ones
+ * only the headers are copied into the linear area, keeping the IP
+ * header aligned, and the payload is attached as a page fragment.  The
+ * ring moves on to the next chunk of the same page when the stack has
+ * released all other chunks, otherwise a fresh page takes its place.
+ * The entry is mapped for DMA again on return; NULL means the frame
+ * has to be dropped.
+ */
+static struct sk_buff *
+fec_enet_rx_skb(struct net_device *ndev, struct bufdesc *bdp, int len)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+	const struct platform_device_id *id_entry =
+				platform_get_device_id(fep->pdev);
+	int index = bdp - fep->rx_bd_base;
+	struct page *page = fep->rx_page[index];
+	unsigned int off = fep->rx_page_off[index];
+	void *data = page_address(page) + off;
+	struct page *new_page;
+	struct sk_buff *skb;
+
+	if (id_entry->driver_data & FEC_QUIRK_SWAP_FRAME)
+		swap_buffer(data, len);
+
+	if (len <= rx_copybreak || len <= FEC_RX_HDR_LEN) {
+		skb = netdev_alloc_skb_ip_align(ndev, len);
+		if (skb)
+			memcpy(skb_put(skb, len), data, len);
+		goto remap;
+	}
+
+	skb = netdev_alloc_skb_ip_align(ndev, FEC_RX_HDR_LEN);
+	if (!skb)
+		goto remap;
+
+	if (page_count(page) == 1) {
+		/* Nobody else holds the page: recycle its next chunk */
+		get_page(page);
+		fep->rx_page_off[index] =
+			(off + FEC_ENET_RX_FRSIZE) & (PAGE_SIZE - 1);
+	} else {
+		new_page = alloc_page(GFP_ATOMIC);
+		if (!new_page) {
+			dev_kfree_skb_any(skb);
+			skb = NULL;
+			goto remap;
+		}
+		fep->rx_page[index] = new_page;
+		fep->rx_page_off[index] = 0;
+	}
+
+	memcpy(skb_put(skb, FEC_RX_HDR_LEN), data, FEC_RX_HDR_LEN);
+	skb_add_rx_frag(skb, 0, page, off + FEC_RX_HDR_LEN,
+			len - FEC_RX_HDR_LEN);
+	skb->truesize += FEC_ENET_RX_FRSIZE - (len - FEC_RX_HDR_LEN);
+
+remap:
+	bdp->cbd_bufaddr = dma_map_page(&fep->pdev->dev,
+			fep->rx_page[index], fep->rx_page_off[index],
+			FEC_ENET_RX_FRSIZE, DMA_FROM_DEVICE);
+	return skb;
+}
+
 /* During a receive, the cur_rx points to the current incoming buffer.
  * When we update through the ring, if the next incoming buffer has
  * not been given to the system, we just set the empty indicator,
  * effectively tossing the packet.
+ *
+ * Called from NAPI context.  At most budget frames are taken off the
+ * ring and handed to GRO afterwards.  Every descriptor is owned by
+ * either the FEC or us through its empty bit, so only cur_rx, which
+ * fec_restart() rewinds, is read and written under hw_lock.  Returns
+ * the number of ring entries consumed.
  */
-static void
-fec_enet_rx(struct net_device *ndev)
+static int
+fec_enet_rx(struct net_device *ndev, int budget)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
-	const struct platform_device_id *id_entry =
-				platform_get_device_id(fep->pdev);
 	struct bufdesc *bdp;
 	unsigned short status;
 	struct	sk_buff	*skb;
+	struct	sk_buff_head rxq;
 	ushort	pkt_len;
-	__u8 *data;
+	unsigned long flags;
+	unsigned int rx_restarts;
+	int pkt_received = 0;
 
 #ifdef CONFIG_M532x
 	flush_cache_all();
 #endif
 
-	spin_lock(&fep->hw_lock);
+	__skb_queue_head_init(&rxq);
+
+	spin_lock_irqsave(&fep->hw_lock, flags);
+	bdp = fep->cur_rx;
+	rx_restarts = fep->rx_restarts;
+	spin_unlock_irqrestore(&fep->hw_lock, flags);
 
 	/* First, grab all of the stats for the incoming packet.
 	 * These get messed up if we get called due to a busy condition.
 	 */
-	bdp = fep->cur_rx;
-
 	while (!((status = bdp->cbd_sc) & BD_ENET_RX_EMPTY)) {
 
+		if (pkt_received >= budget)
+			break;
+		pkt_received++;
+
 		/* Since we have allocated space to hold a complete frame,
 		 * the last indicator should be set.
 		 */
@@ -695,36 +967,24 @@ fec_enet_rx(struct net_device *ndev)
 		ndev->stats.rx_packets++;
 		pkt_len = bdp->cbd_datlen;
 		ndev->stats.rx_bytes += pkt_len;
-		data = (__u8*)__va(bdp->cbd_bufaddr);
 
-		dma_unmap_single(&fep->pdev->dev, bdp->cbd_bufaddr,
-				FEC_ENET_TX_FRSIZE, DMA_FROM_DEVICE);
-
-		if (id_entry->driver_data & FEC_QUIRK_SWAP_FRAME)
-			swap_buffer(data, pkt_len);
+		dma_unmap_page(&fep->pdev->dev, bdp->cbd_bufaddr,
+				FEC_ENET_RX_FRSIZE, DMA_FROM_DEVICE);
 
-		/* This does 16 byte alignment, exactly what we need.
-		 * The packet length includes FCS, but we don't want to
+		/* The packet length includes FCS, but we don't want to
 		 * include that when passing upstream as it messes up
 		 * bridging applications.
 		 */
-		skb = dev_alloc_skb(pkt_len - 4 + NET_IP_ALIGN);
+		skb = fec_enet_rx_skb(ndev, bdp, pkt_len - 4);
 
 		if (unlikely(!skb)) {
 			printk("%s: Memory squeeze, dropping packet.\n",
 					ndev->name);
 			ndev->stats.rx_dropped++;
 		} else {
-			skb_reserve(skb, NET_IP_ALIGN);
-			skb_put(skb, pkt_len - 4);	/* Make room */
-			skb_copy_to_linear_data(skb, data, pkt_len - 4);
-			skb->protocol = eth_type_trans(skb, ndev);
-			if (!skb_defer_rx_timestamp(skb))
-				netif_rx(skb);
+			__skb_queue_tail(&rxq, skb);
 		}
 
-		bdp->cbd_bufaddr = dma_map_single(&fep->pdev->dev, data,
-				FEC_ENET_TX_FRSIZE, DMA_FROM_DEVICE);
 rx_processing_done:
 		/* Clear the status flags for this buffer */
 		status &= ~BD_ENET_RX_STATS;
@@ -744,9 +1004,71 @@ rx_processing_done:
 		 */
 		writel(0, fep->hwp + FEC_R_DES_ACTIVE);
 	}
-	fep->cur_rx = bdp;
 
-	spin_unlock(&fep->hw_lock);
+	spin_lock_irqsave(&fep->hw_lock, flags);
+	/* a restart meanwhile has moved the FEC back to the first entry */
+	if (fep->rx_restarts == rx_restarts)
+		fep->cur_rx = bdp;
+	spin_unlock_irqrestore(&fep->hw_lock, flags);
+
+	while ((skb = __skb_dequeue(&rxq)) != NULL) {
+		skb->protocol = eth_type_trans(skb, ndev);
+		if (!skb_defer_rx_timestamp(skb))
+			napi_gro_receive(&fep->napi, skb);
+	}
+
+	return pkt_received;
+}
+
+/*
+ * NAPI poll: reclaim finished transmit descriptors, then receive up to
+ * budget frames.  RX and TX interrupts stay masked until the rings are
+ * drained, and for the coalescing hold-off after busy polls.
+ */
+static int
+fec_enet_rx_napi(struct napi_struct *napi, int budget)
+{
+	struct fec_enet_private *fep =
+		container_of(napi, struct fec_enet_private, napi);
+	struct net_device *ndev = fep->netdev;
+	int pkts, tx_pkts;
+
+	tx_pkts = fec_enet_tx(ndev);
+	pkts = fec_enet_rx(ndev, budget);
+
+	if (pkts < budget) {
+		napi_complete(napi);
+
+		if (fep->coal_usecs && pkts + tx_pkts >= fep->coal_frames) {
+			hrtimer_start(&fep->coal_timer,
+				ns_to_ktime(fep->coal_usecs * NSEC_PER_USEC),
+				HRTIMER_MODE_REL);
+			return pkts;
+		}
+
+		writel(FEC_DEFAULT_IMASK, fep->hwp + FEC_IMASK);
+
+		/*
+		 * A frame may have landed between the last ring check and
+		 * unmasking, with its event already acked by the MII path.
+		 */
+		if (!(fep->cur_rx->cbd_sc & BD_ENET_RX_EMPTY) &&
+		    napi_reschedule(napi))
+			writel(FEC_NAPI_IMASK, fep->hwp + FEC_IMASK);
+	}
+
+	return pkts;
+}
+
+/* End of the coalescing hold-off: poll again, interrupts stay masked */
+static enum hrtimer_restart fec_enet_coal_timer(struct hrtimer *timer)
+{
+	struct fec_enet_private *fep =
+		container_of(timer, struct fec_enet_private, coal_timer);
+
+	napi_schedule(&fep->napi);
+
+	return HRTIMER_NORESTART;
 }
 
 static irqreturn_t
@@ -761,18 +1083,15 @@ fec_enet_interrupt(int irq, void *dev_id)
 		int_events = readl(fep->hwp + FEC_IEVENT);
 		writel(int_events, fep->hwp + FEC_IEVENT);
 
-		if (int_events & FEC_ENET_RXF) {
-			ret = IRQ_HANDLED;
-			fec_enet_rx(ndev);
-		}
-
-		/* Transmit OK, or non-fatal error. Update the buffer
-		 * descriptors. FEC handles all errors, we just discover
-		 * them as part of the transmit process.
+		/* Receive, or transmit OK / non-fatal error: mask both
+		 * sources and let the NAPI poll walk the buffer descriptors.
+		 * FEC handles all errors, we just discover them as part of
+		 * the transmit process.
 		 */
-		if (int_events & FEC_ENET_TXF) {
+		if (int_events & (FEC_ENET_RXF | FEC_ENET_TXF)) {
 			ret = IRQ_HANDLED;
-			fec_enet_tx(ndev);
+			writel(FEC_NAPI_IMASK, fep->hwp + FEC_IMASK);
+			napi_schedule(&fep->napi);
 		}
 
 		if (int_events & FEC_ENET_MII) {
@@ -1142,11 +1461,105 @@ static void fec_enet_get_drvinfo(struct net_device *ndev,
 	strcpy(info->bus_info, dev_name(&ndev->dev));
 }
 
+static void fec_enet_get_ringparam(struct net_device *ndev,
+				   struct ethtool_ringparam *ring)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+
+	ring->rx_max_pending = RX_RING_SIZE;
+	ring->tx_max_pending = FEC_TX_RING_MAX;
+	ring->rx_pending = RX_RING_SIZE;
+	ring->tx_pending = fep->tx_ring_size;
+}
+
+static int fec_enet_set_ringparam(struct net_device *ndev,
+				  struct ethtool_ringparam *ring)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+	unsigned long flags;
+
+	if (ring->rx_pending != RX_RING_SIZE ||
+	    ring->rx_mini_pending || ring->rx_jumbo_pending)
+		return -EINVAL;
+
+	if (ring->tx_pending < FEC_TX_RING_MIN ||
+	    ring->tx_pending > FEC_TX_RING_MAX ||
+	    !is_power_of_2(ring->tx_pending))
+		return -EINVAL;
+
+	if (ring->tx_pending == fep->tx_ring_size)
+		return 0;
+
+	if (!netif_running(ndev)) {
+		fep->tx_ring_size = ring->tx_pending;
+		return 0;
+	}
+
+	/* Quiesce, then restart the controller on the resized ring */
+	netif_stop_queue(ndev);
+	napi_disable(&fep->napi);
+
+	spin_lock_irqsave(&fep->hw_lock, flags);
+	fep->tx_ring_size = ring->tx_pending;
+	fec_restart(ndev, fep->full_duplex);
+	if (!fep->link)
+		fec_stop(ndev);
+	spin_unlock_irqrestore(&fep->hw_lock, flags);
+
+	napi_enable(&fep->napi);
+	netif_wake_queue(ndev);
+
+	return 0;
+}
+
+/*
+ * The FEC has no hardware interrupt coalescing, and RX and TX share one
+ * interrupt and one poll context, so a single software hold-off serves
+ * both directions: rx-usecs is the time interrupts stay masked after a
+ * poll, rx-frames the number of frames (RX plus TX completions) a poll
+ * must have handled for the hold-off to apply.  The tx-* values mirror
+ * the rx-* ones.
+ */
+static int fec_enet_get_coalesce(struct net_device *ndev,
+				 struct ethtool_coalesce *ec)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+
+	ec->rx_coalesce_usecs = fep->coal_usecs;
+	ec->rx_max_coalesced_frames = fep->coal_frames;
+	ec->tx_coalesce_usecs = fep->coal_usecs;
+	ec->tx_max_coalesced_frames = fep->coal_frames;
+
+	return 0;
+}
+
+static int fec_enet_set_coalesce(struct net_device *ndev,
+				 struct ethtool_coalesce *ec)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+
+	if (ec->rx_coalesce_usecs > FEC_COAL_USECS_MAX)
+		return -EINVAL;
+
+	if (ec->rx_max_coalesced_frames > RX_RING_SIZE)
+		return -EINVAL;
+
+	fep->coal_usecs = ec->rx_coalesce_usecs;
+	/* A hold-off after polls that found nothing would never end */
+	fep->coal_frames = max_t(u32, ec->rx_max_coalesced_frames, 1);
+
+	return 0;
+}
+
 static struct ethtool_ops fec_enet_ethtool_ops = {
 	.get_settings		= fec_enet_get_settings,
 	.set_settings		= fec_enet_set_settings,
 	.get_drvinfo		= fec_enet_get_drvinfo,
 	.get_link		= ethtool_op_get_link,
+	.get_ringparam		= fec_enet_get_ringparam,
+	.set_ringparam		= fec_enet_set_ringparam,
+	.get_coalesce		= fec_enet_get_coalesce,
+	.set_coalesce		= fec_enet_set_coalesce,
 };
 
 static int fec_enet_ioctl(struct net_device *ndev, struct ifreq *rq, int cmd)
@@ -1167,43 +1580,45 @@ static void fec_enet_free_buffers(struct net_device *ndev)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
 	int i;
-	struct sk_buff *skb;
 	struct bufdesc	*bdp;
 
 	bdp = fep->rx_bd_base;
 	for (i = 0; i < RX_RING_SIZE; i++) {
-		skb = fep->rx_skbuff[i];
-
 		if (bdp->cbd_bufaddr)
-			dma_unmap_single(&fep->pdev->dev, bdp->cbd_bufaddr,
+			dma_unmap_page(&fep->pdev->dev, bdp->cbd_bufaddr,
 					FEC_ENET_RX_FRSIZE, DMA_FROM_DEVICE);
-		if (skb)
-			dev_kfree_skb(skb);
+		bdp->cbd_bufaddr = 0;
+		if (fep->rx_page[i])
+			put_page(fep->rx_page[i]);
+		fep->rx_page[i] = NULL;
 		bdp++;
 	}
 
-	bdp = fep->tx_bd_base;
-	for (i = 0; i < TX_RING_SIZE; i++)
+	fec_enet_tx_ring_reset(ndev);
+	for (i = 0; i < FEC_TX_RING_MAX; i++) {
 		kfree(fep->tx_bounce[i]);
+		fep->tx_bounce[i] = NULL;
+	}
 }
 
 static int fec_enet_alloc_buffers(struct net_device *ndev)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
 	int i;
-	struct sk_buff *skb;
+	struct page *page;
 	struct bufdesc	*bdp;
 
 	bdp = fep->rx_bd_base;
 	for (i = 0; i < RX_RING_SIZE; i++) {
-		skb = dev_alloc_skb(FEC_ENET_RX_FRSIZE);
-		if (!skb) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
 			fec_enet_free_buffers(ndev);
 			return -ENOMEM;
 		}
-		fep->rx_skbuff[i] = skb;
+		fep->rx_page[i] = page;
+		fep->rx_page_off[i] = 0;
 
-		bdp->cbd_bufaddr = dma_map_single(&fep->pdev->dev, skb->data,
+		bdp->cbd_bufaddr = dma_map_page(&fep->pdev->dev, page, 0,
 				FEC_ENET_RX_FRSIZE, DMA_FROM_DEVICE);
 		bdp->cbd_sc = BD_ENET_RX_EMPTY;
 		bdp++;
@@ -1213,18 +1628,8 @@ static int fec_enet_alloc_buffers(struct net_device *ndev)
 	bdp--;
 	bdp->cbd_sc |= BD_SC_WRAP;
 
-	bdp = fep->tx_bd_base;
-	for (i = 0; i < TX_RING_SIZE; i++) {
-		fep->tx_bounce[i] = kmalloc(FEC_ENET_TX_FRSIZE, GFP_KERNEL);
-
-		bdp->cbd_sc = 0;
-		bdp->cbd_bufaddr = 0;
-		bdp++;
-	}
-
-	/* Set the last buffer to wrap. */
-	bdp--;
-	bdp->cbd_sc |= BD_SC_WRAP;
+	/* TX bounce buffers are allocated when first needed */
+	fec_enet_tx_ring_reset(ndev);
 
 	return 0;
 }
@@ -1249,6 +1654,7 @@ fec_enet_open(struct net_device *ndev)
 		fec_enet_free_buffers(ndev);
 		return ret;
 	}
+	napi_enable(&fep->napi);
 	phy_start(fep->phy_dev);
 	netif_start_queue(ndev);
 	fep->opened = 1;
@@ -1263,6 +1669,8 @@ fec_enet_close(struct net_device *ndev)
 	/* Don't know what to do yet. */
 	fep->opened = 0;
 	netif_stop_queue(ndev);
+	napi_disable(&fep->napi);
+	hrtimer_cancel(&fep->coal_timer);
 	fec_stop(ndev);
 
 	if (fep->phy_dev) {
@@ -1415,6 +1823,8 @@ static const struct net_device_ops fec_netdev_ops = {
 static int fec_enet_init(struct net_device *ndev)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
+	const struct platform_device_id *id_entry =
+				platform_get_device_id(fep->pdev);
 	struct bufdesc *cbd_base;
 	struct bufdesc *bdp;
 	int i;
@@ -1443,6 +1853,26 @@ static int fec_enet_init(struct net_device *ndev)
 	ndev->netdev_ops = &fec_netdev_ops;
 	ndev->ethtool_ops = &fec_enet_ethtool_ops;
 
+	/* Paged frames need software checksumming (see start_xmit) and
+	 * cannot be used when every frame has to be byte swapped.
+	 */
+	if (!(id_entry->driver_data & FEC_QUIRK_SWAP_FRAME)) {
+		ndev->hw_features = NETIF_F_SG | NETIF_F_HW_CSUM;
+		ndev->features |= ndev->hw_features;
+	}
+
+	fep->tx_ring_size = clamp_t(int, tx_ring_size, FEC_TX_RING_MIN,
+				    FEC_TX_RING_MAX);
+	fep->tx_ring_size = rounddown_pow_of_two(fep->tx_ring_size);
+
+	if (napi_weight <= 0)
+		napi_weight = FEC_NAPI_WEIGHT;
+	netif_napi_add(ndev, &fep->napi, fec_enet_rx_napi, napi_weight);
+
+	hrtimer_init(&fep->coal_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	fep->coal_timer.function = fec_enet_coal_timer;
+	fep->coal_frames = 1;
+
 	/* Initialize the receive buffer descriptors. */
 	bdp = fep->rx_bd_base;
 	for (i = 0; i < RX_RING_SIZE; i++) {
@@ -1458,7 +1888,7 @@ static int fec_enet_init(struct net_device *ndev)
 
 	/* ...and the same for transmit */
 	bdp = fep->tx_bd_base;
-	for (i = 0; i < TX_RING_SIZE; i++) {
+	for (i = 0; i < FEC_TX_RING_MAX; i++) {
 
 		/* Initialize the BD for every fragment in the page. */
 		bdp->cbd_sc = 0;
@@ -1467,7 +1897,7 @@ static int fec_enet_init(struct net_device *ndev)
 	}
 
 	/* Set the last buffer to wrap */
-	bdp--;
+	bdp = fep->tx_bd_base + fep->tx_ring_size - 1;
 	bdp->cbd_sc |= BD_SC_WRAP;
 
 	fec_restart(ndev, 0);
@@ -21,6 +21,8 @@
 #include <linux/clk.h>
 #include <linux/completion.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/err.h>
 #include <linux/gpio.h>
 #include <linux/init.h>
@@ -30,6 +32,7 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/spi/spi.h>
 #include <linux/spi/spi_bitbang.h>
@@ -38,10 +41,26 @@
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 
+#include <mach/dma.h>
 #include <mach/spi.h>
 
 #define DRIVER_NAME "spi_imx"
 
+/*
+ * Transfers shorter than this are done by PIO, the SDMA setup costs more
+ * than the few FIFO interrupts it would save.
+ */
+#define SPI_IMX_DMA_MIN_BYTES	64
+/* words per DMA request, the FIFO is 8 words deep */
+#define SPI_IMX_DMA_BURST	4
+/* the SDMA buffer descriptors take at most 0xffff bytes each */
+#define SPI_IMX_DMA_SEG_SIZE	SZ_32K
+
+static unsigned int dma_min_bytes = SPI_IMX_DMA_MIN_BYTES;
+module_param(dma_min_bytes, uint, 0644);
+MODULE_PARM_DESC(dma_min_bytes,
+		"Minimum transfer length in bytes to use DMA (0 disables DMA)");
+
 #define MXC_CSPIRXDATA		0x00
 #define MXC_CSPITXDATA		0x04
 #define MXC_CSPICTRL		0x08
@@ -95,6 +114,16 @@ struct spi_imx_data {
 	const void *tx_buf;
 	unsigned int txfifo; /* number of words pushed in tx FIFO */
 
+	/* DMA */
+	resource_size_t phys;
+	struct dma_chan *dma_rx;
+	struct dma_chan *dma_tx;
+	struct imx_dma_data dma_data_rx;
+	struct imx_dma_data dma_data_tx;
+	unsigned int dma_width;	/* bus width the channels are set up for */
+	unsigned int bytes_per_word;
+	unsigned int speed_hz;
+
 	struct spi_imx_devtype_data *devtype_data;
 	int chipselect[0];
 };
@@ -315,6 +344,7 @@ static void __maybe_unused mx51_ecspi_reset(struct spi_imx_data *spi_imx)
 #define MX31_CSPICTRL_ENABLE	(1 << 0)
 #define MX31_CSPICTRL_MASTER	(1 << 1)
 #define MX31_CSPICTRL_XCH	(1 << 2)
+#define MX31_CSPICTRL_SMC	(1 << 3)
 #define MX31_CSPICTRL_POL	(1 << 4)
 #define MX31_CSPICTRL_PHA	(1 << 5)
 #define MX31_CSPICTRL_SSCTL	(1 << 6)
@@ -325,6 +355,10 @@ static void __maybe_unused mx51_ecspi_reset(struct spi_imx_data *spi_imx)
 #define MX35_CSPICTRL_CS_SHIFT	12
 #define MX31_CSPICTRL_DR_SHIFT	16
 
+#define MX31_CSPIDMA		0x10
+#define MX31_DMAREG_THDEN	(1 << 1)
+#define MX31_DMAREG_RHDEN	(1 << 4)
+
 #define MX31_CSPISTATUS		0x14
 #define MX31_STATUS_RR		(1 << 3)
 
@@ -671,6 +705,263 @@ static irqreturn_t spi_imx_isr(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
+static bool spi_imx_dma_filter(struct dma_chan *chan, void *param)
+{
+	if (!imx_dma_is_general_purpose(chan))
+		return false;
+
+	chan->private = param;
+
+	return true;
+}
+
+static int spi_imx_dma_configure(struct spi_imx_data *spi_imx,
+		unsigned int bytes_per_word)
+{
+	struct dma_slave_config rx = {}, tx = {};
+	int ret;
+
+	rx.direction = DMA_FROM_DEVICE;
+	rx.src_addr = spi_imx->phys + MXC_CSPIRXDATA;
+	rx.src_addr_width = bytes_per_word;
+	rx.src_maxburst = SPI_IMX_DMA_BURST;
+
+	tx.direction = DMA_TO_DEVICE;
+	tx.dst_addr = spi_imx->phys + MXC_CSPITXDATA;
+	tx.dst_addr_width = bytes_per_word;
+	tx.dst_maxburst = SPI_IMX_DMA_BURST;
+
+	spi_imx->dma_width = 0;
+
+	ret = dmaengine_slave_config(spi_imx->dma_rx, &rx);
+	if (ret)
+		return ret;
+
+	ret = dmaengine_slave_config(spi_imx->dma_tx, &tx);
+	if (ret)
+		return ret;
+
+	spi_imx->dma_width = bytes_per_word;
+
+	return 0;
+}
+
+static void spi_imx_dma_release(struct spi_imx_data *spi_imx)
+{
+	if (spi_imx->dma_rx) {
+		dma_release_channel(spi_imx->dma_rx);
+		spi_imx->dma_rx = NULL;
+	}
+	if (spi_imx->dma_tx) {
+		dma_release_channel(spi_imx->dma_tx);
+		spi_imx->dma_tx = NULL;
+	}
+}
+
+static void __devinit spi_imx_dma_request(struct spi_imx_data *spi_imx,
+		struct platform_device *pdev)
+{
+	struct resource *res_rx, *res_tx;
+	dma_cap_mask_t mask;
+
+	/* only the i.MX35 type CSPI has the DMA request logic wired up */
+	if (!is_imx35_cspi(spi_imx))
+		return;
+
+	res_rx = platform_get_resource_byname(pdev, IORESOURCE_DMA, "rx");
+	res_tx = platform_get_resource_byname(pdev, IORESOURCE_DMA, "tx");
+	if (!res_rx || !res_tx)
+		return;
+
+	spi_imx->dma_data_rx.dma_request = res_rx->start;
+	spi_imx->dma_data_rx.peripheral_type = IMX_DMATYPE_CSPI;
+	spi_imx->dma_data_rx.priority = DMA_PRIO_HIGH;
+
+	spi_imx->dma_data_tx.dma_request = res_tx->start;
+	spi_imx->dma_data_tx.peripheral_type = IMX_DMATYPE_CSPI;
+	spi_imx->dma_data_tx.priority = DMA_PRIO_HIGH;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_SLAVE, mask);
+
+	spi_imx->dma_rx = dma_request_channel(mask, spi_imx_dma_filter,
+			&spi_imx->dma_data_rx);
+	spi_imx->dma_tx = dma_request_channel(mask, spi_imx_dma_filter,
+			&spi_imx->dma_data_tx);
+	if (!spi_imx->dma_rx || !spi_imx->dma_tx)
+		goto out_release;
+
+	if (spi_imx_dma_configure(spi_imx, 1))
+		goto out_release;
+
+	dev_info(&pdev->dev, "using DMA for transfers >= %u bytes\n",
+			dma_min_bytes);
+
+	return;
+
+out_release:
+	spi_imx_dma_release(spi_imx);
+	dev_info(&pdev->dev, "dma not available. Using PIO\n");
+}
+
+static int spi_imx_can_dma(struct spi_imx_data *spi_imx,
+		struct spi_transfer *transfer)
+{
+	if (!spi_imx->dma_rx || spi_imx->dma_width != spi_imx->bytes_per_word)
+		return 0;
+
+	if (!dma_min_bytes || transfer->len < dma_min_bytes)
+		return 0;
+
+	if (transfer->len < SPI_IMX_DMA_BURST * spi_imx->bytes_per_word)
+		return 0;
+
+	/* dma_map_sg() needs lowmem buffers */
+	if ((transfer->tx_buf && is_vmalloc_addr(transfer->tx_buf)) ||
+	    (transfer->rx_buf && is_vmalloc_addr(transfer->rx_buf)))
+		return 0;
+
+	return 1;
+}
+
+static int spi_imx_dma_map(struct spi_imx_data *spi_imx, struct sg_table *sgt,
+		void *buf, unsigned int len, enum dma_data_direction dir)
+{
+	struct scatterlist *sg;
+	unsigned int nents = DIV_ROUND_UP(len, SPI_IMX_DMA_SEG_SIZE);
+	int i, ret;
+
+	ret = sg_alloc_table(sgt, nents, GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	for_each_sg(sgt->sgl, sg, nents, i) {
+		unsigned int seg = min_t(unsigned int, len, SPI_IMX_DMA_SEG_SIZE);
+
+		sg_set_buf(sg, buf, seg);
+		buf += seg;
+		len -= seg;
+	}
+
+	if (dma_map_sg(spi_imx->dma_rx->device->dev, sgt->sgl, nents, dir) !=
+			nents) {
+		sg_free_table(sgt);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void spi_imx_dma_unmap(struct spi_imx_data *spi_imx,
+		struct sg_table *sgt, enum dma_data_direction dir)
+{
+	dma_unmap_sg(spi_imx->dma_rx->device->dev, sgt->sgl, sgt->nents, dir);
+	sg_free_table(sgt);
+}
+
+static void spi_imx_dma_rx_callback(void *data)
+{
+	struct spi_imx_data *spi_imx = data;
+
+	complete(&spi_imx->xfer_done);
+}
+
+/*
+ * Runs the first len bytes of the transfer through SDMA. Returns the number
+ * of bytes transferred, 0 if the DMA could not be set up and the caller
+ * should fall back to PIO, or a negative error code.
+ */
+static int spi_imx_dma_transfer(struct spi_imx_data *spi_imx,
+		struct spi_transfer *transfer, unsigned int len)
+{
+	struct dma_async_tx_descriptor *desc_rx, *desc_tx;
+	struct sg_table sgt_rx, sgt_tx;
+	void *rx_buf = transfer->rx_buf;
+	void *tx_buf = (void *)transfer->tx_buf;
+	void *dummy = NULL;
+	unsigned long timeout;
+	unsigned int ctrl;
+	int ret = 0;
+
+	/* the CSPI is full duplex, both channels always have to run */
+	if (!rx_buf || !tx_buf) {
+		dummy = kzalloc(len, GFP_KERNEL);
+		if (!dummy)
+			return 0;
+		if (!rx_buf)
+			rx_buf = dummy;
+		if (!tx_buf)
+			tx_buf = dummy;
+	}
+
+	if (spi_imx_dma_map(spi_imx, &sgt_rx, rx_buf, len, DMA_FROM_DEVICE))
+		goto out_free;
+	if (spi_imx_dma_map(spi_imx, &sgt_tx, tx_buf, len, DMA_TO_DEVICE))
+		goto out_unmap_rx;
+
+	desc_rx = spi_imx->dma_rx->device->device_prep_slave_sg(spi_imx->dma_rx,
+			sgt_rx.sgl, sgt_rx.nents, DMA_FROM_DEVICE,
+			DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc_rx)
+		goto out_unmap_tx;
+
+	desc_tx = spi_imx->dma_tx->device->device_prep_slave_sg(spi_imx->dma_tx,
+			sgt_tx.sgl, sgt_tx.nents, DMA_TO_DEVICE,
+			DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc_tx) {
+		dmaengine_terminate_all(spi_imx->dma_rx);
+		goto out_unmap_tx;
+	}
+
+	init_completion(&spi_imx->xfer_done);
+
+	desc_rx->callback = spi_imx_dma_rx_callback;
+	desc_rx->callback_param = spi_imx;
+	dmaengine_submit(desc_rx);
+	dmaengine_submit(desc_tx);
+
+	/*
+	 * Start the exchange as soon as the TX FIFO has data, the TX DMA
+	 * keeps it topped up so there is no need to trigger by hand.
+	 */
+	ctrl = readl(spi_imx->base + MXC_CSPICTRL);
+	writel(ctrl | MX31_CSPICTRL_SMC, spi_imx->base + MXC_CSPICTRL);
+	writel(MX31_DMAREG_THDEN | MX31_DMAREG_RHDEN,
+			spi_imx->base + MX31_CSPIDMA);
+
+	dma_async_issue_pending(spi_imx->dma_rx);
+	dma_async_issue_pending(spi_imx->dma_tx);
+
+	/* twice the time on the wire, plus some slack for scheduling */
+	timeout = msecs_to_jiffies(DIV_ROUND_UP(len * 8 * 2,
+			spi_imx->speed_hz / 1000 ? : 1) + 100);
+
+	if (!wait_for_completion_timeout(&spi_imx->xfer_done, timeout)) {
+		dev_err(&spi_imx->bitbang.master->dev,
+				"DMA transfer timed out\n");
+		dmaengine_terminate_all(spi_imx->dma_tx);
+		dmaengine_terminate_all(spi_imx->dma_rx);
+		ret = -ETIMEDOUT;
+	} else {
+		ret = len;
+	}
+
+	writel(0, spi_imx->base + MX31_CSPIDMA);
+	writel(ctrl, spi_imx->base + MXC_CSPICTRL);
+
+	if (ret < 0)
+		spi_imx->devtype_data->reset(spi_imx);
+
+out_unmap_tx:
+	spi_imx_dma_unmap(spi_imx, &sgt_tx, DMA_TO_DEVICE);
+out_unmap_rx:
+	spi_imx_dma_unmap(spi_imx, &sgt_rx, DMA_FROM_DEVICE);
+out_free:
+	kfree(dummy);
+
+	return ret;
+}
+
 static int spi_imx_setupxfer(struct spi_device *spi,
 				 struct spi_transfer *t)
 {
@@ -693,17 +984,25 @@ static int spi_imx_setupxfer(struct spi_device *spi,
 	if (config.bpw <= 8) {
 		spi_imx->rx = spi_imx_buf_rx_u8;
 		spi_imx->tx = spi_imx_buf_tx_u8;
+		spi_imx->bytes_per_word = 1;
 	} else if (config.bpw <= 16) {
 		spi_imx->rx = spi_imx_buf_rx_u16;
 		spi_imx->tx = spi_imx_buf_tx_u16;
+		spi_imx->bytes_per_word = 2;
 	} else if (config.bpw <= 32) {
 		spi_imx->rx = spi_imx_buf_rx_u32;
 		spi_imx->tx = spi_imx_buf_tx_u32;
+		spi_imx->bytes_per_word = 4;
 	} else
 		BUG();
 
+	spi_imx->speed_hz = config.speed_hz;
+
 	spi_imx->devtype_data->config(spi_imx, &config);
 
+	if (spi_imx->dma_rx && spi_imx->dma_width != spi_imx->bytes_per_word)
+		spi_imx_dma_configure(spi_imx, spi_imx->bytes_per_word);
+
 	return 0;
 }
 
@@ -711,10 +1010,29 @@ static int spi_imx_transfer(struct spi_device *spi,
 				struct spi_transfer *transfer)
 {
 	struct spi_imx_data *spi_imx = spi_master_get_devdata(spi->master);
+	unsigned int done = 0;
+
+	if (spi_imx_can_dma(spi_imx, transfer)) {
+		unsigned int chunk = SPI_IMX_DMA_BURST * spi_imx->bytes_per_word;
+		int ret;
 
-	spi_imx->tx_buf = transfer->tx_buf;
-	spi_imx->rx_buf = transfer->rx_buf;
-	spi_imx->count = transfer->len;
+		/*
+		 * The CSPI only requests RX DMA once a full burst is in the
+		 * FIFO, so DMA the whole bursts and leave the tail to PIO.
+		 */
+		ret = spi_imx_dma_transfer(spi_imx, transfer,
+				transfer->len / chunk * chunk);
+		if (ret < 0)
+			return ret;
+		done = ret;
+	}
+
+	if (done == transfer->len)
+		return transfer->len;
+
+	spi_imx->tx_buf = transfer->tx_buf ? transfer->tx_buf + done : NULL;
+	spi_imx->rx_buf = transfer->rx_buf ? transfer->rx_buf + done : NULL;
+	spi_imx->count = transfer->len - done;
 	spi_imx->txfifo = 0;
 
 	init_completion(&spi_imx->xfer_done);
@@ -833,6 +1151,7 @@ static int __devinit spi_imx_probe(struct platform_device *pdev)
 		ret = -EINVAL;
 		goto out_release_mem;
 	}
+	spi_imx->phys = res->start;
 
 	spi_imx->irq = platform_get_irq(pdev, 0);
 	if (spi_imx->irq < 0) {
@@ -860,18 +1179,21 @@ static int __devinit spi_imx_probe(struct platform_device *pdev)
 
 	spi_imx->devtype_data->intctrl(spi_imx, 0);
 
+	spi_imx_dma_request(spi_imx, pdev);
+
 	master->dev.of_node = pdev->dev.of_node;
 	ret = spi_bitbang_start(&spi_imx->bitbang);
 	if (ret) {
 		dev_err(&pdev->dev, "bitbang start failed with %d\n", ret);
-		goto out_clk_put;
+		goto out_dma_release;
 	}
 
 	dev_info(&pdev->dev, "probed\n");
 
 	return ret;
 
-out_clk_put:
+out_dma_release:
+	spi_imx_dma_release(spi_imx);
 	clk_disable(spi_imx->clk);
 	clk_put(spi_imx->clk);
 out_free_irq:
@@ -900,6 +1222,8 @@ static int __devexit spi_imx_remove(struct platform_device *pdev)
 
 	spi_bitbang_stop(&spi_imx->bitbang);
 
+	spi_imx_dma_release(spi_imx);
+
 	writel(0, spi_imx->base + MXC_CSPICTRL);
 	clk_disable(spi_imx->clk);
 	clk_put(spi_imx->clk);
@@ -47,9 +47,13 @@
 #include <linux/slab.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/scatterlist.h>
 
 #include <asm/io.h>
 #include <asm/irq.h>
+#include <mach/dma.h>
 #include <mach/imx-uart.h>
 
 /* Register definitions */
@@ -90,6 +94,7 @@
 #define  UCR1_SNDBRK     (1<<4)	 /* Send break */
 #define  UCR1_TDMAEN     (1<<3)	 /* Transmitter ready DMA enable */
 #define  IMX1_UCR1_UARTCLKEN  (1<<2)  /* UART clock enabled, i.mx1 only */
+#define  IMX21_UCR1_ATDMAEN   (1<<2)  /* Aging DMA timer enable */
 #define  UCR1_DOZE       (1<<1)	 /* Doze */
 #define  UCR1_UARTEN     (1<<0)	 /* UART enabled */
 #define  UCR2_ESCI     	 (1<<15) /* Escape seq interrupt enable */
@@ -102,6 +107,7 @@
 #define  UCR2_STPB       (1<<6)	 /* Stop */
 #define  UCR2_WS         (1<<5)	 /* Word size */
 #define  UCR2_RTSEN      (1<<4)	 /* Request to send interrupt enable */
+#define  UCR2_ATEN       (1<<3)	 /* Aging timer enable */
 #define  UCR2_TXEN       (1<<2)	 /* Transmitter enabled */
 #define  UCR2_RXEN       (1<<1)	 /* Receiver enabled */
 #define  UCR2_SRST 	 (1<<0)	 /* SW reset */
@@ -182,6 +188,9 @@
 
 #define UART_NR 8
 
+/* RX DMA buffer, closed early by the SDMA script when the line goes idle */
+#define IMX_RXBUF_SIZE	PAGE_SIZE
+
 /* i.mx21 type uart runs on all i.mx except i.mx1 */
 enum imx_uart_type {
 	IMX1_UART,
@@ -206,6 +215,19 @@ struct imx_port {
 	unsigned short		trcv_delay; /* transceiver delay */
 	struct clk		*clk;
 	struct imx_uart_data	*devdata;
+
+	/* DMA fields */
+	unsigned int		dma_is_enabled:1;
+	unsigned int		dma_is_rxing:1;
+	unsigned int		dma_is_txing:1;
+	struct dma_chan		*dma_chan_rx, *dma_chan_tx;
+	struct imx_dma_data	dma_data_rx, dma_data_tx;
+	struct scatterlist	rx_sgl, tx_sgl[2];
+	void			*rx_buf;
+	dma_addr_t		rx_dma;
+	dma_cookie_t		rx_cookie;
+	unsigned int		tx_bytes;
+	unsigned int		dma_tx_nents;
 };
 
 #ifdef CONFIG_IRDA
@@ -260,6 +282,11 @@ static inline int is_imx21_uart(struct imx_port *sport)
 	return sport->devdata->devtype == IMX21_UART;
 }
 
+static inline int imx_is_console(struct imx_port *sport)
+{
+	return sport->port.cons && sport->port.cons->index == sport->port.line;
+}
+
 /*
  * Handle any change of modem status signal since we were last called.
  */
@@ -313,6 +340,17 @@ static void imx_stop_tx(struct uart_port *port)
 	struct imx_port *sport = (struct imx_port *)port;
 	unsigned long temp;
 
+	/*
+	 * Pause a running TX DMA by taking away its request line. The
+	 * transfer resumes where it stopped in imx_start_tx(), xmit->tail
+	 * only moves on completion, so nothing gets lost or sent twice.
+	 */
+	if (sport->dma_is_enabled) {
+		temp = readl(sport->port.membase + UCR1);
+		writel(temp & ~UCR1_TDMAEN, sport->port.membase + UCR1);
+		return;
+	}
+
 	if (USE_IRDA(sport)) {
 		/* half duplex - wait for end of transmission */
 		int n = 256;
@@ -402,6 +440,88 @@ static inline void imx_transmit_buffer(struct imx_port *sport)
 		imx_stop_tx(&sport->port);
 }
 
+static void imx_dma_tx(struct imx_port *sport);
+
+static void imx_dma_tx_callback(void *data)
+{
+	struct imx_port *sport = data;
+	struct circ_buf *xmit = &sport->port.state->xmit;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sport->port.lock, flags);
+
+	/* imx_flush_buffer() may have cancelled the transfer meanwhile */
+	if (!sport->dma_is_txing)
+		goto out;
+
+	dma_unmap_sg(sport->dma_chan_tx->device->dev, sport->tx_sgl,
+			sport->dma_tx_nents, DMA_TO_DEVICE);
+
+	xmit->tail = (xmit->tail + sport->tx_bytes) & (UART_XMIT_SIZE - 1);
+	sport->port.icount.tx += sport->tx_bytes;
+	sport->dma_is_txing = 0;
+
+	if (uart_circ_chars_pending(xmit) < WAKEUP_CHARS)
+		uart_write_wakeup(&sport->port);
+
+	if (!uart_circ_empty(xmit) && !uart_tx_stopped(&sport->port))
+		imx_dma_tx(sport);
+out:
+	spin_unlock_irqrestore(&sport->port.lock, flags);
+}
+
+/*
+ * Hand everything pending in the circ buffer to the TX DMA, using two
+ * sg entries if it wraps. Called with the port lock held.
+ */
+static void imx_dma_tx(struct imx_port *sport)
+{
+	struct circ_buf *xmit = &sport->port.state->xmit;
+	struct scatterlist *sgl = sport->tx_sgl;
+	struct dma_chan *chan = sport->dma_chan_tx;
+	struct dma_async_tx_descriptor *desc;
+
+	if (sport->dma_is_txing || uart_circ_empty(xmit))
+		return;
+
+	sport->tx_bytes = uart_circ_chars_pending(xmit);
+
+	if (xmit->tail < xmit->head || xmit->head == 0) {
+		/* contiguous, or wrapping exactly at the end of the buffer */
+		sport->dma_tx_nents = 1;
+		sg_init_one(sgl, xmit->buf + xmit->tail, sport->tx_bytes);
+	} else {
+		sport->dma_tx_nents = 2;
+		sg_init_table(sgl, 2);
+		sg_set_buf(sgl, xmit->buf + xmit->tail,
+				UART_XMIT_SIZE - xmit->tail);
+		sg_set_buf(sgl + 1, xmit->buf, xmit->head);
+	}
+
+	if (!dma_map_sg(chan->device->dev, sgl, sport->dma_tx_nents,
+				DMA_TO_DEVICE)) {
+		dev_err(sport->port.dev, "DMA mapping error for TX\n");
+		return;
+	}
+
+	desc = chan->device->device_prep_slave_sg(chan, sgl,
+			sport->dma_tx_nents, DMA_TO_DEVICE,
+			DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc) {
+		dma_unmap_sg(chan->device->dev, sgl, sport->dma_tx_nents,
+				DMA_TO_DEVICE);
+		dev_err(sport->port.dev, "cannot prepare TX DMA\n");
+		return;
+	}
+
+	desc->callback = imx_dma_tx_callback;
+	desc->callback_param = sport;
+
+	sport->dma_is_txing = 1;
+	dmaengine_submit(desc);
+	dma_async_issue_pending(chan);
+}
+
 /*
  * interrupts disabled on entry
  */
@@ -410,6 +530,22 @@ static void imx_start_tx(struct uart_port *port)
 	struct imx_port *sport = (struct imx_port *)port;
 	unsigned long temp;
 
+	if (sport->dma_is_enabled) {
+		if (port->x_char && !(readl(sport->port.membase +
+					uts_reg(sport)) & UTS_TXFULL)) {
+			writel(port->x_char, sport->port.membase + URTX0);
+			port->icount.tx++;
+			port->x_char = 0;
+		}
+		/* also called to send x_char while stopped */
+		if (uart_tx_stopped(port))
+			return;
+		temp = readl(sport->port.membase + UCR1);
+		writel(temp | UCR1_TDMAEN, sport->port.membase + UCR1);
+		imx_dma_tx(sport);
+		return;
+	}
+
 	if (USE_IRDA(sport)) {
 		/* half duplex in IrDA mode; have to disable receive mode */
 		temp = readl(sport->port.membase + UCR4);
@@ -550,6 +686,82 @@ out:
 	return IRQ_HANDLED;
 }
 
+static void imx_dma_rx(struct imx_port *sport);
+
+/*
+ * Called when the RX buffer is full or, through the uart_2_mcu script,
+ * when the aging timer expired with less data than the watermark in the
+ * FIFO. The residue tells how much actually arrived.
+ */
+static void imx_dma_rx_callback(void *data)
+{
+	struct imx_port *sport = data;
+	struct dma_chan *chan = sport->dma_chan_rx;
+	struct tty_struct *tty = sport->port.state->port.tty;
+	struct dma_tx_state state;
+	unsigned long flags;
+	unsigned int count = 0;
+
+	spin_lock_irqsave(&sport->port.lock, flags);
+
+	if (!sport->dma_is_rxing)
+		goto out;
+
+	chan->device->device_tx_status(chan, sport->rx_cookie, &state);
+	count = IMX_RXBUF_SIZE - state.residue;
+
+	dma_sync_single_for_cpu(chan->device->dev, sport->rx_dma,
+			IMX_RXBUF_SIZE, DMA_FROM_DEVICE);
+
+	if (count) {
+		tty_insert_flip_string(tty, sport->rx_buf, count);
+		sport->port.icount.rx += count;
+	}
+
+	imx_dma_rx(sport);
+out:
+	spin_unlock_irqrestore(&sport->port.lock, flags);
+
+	if (count)
+		tty_flip_buffer_push(tty);
+}
+
+/*
+ * (Re)arm the RX DMA. Called with the port lock held. If that fails, go
+ * back to interrupt driven receive rather than leave the port deaf.
+ */
+static void imx_dma_rx(struct imx_port *sport)
+{
+	struct dma_chan *chan = sport->dma_chan_rx;
+	struct dma_async_tx_descriptor *desc;
+	unsigned long temp;
+
+	sg_init_one(&sport->rx_sgl, sport->rx_buf, IMX_RXBUF_SIZE);
+	sg_dma_address(&sport->rx_sgl) = sport->rx_dma;
+
+	dma_sync_single_for_device(chan->device->dev, sport->rx_dma,
+			IMX_RXBUF_SIZE, DMA_FROM_DEVICE);
+
+	desc = chan->device->device_prep_slave_sg(chan, &sport->rx_sgl, 1,
+			DMA_FROM_DEVICE, DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc) {
+		dev_err(sport->port.dev, "cannot prepare RX DMA, using PIO\n");
+		sport->dma_is_rxing = 0;
+
+		temp = readl(sport->port.membase + UCR1);
+		temp &= ~(UCR1_RDMAEN | IMX21_UCR1_ATDMAEN);
+		writel(temp | UCR1_RRDYEN, sport->port.membase + UCR1);
+		return;
+	}
+
+	desc->callback = imx_dma_rx_callback;
+	desc->callback_param = sport;
+
+	sport->dma_is_rxing = 1;
+	sport->rx_cookie = dmaengine_submit(desc);
+	dma_async_issue_pending(chan);
+}
+
 static irqreturn_t imx_int(int irq, void *dev_id)
 {
 	struct imx_port *sport = dev_id;
@@ -557,7 +769,7 @@ static irqreturn_t imx_int(int irq, void *dev_id)
 
 	sts = readl(sport->port.membase + USR1);
 
-	if (sts & USR1_RRDY)
+	if (sts & USR1_RRDY && !sport->dma_is_rxing)
 		imx_rxint(irq, dev_id);
 
 	if (sts & USR1_TRDY &&
@@ -577,9 +789,28 @@ static unsigned int imx_tx_empty(struct uart_port *port)
 {
 	struct imx_port *sport = (struct imx_port *)port;
 
+	if (sport->dma_is_txing)
+		return 0;
+
 	return (readl(sport->port.membase + USR2) & USR2_TXDC) ?  TIOCSER_TEMT : 0;
 }
 
+/*
+ * Interrupts always disabled.
+ */
+static void imx_flush_buffer(struct uart_port *port)
+{
+	struct imx_port *sport = (struct imx_port *)port;
+
+	if (!sport->dma_is_txing)
+		return;
+
+	dmaengine_terminate_all(sport->dma_chan_tx);
+	dma_unmap_sg(sport->dma_chan_tx->device->dev, sport->tx_sgl,
+			sport->dma_tx_nents, DMA_TO_DEVICE);
+	sport->dma_is_txing = 0;
+}
+
 /*
  * We have a modem side uart, so the meanings of RTS and CTS are inverted.
  */
@@ -632,6 +863,8 @@ static void imx_break_ctl(struct uart_port *port, int break_state)
 
 #define TXTL 2 /* reset default */
 #define RXTL 1 /* reset default */
+#define TXTL_DMA 16 /* half the FIFO, also the DMA burst */
+#define RXTL_DMA 16
 
 static int imx_setup_ufcr(struct imx_port *sport, unsigned int mode)
 {
@@ -639,7 +872,10 @@ static int imx_setup_ufcr(struct imx_port *sport, unsigned int mode)
 
 	/* set receiver / transmitter trigger level */
 	val = readl(sport->port.membase + UFCR) & (UFCR_RFDIV | UFCR_DCEDTE);
-	val |= TXTL << UFCR_TXTL_SHF | RXTL;
+	if (sport->dma_is_enabled)
+		val |= TXTL_DMA << UFCR_TXTL_SHF | RXTL_DMA;
+	else
+		val |= TXTL << UFCR_TXTL_SHF | RXTL;
 	writel(val, sport->port.membase + UFCR);
 	return 0;
 }
@@ -653,6 +889,9 @@ static int imx_startup(struct uart_port *port)
 	int retval;
 	unsigned long flags, temp;
 
+	/* the console writes by polling, keep it off the DMA */
+	sport->dma_is_enabled = sport->dma_chan_rx && !imx_is_console(sport);
+
 	imx_setup_ufcr(sport, 0);
 
 	/* disable the DREN bit (Data Ready interrupt enable) before
@@ -729,10 +968,18 @@ static int imx_startup(struct uart_port *port)
 		temp &= ~(UCR1_RTSDEN);
 	}
 
+	if (sport->dma_is_enabled) {
+		temp &= ~UCR1_RRDYEN;
+		temp |= UCR1_RDMAEN | UCR1_TDMAEN | IMX21_UCR1_ATDMAEN;
+	}
+
 	writel(temp, sport->port.membase + UCR1);
 
 	temp = readl(sport->port.membase + UCR2);
 	temp |= (UCR2_RXEN | UCR2_TXEN);
+	/* the aging timer hands data below the RX watermark to the DMA */
+	if (sport->dma_is_enabled)
+		temp |= UCR2_ATEN;
 	writel(temp, sport->port.membase + UCR2);
 
 	if (USE_IRDA(sport)) {
@@ -766,6 +1013,9 @@ static int imx_startup(struct uart_port *port)
 		writel(temp, sport->port.membase + UCR3);
 	}
 
+	if (sport->dma_is_enabled)
+		imx_dma_rx(sport);
+
 	/*
 	 * Enable modem status interrupts
 	 */
@@ -804,6 +1054,12 @@ static void imx_shutdown(struct uart_port *port)
 	temp = readl(sport->port.membase + UCR2);
 	temp &= ~(UCR2_TXEN);
 	writel(temp, sport->port.membase + UCR2);
+
+	if (sport->dma_is_enabled) {
+		sport->dma_is_rxing = 0;
+		dmaengine_terminate_all(sport->dma_chan_rx);
+		imx_flush_buffer(&sport->port);
+	}
 	spin_unlock_irqrestore(&sport->port.lock, flags);
 
 	if (USE_IRDA(sport)) {
@@ -838,8 +1094,16 @@ static void imx_shutdown(struct uart_port *port)
 	temp &= ~(UCR1_TXMPTYEN | UCR1_RRDYEN | UCR1_RTSDEN | UCR1_UARTEN);
 	if (USE_IRDA(sport))
 		temp &= ~(UCR1_IREN);
+	if (sport->dma_is_enabled)
+		temp &= ~(UCR1_RDMAEN | UCR1_TDMAEN | IMX21_UCR1_ATDMAEN);
 
 	writel(temp, sport->port.membase + UCR1);
+
+	if (sport->dma_is_enabled) {
+		temp = readl(sport->port.membase + UCR2);
+		writel(temp & ~UCR2_ATEN, sport->port.membase + UCR2);
+	}
+	sport->dma_is_enabled = 0;
 	spin_unlock_irqrestore(&sport->port.lock, flags);
 }
 
@@ -947,7 +1211,7 @@ imx_set_termios(struct uart_port *port, struct ktermios *termios,
 	old_txrxen = readl(sport->port.membase + UCR2);
 	writel(old_txrxen & ~( UCR2_TXEN | UCR2_RXEN),
 			sport->port.membase + UCR2);
-	old_txrxen &= (UCR2_TXEN | UCR2_RXEN);
+	old_txrxen &= (UCR2_TXEN | UCR2_RXEN | UCR2_ATEN);
 
 	if (USE_IRDA(sport)) {
 		/*
@@ -1080,6 +1344,7 @@ static struct uart_ops imx_pops = {
 	.get_mctrl	= imx_get_mctrl,
 	.stop_tx	= imx_stop_tx,
 	.start_tx	= imx_start_tx,
+	.flush_buffer	= imx_flush_buffer,
 	.stop_rx	= imx_stop_rx,
 	.enable_ms	= imx_enable_ms,
 	.break_ctl	= imx_break_ctl,
@@ -1341,6 +1606,113 @@ static void serial_imx_probe_pdata(struct imx_port *sport,
 		sport->use_irda = 1;
 }
 
+static bool imx_uart_dma_filter(struct dma_chan *chan, void *param)
+{
+	if (!imx_dma_is_general_purpose(chan))
+		return false;
+
+	chan->private = param;
+
+	return true;
+}
+
+static void imx_uart_dma_exit(struct imx_port *sport)
+{
+	if (sport->rx_buf) {
+		dma_unmap_single(sport->dma_chan_rx->device->dev,
+				sport->rx_dma, IMX_RXBUF_SIZE,
+				DMA_FROM_DEVICE);
+		kfree(sport->rx_buf);
+		sport->rx_buf = NULL;
+	}
+
+	if (sport->dma_chan_rx) {
+		dma_release_channel(sport->dma_chan_rx);
+		sport->dma_chan_rx = NULL;
+	}
+
+	if (sport->dma_chan_tx) {
+		dma_release_channel(sport->dma_chan_tx);
+		sport->dma_chan_tx = NULL;
+	}
+}
+
+/*
+ * Set up SDMA for ports that ask for it in their platform data and have
+ * DMA request lines. Any failure leaves the port interrupt driven.
+ */
+static void imx_uart_dma_init(struct imx_port *sport,
+		struct platform_device *pdev)
+{
+	struct imxuart_platform_data *pdata = pdev->dev.platform_data;
+	struct dma_slave_config slave_config = {};
+	struct resource *res_rx, *res_tx;
+	dma_cap_mask_t mask;
+	void *buf;
+
+	if (!pdata || !(pdata->flags & IMXUART_SDMA) || !is_imx21_uart(sport) ||
+	    USE_IRDA(sport))
+		return;
+
+	res_rx = platform_get_resource_byname(pdev, IORESOURCE_DMA, "rx");
+	res_tx = platform_get_resource_byname(pdev, IORESOURCE_DMA, "tx");
+	if (!res_rx || !res_tx) {
+		dev_info(&pdev->dev, "no DMA request lines, using PIO\n");
+		return;
+	}
+
+	sport->dma_data_rx.dma_request = res_rx->start;
+	sport->dma_data_rx.peripheral_type = IMX_DMATYPE_UART;
+	sport->dma_data_rx.priority = DMA_PRIO_HIGH;
+
+	sport->dma_data_tx.dma_request = res_tx->start;
+	sport->dma_data_tx.peripheral_type = IMX_DMATYPE_UART;
+	sport->dma_data_tx.priority = DMA_PRIO_MEDIUM;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_SLAVE, mask);
+
+	sport->dma_chan_rx = dma_request_channel(mask, imx_uart_dma_filter,
+			&sport->dma_data_rx);
+	sport->dma_chan_tx = dma_request_channel(mask, imx_uart_dma_filter,
+			&sport->dma_data_tx);
+	if (!sport->dma_chan_rx || !sport->dma_chan_tx)
+		goto err;
+
+	slave_config.direction = DMA_FROM_DEVICE;
+	slave_config.src_addr = sport->port.mapbase + URXD0;
+	slave_config.src_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE;
+	slave_config.src_maxburst = RXTL_DMA;
+	if (dmaengine_slave_config(sport->dma_chan_rx, &slave_config))
+		goto err;
+
+	slave_config.direction = DMA_TO_DEVICE;
+	slave_config.dst_addr = sport->port.mapbase + URTX0;
+	slave_config.dst_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE;
+	slave_config.dst_maxburst = TXTL_DMA;
+	if (dmaengine_slave_config(sport->dma_chan_tx, &slave_config))
+		goto err;
+
+	buf = kmalloc(IMX_RXBUF_SIZE, GFP_KERNEL);
+	if (!buf)
+		goto err;
+
+	sport->rx_dma = dma_map_single(sport->dma_chan_rx->device->dev, buf,
+			IMX_RXBUF_SIZE, DMA_FROM_DEVICE);
+	if (dma_mapping_error(sport->dma_chan_rx->device->dev, sport->rx_dma)) {
+		kfree(buf);
+		goto err;
+	}
+	sport->rx_buf = buf;
+
+	dev_info(&pdev->dev, "using SDMA\n");
+
+	return;
+err:
+	imx_uart_dma_exit(sport);
+	dev_info(&pdev->dev, "dma not available. Using PIO\n");
+}
+
 static int serial_imx_probe(struct platform_device *pdev)
 {
 	struct imx_port *sport;
@@ -1394,6 +1766,8 @@ static int serial_imx_probe(struct platform_device *pdev)
 
 	sport->port.uartclk = clk_get_rate(sport->clk);
 
+	imx_uart_dma_init(sport, pdev);
+
 	imx_ports[sport->port.line] = sport;
 
 	pdata = pdev->dev.platform_data;
@@ -1413,6 +1787,7 @@ deinit:
 	if (pdata && pdata->exit)
 		pdata->exit(pdev);
 clkput:
+	imx_uart_dma_exit(sport);
 	clk_put(sport->clk);
 	clk_disable(sport->clk);
 unmap:
@@ -1434,6 +1809,7 @@ static int serial_imx_remove(struct platform_device *pdev)
 
 	if (sport) {
 		uart_remove_one_port(&imx_reg, &sport->port);
+		imx_uart_dma_exit(sport);
 		clk_put(sport->clk);
 	}
 
@@ -34,13 +34,17 @@
  * mode is enabled, it provides good functional coverage for the "USBCV"
  * test harness from USB-IF.
  *
- * Note that because this doesn't queue more than one request at a time,
- * some other function must be used to test queueing logic.  The network
- * link (g_ether) is the best overall option for that, since its TX and RX
+ * By default this doesn't queue more than one request at a time, so some
+ * other function must be used to test queueing logic.  The network link
+ * (g_ether) is the best overall option for that, since its TX and RX
  * queues are relatively independent, will receive a range of packet sizes,
  * and can often be made to run out completely.  Those issues are important
  * when stress testing peripheral controller drivers.
  *
+ * With "ss_qlen" set, that many requests are kept queued on each endpoint
+ * and only the last of each batch asks for a completion interrupt, which
+ * makes this a throughput benchmark for controllers that chain transfers.
+ *
  *
  * This is currently packaged as a configuration driver, which can't be
  * combined with other functions to make composite devices.  However, it
@@ -62,6 +66,11 @@ static unsigned pattern;
 module_param(pattern, uint, 0);
 MODULE_PARM_DESC(pattern, "0 = all zeroes, 1 = mod63 ");
 
+static unsigned ss_qlen = 1;
+module_param(ss_qlen, uint, 0);
+MODULE_PARM_DESC(ss_qlen, "requests queued per endpoint, "
+		"only the last of them interrupts on completion");
+
 /*-------------------------------------------------------------------------*/
 
 static struct usb_interface_descriptor source_sink_intf = {
@@ -348,31 +357,41 @@ static int source_sink_start_ep(struct f_sourcesink *ss, bool is_in)
 {
 	struct usb_ep		*ep;
 	struct usb_request	*req;
-	int			status;
+	int			i, status;
 
 	ep = is_in ? ss->in_ep : ss->out_ep;
-	req = alloc_ep_req(ep);
-	if (!req)
-		return -ENOMEM;
+	for (i = 0; i < max(ss_qlen, 1U); i++) {
+		req = alloc_ep_req(ep);
+		if (!req)
+			return -ENOMEM;
 
-	req->complete = source_sink_complete;
-	if (is_in)
-		reinit_write_data(ep, req);
-	else
-		memset(req->buf, 0x55, req->length);
-
-	status = usb_ep_queue(ep, req, GFP_ATOMIC);
-	if (status) {
-		struct usb_composite_dev	*cdev;
+		req->complete = source_sink_complete;
+		if (is_in)
+			reinit_write_data(ep, req);
+		else
+			memset(req->buf, 0x55, req->length);
 
-		cdev = ss->function.config->cdev;
-		ERROR(cdev, "start %s %s --> %d\n",
-				is_in ? "IN" : "OUT",
-				ep->name, status);
-		free_ep_req(ep, req);
+		/*
+		 * Requests complete in order and are requeued in order, so
+		 * the one interrupt per batch also retires the requests
+		 * queued before it.
+		 */
+		req->no_interrupt = i + 1 < ss_qlen;
+
+		status = usb_ep_queue(ep, req, GFP_ATOMIC);
+		if (status) {
+			struct usb_composite_dev	*cdev;
+
+			cdev = ss->function.config->cdev;
+			ERROR(cdev, "start %s %s --> %d\n",
+					is_in ? "IN" : "OUT",
+					ep->name, status);
+			free_ep_req(ep, req);
+			return status;
+		}
 	}
 
-	return status;
+	return 0;
 }
 
 static void disable_source_sink(struct f_sourcesink *ss)
@@ -40,6 +40,7 @@
 #include <linux/fsl_devices.h>
 #include <linux/dmapool.h>
 #include <linux/delay.h>
+#include <linux/log2.h>
 
 #include <asm/byteorder.h>
 #include <asm/io.h>
@@ -66,6 +67,12 @@ static struct usb_sys_interface *usb_sys_regs;
 /* it is initialized in probe()  */
 static struct fsl_udc *udc_controller = NULL;
 
+/* completions within the threshold share one interrupt */
+static unsigned int itc = 8;
+module_param(itc, uint, S_IRUGO);
+MODULE_PARM_DESC(itc, "interrupt threshold in micro frames: "
+		"0, 1, 2, 4, 8 (default), 16, 32 or 64");
+
 static const struct usb_endpoint_descriptor
 fsl_ep0_desc = {
 	.bLength =		USB_DT_ENDPOINT_SIZE,
@@ -153,6 +160,55 @@ static inline void fsl_set_accessors(struct fsl_usb2_platform_data *pdata) {}
 /********************************************************************
  *	Internal Used Function
 ********************************************************************/
+/*-----------------------------------------------------------------
+ * dTD allocation. Retired dTD chains are kept on a free list in front
+ * of td_pool, so that the hot path is a pointer swap and a whole
+ * request is recycled at once instead of dTD by dTD.
+ *--------------------------------------------------------------*/
+static struct ep_td_struct *fsl_alloc_dtd(struct fsl_udc *udc,
+		dma_addr_t *dma, gfp_t gfp_flags)
+{
+	struct ep_td_struct *dtd;
+	unsigned long flags;
+
+	spin_lock_irqsave(&udc->td_lock, flags);
+	dtd = udc->td_free;
+	if (dtd)
+		udc->td_free = dtd->next_td_virt;
+	spin_unlock_irqrestore(&udc->td_lock, flags);
+
+	if (dtd) {
+		*dma = dtd->td_dma;
+		return dtd;
+	}
+
+	return dma_pool_alloc(udc->td_pool, gfp_flags, dma);
+}
+
+/* Put the chain head .. tail, linked by next_td_virt, on the free list */
+static void fsl_free_dtd_chain(struct fsl_udc *udc,
+		struct ep_td_struct *head, struct ep_td_struct *tail)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&udc->td_lock, flags);
+	tail->next_td_virt = udc->td_free;
+	udc->td_free = head;
+	spin_unlock_irqrestore(&udc->td_lock, flags);
+}
+
+/* Give all dTDs on the free list back to td_pool */
+static void fsl_drain_dtd_free(struct fsl_udc *udc)
+{
+	struct ep_td_struct *dtd;
+
+	while (udc->td_free) {
+		dtd = udc->td_free;
+		udc->td_free = dtd->next_td_virt;
+		dma_pool_free(udc->td_pool, dtd, dtd->td_dma);
+	}
+}
+
 /*-----------------------------------------------------------------
  * done() - retire a request; caller blocked irqs
  * @status : request status to be set, only works when
@@ -162,8 +218,6 @@ static void done(struct fsl_ep *ep, struct fsl_req *req, int status)
 {
 	struct fsl_udc *udc = NULL;
 	unsigned char stopped = ep->stopped;
-	struct ep_td_struct *curr_td, *next_td;
-	int j;
 
 	udc = (struct fsl_udc *)ep->udc;
 	/* Removed the req from fsl_ep->queue */
@@ -176,14 +230,8 @@ static void done(struct fsl_ep *ep, struct fsl_req *req, int status)
 		status = req->req.status;
 
 	/* Free dtd for the request */
-	next_td = req->head;
-	for (j = 0; j < req->dtd_count; j++) {
-		curr_td = next_td;
-		if (j != req->dtd_count - 1) {
-			next_td = curr_td->next_td_virt;
-		}
-		dma_pool_free(udc->td_pool, curr_td, curr_td->td_dma);
-	}
+	if (req->dtd_count)
+		fsl_free_dtd_chain(udc, req->head, req->tail);
 
 	if (req->mapped) {
 		dma_unmap_single(ep->udc->gadget.dev.parent,
@@ -304,6 +352,12 @@ static int dr_controller_setup(struct fsl_udc *udc)
 	/* Clear the setup status */
 	fsl_writel(0, &dr_regs->usbsts);
 
+	/* Interrupt threshold control */
+	tmp = fsl_readl(&dr_regs->usbcmd);
+	tmp &= ~USB_CMD_ITC;
+	tmp |= (itc << USB_CMD_ITC_BIT_POS) & USB_CMD_ITC;
+	fsl_writel(tmp, &dr_regs->usbcmd);
+
 	tmp = udc->ep_qh_dma;
 	tmp &= USB_EP_LIST_ADDRESS_MASK;
 	fsl_writel(tmp, &dr_regs->endpointlistaddr);
@@ -779,7 +833,7 @@ static struct ep_td_struct *fsl_build_dtd(struct fsl_req *req, unsigned *length,
 	*length = min(req->req.length - req->req.actual,
 			(unsigned)EP_MAX_LENGTH_TRANSFER);
 
-	dtd = dma_pool_alloc(udc_controller->td_pool, gfp_flags, dma);
+	dtd = fsl_alloc_dtd(udc_controller, dma, gfp_flags);
 	if (dtd == NULL)
 		return dtd;
 
@@ -839,8 +893,13 @@ static int fsl_req_to_dtd(struct fsl_req *req, gfp_t gfp_flags)
 
 	do {
 		dtd = fsl_build_dtd(req, &count, &dma, &is_last, gfp_flags);
-		if (dtd == NULL)
+		if (dtd == NULL) {
+			if (last_dtd)
+				fsl_free_dtd_chain(udc_controller, req->head,
+						last_dtd);
+			req->dtd_count = 0;
 			return -ENOMEM;
+		}
 
 		if (is_first) {
 			is_first = 0;
@@ -2426,6 +2485,7 @@ static int __init fsl_udc_probe(struct platform_device *pdev)
 	pdata = pdev->dev.platform_data;
 	udc_controller->pdata = pdata;
 	spin_lock_init(&udc_controller->lock);
+	spin_lock_init(&udc_controller->td_lock);
 	udc_controller->stopped = 1;
 
 #ifdef CONFIG_USB_OTG
@@ -2573,6 +2633,18 @@ static int __init fsl_udc_probe(struct platform_device *pdev)
 		goto err_unregister;
 	}
 
+	/* seed the dTD free list, more come from td_pool on demand */
+	for (i = 0; i < DTD_PREALLOC; i++) {
+		struct ep_td_struct *dtd;
+		dma_addr_t dma;
+
+		dtd = dma_pool_alloc(udc_controller->td_pool, GFP_KERNEL, &dma);
+		if (!dtd)
+			break;
+		dtd->td_dma = dma;
+		fsl_free_dtd_chain(udc_controller, dtd, dtd);
+	}
+
 	ret = usb_add_gadget_udc(&pdev->dev, &udc_controller->gadget);
 	if (ret)
 		goto err_del_udc;
@@ -2581,6 +2653,7 @@ static int __init fsl_udc_probe(struct platform_device *pdev)
 	return 0;
 
 err_del_udc:
+	fsl_drain_dtd_free(udc_controller);
 	dma_pool_destroy(udc_controller->td_pool);
 err_unregister:
 	device_unregister(&udc_controller->gadget.dev);
@@ -2627,6 +2700,7 @@ static int __exit fsl_udc_remove(struct platform_device *pdev)
 	kfree(udc_controller->status_req);
 	kfree(udc_controller->eps);
 
+	fsl_drain_dtd_free(udc_controller);
 	dma_pool_destroy(udc_controller->td_pool);
 	free_irq(udc_controller->irq, udc_controller);
 	iounmap(dr_regs);
@@ -2751,6 +2825,10 @@ static struct platform_driver udc_driver = {
 static int __init udc_init(void)
 {
 	printk(KERN_INFO "%s (%s)\n", driver_desc, DRIVER_VERSION);
+	if (itc > 64 || (itc && !is_power_of_2(itc))) {
+		WARNING("invalid itc %u, using 8\n", itc);
+		itc = 8;
+	}
 	return platform_driver_probe(&udc_driver, fsl_udc_probe);
 }
 
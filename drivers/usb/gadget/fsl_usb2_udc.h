@@ -426,6 +426,9 @@ struct ep_td_struct {
 /* Controller dma boundary */
 #define UDC_DMA_BOUNDARY			0x1000
 
+/* DTDs taken from td_pool at probe time to seed the free list */
+#define DTD_PREALLOC				64
+
 /*-------------------------------------------------------------------------*/
 
 /* ### driver private data
@@ -482,6 +485,8 @@ struct fsl_udc {
 	struct ep_queue_head *ep_qh;	/* Endpoints Queue-Head */
 	struct fsl_req *status_req;	/* ep0 status request */
 	struct dma_pool *td_pool;	/* dma pool for DTD */
+	struct ep_td_struct *td_free;	/* recycled DTDs, via next_td_virt */
+	spinlock_t td_lock;		/* protects td_free */
 	enum fsl_usb2_phy_modes phy_mode;
 
 	size_t ep_qh_size;		/* size after alignment adjustment*/
@@ -29,8 +29,13 @@
 #include <linux/clk.h>
 #include <linux/platform_device.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/io.h>
 #include <linux/math64.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#include <asm/cacheflush.h>
 
 #include <mach/imxfb.h>
 #include <mach/hardware.h>
@@ -107,6 +112,9 @@
 #define LCDICR_INT_SYN	(1<<2)
 #define LCDICR_INT_CON	(1)
 
+#define LCDC_LCDIER	0x3C
+#define LCDIER_EOF	(1<<1)
+
 #define LCDC_LCDISR	0x40
 #define LCDISR_UDR_ERR	(1<<3)
 #define LCDISR_ERR_RES	(1<<2)
@@ -116,6 +124,13 @@
 /* Used fb-mode. Can be set on kernel command line, therefore file-static. */
 static const char *fb_mode;
 
+/* Frames for page flipping, overrides the platform data if set. */
+static unsigned int fb_buffers;
+/* Allocate the damage back buffer regardless of the platform data. */
+static int fb_damage;
+
+#define IMXFB_MAX_BUFFERS	4
+
 
 /*
  * These are the bitfields for each
@@ -145,6 +160,29 @@ struct imxfb_info {
 	dma_addr_t		screen_dma;
 	u_int			palette_size;
 
+	/*
+	 * Start address of the scanned out frame. A new address is
+	 * written to the controller at the next end of frame.
+	 */
+	spinlock_t		lock;
+	dma_addr_t		ssa;
+	int			ssa_pending;
+	int			irq;
+	u_int			vsync_count;
+	wait_queue_head_t	vsync_wait;
+
+	/*
+	 * Cached back buffer for damage updates and the memcpy channel
+	 * that copies out of it. Without a channel the CPU copies. It is
+	 * mapped bidirectional, as syncing a DMA_TO_DEVICE mapping for
+	 * the CPU does not invalidate anything.
+	 */
+	void			*back_cpu;
+	dma_addr_t		back_dma;
+	u_int			back_size;
+	struct dma_chan		*dma_chan;
+	struct completion	dma_done;
+
 	dma_addr_t		dbar1;
 	dma_addr_t		dbar2;
 
@@ -303,6 +341,327 @@ static const struct imx_fb_videomode *imxfb_find_mode(struct imxfb_info *fbi)
 	return NULL;
 }
 
+/*
+ * Enable the end of frame interrupt, called with fbi->lock held. While
+ * it was masked LCDISR kept the EOF of some earlier frame, reading it
+ * clears that so the next interrupt really is the next end of frame.
+ * If the interrupt is already enabled a pending EOF is still wanted.
+ */
+static void imxfb_enable_eof(struct imxfb_info *fbi)
+{
+	if (!(readl(fbi->regs + LCDC_LCDIER) & LCDIER_EOF))
+		readl(fbi->regs + LCDC_LCDISR);
+	writel(LCDIER_EOF, fbi->regs + LCDC_LCDIER);
+}
+
+/*
+ * imxfb_set_start():
+ *	Scan out from a new address. While the controller runs the address
+ *	is written at the next end of frame so the switch does not tear.
+ */
+static void imxfb_set_start(struct imxfb_info *fbi, dma_addr_t ssa)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fbi->lock, flags);
+	fbi->ssa = ssa;
+	if (fbi->clk_enabled && fbi->irq >= 0) {
+		fbi->ssa_pending = 1;
+		imxfb_enable_eof(fbi);
+	} else {
+		writel(ssa, fbi->regs + LCDC_SSA);
+	}
+	spin_unlock_irqrestore(&fbi->lock, flags);
+}
+
+static irqreturn_t imxfb_irq_handler(int irq, void *dev_id)
+{
+	struct imxfb_info *fbi = dev_id;
+	u32 status;
+
+	spin_lock(&fbi->lock);
+	/* the status bits are cleared by reading */
+	status = readl(fbi->regs + LCDC_LCDISR);
+	if (status & LCDISR_EOF) {
+		if (fbi->ssa_pending) {
+			writel(fbi->ssa, fbi->regs + LCDC_SSA);
+			fbi->ssa_pending = 0;
+		}
+		fbi->vsync_count++;
+
+		/* no interrupts while nobody flips or waits */
+		writel(0, fbi->regs + LCDC_LCDIER);
+		wake_up_interruptible_all(&fbi->vsync_wait);
+	}
+	spin_unlock(&fbi->lock);
+
+	return IRQ_HANDLED;
+}
+
+static int imxfb_wait_for_vsync(struct imxfb_info *fbi)
+{
+	unsigned long flags;
+	u_int count;
+	int ret;
+
+	spin_lock_irqsave(&fbi->lock, flags);
+	if (!fbi->clk_enabled || fbi->irq < 0) {
+		spin_unlock_irqrestore(&fbi->lock, flags);
+		return -EINVAL;
+	}
+	count = fbi->vsync_count;
+	imxfb_enable_eof(fbi);
+	spin_unlock_irqrestore(&fbi->lock, flags);
+
+	ret = wait_event_interruptible_timeout(fbi->vsync_wait,
+			fbi->vsync_count != count, HZ / 10);
+	if (ret < 0)
+		return ret;
+	if (ret == 0)
+		return -ETIMEDOUT;
+	return 0;
+}
+
+static int imxfb_pan_display(struct fb_var_screeninfo *var,
+			     struct fb_info *info)
+{
+	struct imxfb_info *fbi = info->par;
+
+	if (var->xoffset ||
+	    var->yoffset + info->var.yres > info->var.yres_virtual)
+		return -EINVAL;
+
+	imxfb_set_start(fbi, fbi->screen_dma +
+			var->yoffset * info->fix.line_length);
+	return 0;
+}
+
+static void imxfb_dma_callback(void *param)
+{
+	struct imxfb_info *fbi = param;
+
+	complete(&fbi->dma_done);
+}
+
+/*
+ * imxfb_copy():
+ *	Copy len bytes from the back buffer to video RAM, offsets are
+ *	relative to the start of each.
+ */
+static int imxfb_copy(struct imxfb_info *fbi, u_int dst, u_int src,
+		      size_t len)
+{
+	struct dma_chan *chan = fbi->dma_chan;
+	struct dma_async_tx_descriptor *tx = NULL;
+
+	/* the CPU takes what the channel can not align to */
+	if (chan && is_dma_copy_aligned(chan->device, fbi->screen_dma + dst,
+					fbi->back_dma + src, len))
+		tx = chan->device->device_prep_dma_memcpy(chan,
+				fbi->screen_dma + dst, fbi->back_dma + src,
+				len, DMA_PREP_INTERRUPT | DMA_CTRL_ACK |
+				DMA_COMPL_SKIP_SRC_UNMAP |
+				DMA_COMPL_SKIP_DEST_UNMAP);
+	if (!tx) {
+		/* drop stale lines of the kernel alias before reading it */
+		dma_sync_single_for_cpu(&fbi->pdev->dev, fbi->back_dma + src,
+					len, DMA_BIDIRECTIONAL);
+		memcpy(fbi->screen_cpu + dst, fbi->back_cpu + src, len);
+		return 0;
+	}
+
+	INIT_COMPLETION(fbi->dma_done);
+	tx->callback = imxfb_dma_callback;
+	tx->callback_param = fbi;
+	dmaengine_submit(tx);
+	dma_async_issue_pending(chan);
+
+	if (!wait_for_completion_timeout(&fbi->dma_done,
+					 msecs_to_jiffies(100))) {
+		dmaengine_terminate_all(chan);
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+/*
+ * imxfb_clean_user():
+ *	The caller drew through its own cached mapping of the back buffer,
+ *	which aliases the kernel one on VIVT caches. Write back the part of
+ *	it that covers len bytes at offset off of the back buffer.
+ */
+static void imxfb_clean_user(struct fb_info *info, u_int off, size_t len)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end, voff, vlen;
+
+	if (!mm)
+		return;
+
+	/* the back buffer follows video RAM in the mmap space */
+	off += PAGE_ALIGN(info->fix.smem_len);
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!vma->vm_file || vma->vm_file->private_data != info)
+			continue;
+
+		voff = vma->vm_pgoff << PAGE_SHIFT;
+		vlen = vma->vm_end - vma->vm_start;
+		if (off + len <= voff || off >= voff + vlen)
+			continue;
+
+		start = vma->vm_start + max_t(unsigned long, off, voff) - voff;
+		end = vma->vm_start +
+			min_t(unsigned long, off + len, voff + vlen) - voff;
+		flush_cache_range(vma, start, end);
+	}
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * imxfb_get_dma_chan():
+ *	imxfb is usually built in and probes before the DMA drivers have
+ *	registered, so the memcpy channel is requested on the first damage
+ *	update instead.
+ */
+static void imxfb_get_dma_chan(struct imxfb_info *fbi)
+{
+	dma_cap_mask_t mask;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_MEMCPY, mask);
+	fbi->dma_chan = dma_request_channel(mask, NULL, NULL);
+	if (fbi->dma_chan)
+		dev_info(&fbi->pdev->dev, "damage updates by %s\n",
+			 dma_chan_name(fbi->dma_chan));
+}
+
+static int imxfb_damage(struct fb_info *info, struct imxfb_rect *r)
+{
+	struct imxfb_info *fbi = info->par;
+	struct fb_var_screeninfo *var = &info->var;
+	u_int line = info->fix.line_length;
+	u_int cpp = var->bits_per_pixel / 8;
+	u_int front = fbi->ssa - fbi->screen_dma;
+	u_int src, i;
+	int ret = 0;
+
+	if (!fbi->back_cpu)
+		return -EINVAL;
+	if (!r->width || !r->height ||
+	    r->x >= var->xres || r->width > var->xres - r->x ||
+	    r->y >= var->yres || r->height > var->yres - r->y)
+		return -EINVAL;
+
+	if (!fbi->dma_chan)
+		imxfb_get_dma_chan(fbi);
+
+	src = r->y * line;
+	imxfb_clean_user(info, src, r->height * line);
+	dma_sync_single_for_device(&fbi->pdev->dev, fbi->back_dma + src,
+				   r->height * line, DMA_BIDIRECTIONAL);
+
+	/* wide rectangles go out as one band of whole lines */
+	if (r->width * 2 >= var->xres)
+		return imxfb_copy(fbi, front + src, src, r->height * line);
+
+	src += r->x * cpp;
+	for (i = 0; i < r->height && !ret; i++, src += line)
+		ret = imxfb_copy(fbi, front + src, src, r->width * cpp);
+
+	return ret;
+}
+
+static int imxfb_ioctl(struct fb_info *info, unsigned int cmd,
+		       unsigned long arg)
+{
+	struct imxfb_info *fbi = info->par;
+	struct imxfb_rect rect;
+	u32 crtc;
+
+	switch (cmd) {
+	case FBIO_WAITFORVSYNC:
+		if (get_user(crtc, (u32 __user *)arg))
+			return -EFAULT;
+		if (crtc != 0)
+			return -ENODEV;
+		return imxfb_wait_for_vsync(fbi);
+
+	case IMXFB_IOCTL_DAMAGE:
+		if (copy_from_user(&rect, (void __user *)arg, sizeof(rect)))
+			return -EFAULT;
+		return imxfb_damage(info, &rect);
+	}
+
+	return -ENOTTY;
+}
+
+/*
+ * imxfb_mmap():
+ *	Video RAM is mapped write combined as usual, the back buffer that
+ *	follows it is mapped cached.
+ */
+static int imxfb_mmap(struct fb_info *info, struct vm_area_struct *vma)
+{
+	struct imxfb_info *fbi = info->par;
+	unsigned long off = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long start, len;
+
+	len = PAGE_ALIGN(info->fix.smem_len);
+	if (off < len) {
+		start = info->fix.smem_start;
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+	} else if (fbi->back_cpu) {
+		off -= len;
+		start = fbi->back_dma;
+		len = PAGE_ALIGN(fbi->back_size);
+	} else {
+		return -EINVAL;
+	}
+
+	if (off >= len || size > len - off)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_IO | VM_RESERVED;
+	return io_remap_pfn_range(vma, vma->vm_start,
+				  (start + off) >> PAGE_SHIFT, size,
+				  vma->vm_page_prot);
+}
+
+static void __init imxfb_init_damage(struct imxfb_info *fbi)
+{
+	if (!fbi->back_size)
+		return;
+
+	fbi->back_cpu = alloc_pages_exact(fbi->back_size,
+					  GFP_KERNEL | __GFP_ZERO);
+	if (!fbi->back_cpu) {
+		dev_warn(&fbi->pdev->dev, "no memory for back buffer\n");
+		return;
+	}
+	fbi->back_dma = dma_map_single(&fbi->pdev->dev, fbi->back_cpu,
+				       fbi->back_size, DMA_BIDIRECTIONAL);
+
+	init_completion(&fbi->dma_done);
+}
+
+static void imxfb_exit_damage(struct imxfb_info *fbi)
+{
+	if (!fbi->back_cpu)
+		return;
+
+	if (fbi->dma_chan)
+		dma_release_channel(fbi->dma_chan);
+	fbi->dma_chan = NULL;
+	dma_unmap_single(&fbi->pdev->dev, fbi->back_dma, fbi->back_size,
+			 DMA_BIDIRECTIONAL);
+	free_pages_exact(fbi->back_cpu, fbi->back_size);
+	fbi->back_cpu = NULL;
+}
+
 /*
  *  imxfb_check_var():
  *    Round up in the following order: bits_per_pixel, xres,
@@ -338,8 +697,17 @@ static int imxfb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
 	var->upper_margin	= imxfb_mode->mode.upper_margin;
 	var->lower_margin	= imxfb_mode->mode.lower_margin;
 	var->sync		= imxfb_mode->mode.sync;
-	var->xres_virtual	= max(var->xres_virtual, var->xres);
-	var->yres_virtual	= max(var->yres_virtual, var->yres);
+	/*
+	 * The line stride is always xres, panning is vertical only and
+	 * limited to the frames that fit into video RAM.
+	 */
+	var->xres_virtual	= var->xres;
+	var->yres_virtual	= min_t(u32, max(var->yres_virtual, var->yres),
+				max_t(u32, var->yres, info->fix.smem_len /
+				      (var->xres * var->bits_per_pixel / 8)));
+	var->xoffset		= 0;
+	var->yoffset		= min(var->yoffset,
+				      var->yres_virtual - var->yres);
 
 	pr_debug("var->bits_per_pixel=%d\n", var->bits_per_pixel);
 
@@ -434,6 +802,8 @@ static int imxfb_set_par(struct fb_info *info)
 	fbi->palette_size = var->bits_per_pixel == 8 ? 256 : 16;
 
 	imxfb_activate_var(var, info);
+	imxfb_set_start(fbi, fbi->screen_dma +
+			var->yoffset * info->fix.line_length);
 
 	return 0;
 }
@@ -527,7 +897,7 @@ static void imxfb_enable_controller(struct imxfb_info *fbi)
 {
 	pr_debug("Enabling LCD controller\n");
 
-	writel(fbi->screen_dma, fbi->regs + LCDC_SSA);
+	writel(fbi->ssa, fbi->regs + LCDC_SSA);
 
 	/* panning offset 0 (0 pixel offset)        */
 	writel(0x00000000, fbi->regs + LCDC_POS);
@@ -560,6 +930,11 @@ static void imxfb_disable_controller(struct imxfb_info *fbi)
 	if (fbi->lcd_power)
 		fbi->lcd_power(0);
 
+	spin_lock_irq(&fbi->lock);
+	writel(0, fbi->regs + LCDC_LCDIER);
+	fbi->ssa_pending = 0;
+	spin_unlock_irq(&fbi->lock);
+
 	if (fbi->clk_enabled) {
 		clk_disable(fbi->clk);
 		fbi->clk_enabled = 0;
@@ -599,6 +974,9 @@ static struct fb_ops imxfb_ops = {
 	.fb_copyarea	= cfb_copyarea,
 	.fb_imageblit	= cfb_imageblit,
 	.fb_blank	= imxfb_blank,
+	.fb_pan_display	= imxfb_pan_display,
+	.fb_ioctl	= imxfb_ioctl,
+	.fb_mmap	= imxfb_mmap,
 };
 
 /*
@@ -709,6 +1087,7 @@ static int __init imxfb_init_fbinfo(struct platform_device *pdev)
 	struct fb_info *info = dev_get_drvdata(&pdev->dev);
 	struct imxfb_info *fbi = info->par;
 	struct imx_fb_videomode *m;
+	u_int buffers;
 	int i;
 
 	pr_debug("%s\n",__func__);
@@ -751,6 +1130,20 @@ static int __init imxfb_init_fbinfo(struct platform_device *pdev)
 		info->fix.smem_len = max_t(size_t, info->fix.smem_len,
 				m->mode.xres * m->mode.yres * m->bpp / 8);
 
+	/* a fixed screen holds exactly one frame */
+	buffers = fb_buffers ? fb_buffers : pdata->num_buffers;
+	if (!buffers || pdata->fixed_screen_cpu)
+		buffers = 1;
+	buffers = min_t(u_int, buffers, IMXFB_MAX_BUFFERS);
+	if (fb_damage || pdata->damage_buffer)
+		fbi->back_size = info->fix.smem_len;
+	info->fix.smem_len *= buffers;
+	if (buffers > 1) {
+		info->fix.ypanstep = 1;
+		/* check_var trims this to the frames in video RAM */
+		info->var.yres_virtual = UINT_MAX;
+	}
+
 	return 0;
 }
 
@@ -836,6 +1229,11 @@ static int __init imxfb_probe(struct platform_device *pdev)
 	if (ret < 0)
 		goto failed_init;
 
+	fbi->pdev = pdev;
+	spin_lock_init(&fbi->lock);
+	init_waitqueue_head(&fbi->vsync_wait);
+	fbi->irq = platform_get_irq(pdev, 0);
+
 	res = request_mem_region(res->start, resource_size(res),
 				DRIVER_NAME);
 	if (!res) {
@@ -882,6 +1280,17 @@ static int __init imxfb_probe(struct platform_device *pdev)
 		fbi->screen_dma = fbi->map_dma;
 		info->fix.smem_start = fbi->screen_dma;
 	}
+	fbi->ssa = fbi->screen_dma;
+
+	if (fbi->irq >= 0) {
+		writel(0, fbi->regs + LCDC_LCDIER);
+		ret = request_irq(fbi->irq, imxfb_irq_handler, 0,
+				  DRIVER_NAME, fbi);
+		if (ret) {
+			dev_err(&pdev->dev, "request_irq failed: %d\n", ret);
+			goto failed_irq;
+		}
+	}
 
 	if (pdata->init) {
 		ret = pdata->init(fbi->pdev);
@@ -916,6 +1325,7 @@ static int __init imxfb_probe(struct platform_device *pdev)
 		goto failed_cmap;
 
 	imxfb_set_par(info);
+	imxfb_init_damage(fbi);
 	ret = register_framebuffer(info);
 	if (ret < 0) {
 		dev_err(&pdev->dev, "failed to register framebuffer\n");
@@ -932,11 +1342,15 @@ static int __init imxfb_probe(struct platform_device *pdev)
 	return 0;
 
 failed_register:
+	imxfb_exit_damage(fbi);
 	fb_dealloc_cmap(&info->cmap);
 failed_cmap:
 	if (pdata->exit)
 		pdata->exit(fbi->pdev);
 failed_platform_init:
+	if (fbi->irq >= 0)
+		free_irq(fbi->irq, fbi);
+failed_irq:
 	if (!pdata->fixed_screen_cpu)
 		dma_free_writecombine(&pdev->dev,fbi->map_size,fbi->map_cpu,
 			fbi->map_dma);
@@ -969,6 +1383,10 @@ static int __devexit imxfb_remove(struct platform_device *pdev)
 	imxfb_exit_backlight(fbi);
 #endif
 	unregister_framebuffer(info);
+	imxfb_exit_damage(fbi);
+
+	if (fbi->irq >= 0)
+		free_irq(fbi->irq, fbi);
 
 	pdata = pdev->dev.platform_data;
 	if (pdata->exit)
@@ -1019,6 +1437,10 @@ static int imxfb_setup(void)
 	while ((opt = strsep(&options, ",")) != NULL) {
 		if (!*opt)
 			continue;
+		else if (!strncmp(opt, "buffers=", 8))
+			fb_buffers = simple_strtoul(opt + 8, NULL, 0);
+		else if (!strcmp(opt, "damage"))
+			fb_damage = 1;
 		else
 			fb_mode = opt;
 	}
@@ -111,6 +111,22 @@ do { \
  * Argument type: pointer to t_adc_convert_param.
  */
 #define IMX_ADC_CONVERT_MULTICHANNEL   _IOWR('p', 0xb4, int)
+/*!
+ * Start timer triggered scans of the general purpose channels. The
+ * results are read from the device with read().
+ * Argument type: pointer to t_adc_stream_param.
+ */
+#define IMX_ADC_STREAM_START           _IOW('p', 0xb5, struct t_adc_stream_param)
+/*!
+ * Stop the scans started with IMX_ADC_STREAM_START.
+ * Argument type: none.
+ */
+#define IMX_ADC_STREAM_STOP            _IO('p', 0xb6)
+/*!
+ * Get the state of the scan buffer.
+ * Argument type: pointer to t_adc_stream_status.
+ */
+#define IMX_ADC_STREAM_STATUS          _IOR('p', 0xb7, struct t_adc_stream_status)
 
 /*! @{ */
 /*!
@@ -189,6 +205,31 @@ struct t_adc_convert_param {
 	unsigned short result[16];
 };
 
+/*!
+ * This structure is used with IOCTL code \a IMX_ADC_STREAM_START.
+ */
+struct t_adc_stream_param {
+	/*
+	 * bitmap of the channels to scan, bit 0 is GER_PURPOSE_ADC0. Each
+	 * scan yields one sample per channel, lowest channel first.
+	 */
+	unsigned int channels;
+	/* scans per second */
+	unsigned int rate;
+};
+
+/*!
+ * This structure is used with IOCTL code \a IMX_ADC_STREAM_STATUS.
+ */
+struct t_adc_stream_status {
+	/* scans lost because the buffer was full or the ADC was busy */
+	unsigned int overruns;
+	/* bytes waiting in the buffer */
+	unsigned int pending;
+	/* non-zero while scans are running */
+	unsigned int running;
+};
+
 /* EXPORTED FUNCTIONS */
 
 #ifdef __KERNEL__